@@ -72,6 +72,9 @@ extern "C" {
 #define TCK_GPIO_Port GPIOA
 #define SWO_Pin GPIO_PIN_3
 #define SWO_GPIO_Port GPIOB
+#define MCP9808_ALERT_Pin GPIO_PIN_5
+#define MCP9808_ALERT_GPIO_Port GPIOB
+#define MCP9808_ALERT_EXTI_IRQn EXTI9_5_IRQn
 	/* USER CODE BEGIN Private defines */
 
 	/* USER CODE END Private defines */
@@ -10,6 +10,15 @@
  * 	- Read alarms
  * 	- Set resolution
  * 	- Read resolution
+ * 	- Read temperature in the background (interrupt or DMA)
+ * 	- Several sensors, read in one sweep
+ * 	- Sample on conversion boundaries, continuous or one-shot (shutdown
+ * 	  between samples)
+ * 	- Alarms on the ALERT pin, queued from its EXTI interrupt
+ * 	- Fixed point readings (Q4, 1/16 C) and batch conversions
+ *
+ * 	Every transfer is a register write and read with a repeated start,
+ * 	bounded by MCP9808_TIMEOUT_MS so a hung bus can't stall the firmware.
  ******************************************************************************
  */
 
@@ -17,6 +26,33 @@
 #define MCP9808_H_
 
 #include "main.h"
+#include "mcp9808_convert.h"
+
+#define MCP9808_TIMEOUT_MS 10 ///> A temperature read takes 0.5 ms at 100 kHz
+#define MCP9808_MAX_INSTANCES 8 ///> Addresses 0x18 to 0x1F
+
+#define MCP9808_ALERT_QUEUE_SIZE 16 ///> Alert events, power of 2
+
+/**
+ * CONFIG register bits.
+ */
+#define MCP9808_CONFIG_HYST_Pos 9 ///> Hysteresis, see MCP9808_Hysteresis_TypeDef
+#define MCP9808_CONFIG_SHDN 0x0100 ///> Shutdown, 0.1 uA instead of 200 uA
+#define MCP9808_CONFIG_CRIT_LOCK 0x0080 ///> T_CRIT locked until power cycle
+#define MCP9808_CONFIG_WIN_LOCK 0x0040 ///> T_UPPER and T_LOWER locked until power cycle
+#define MCP9808_CONFIG_INT_CLEAR 0x0020 ///> Clear the alert in interrupt mode
+#define MCP9808_CONFIG_ALERT_STAT 0x0010 ///> Alert asserted (read only)
+#define MCP9808_CONFIG_ALERT_CNT 0x0008 ///> Alert output enabled
+#define MCP9808_CONFIG_ALERT_SEL 0x0004 ///> Alert on T_CRIT only
+#define MCP9808_CONFIG_ALERT_POL 0x0002 ///> Alert active high
+#define MCP9808_CONFIG_ALERT_MOD 0x0001 ///> Interrupt mode instead of comparator
+
+/**
+ * Limit flags in the top bits of T_AMBIENT.
+ */
+#define MCP9808_FLAG_CRIT 0x04 ///> At or above T_CRIT
+#define MCP9808_FLAG_UPPER 0x02 ///> Above T_UPPER
+#define MCP9808_FLAG_LOWER 0x01 ///> Below T_LOWER
 
 /**
  * Various other registers.
@@ -50,23 +86,141 @@ typedef enum {
 	MCP9808_VeryHigh_Res = 0x03 ///> Highest 0.0625 (Slowest 250 ms)
 } MCP9808_Resolution_TypeDef;
 
+typedef struct MCP9808 MCP9808_TypeDef;
+typedef struct MCP9808_Sweep MCP9808_Sweep_TypeDef;
+
+/**
+ * Sampler conversion modes.
+ */
+typedef enum {
+	MCP9808_Continuous = 0x00, ///> Sensor converts all the time
+	MCP9808_OneShot = 0x01 ///> Sensor shut down, woken for each sample
+} MCP9808_Mode_TypeDef;
+
+/**
+ * ALERT output modes.
+ */
+typedef enum {
+	MCP9808_Comparator = 0x00, ///> Asserted while outside the limits
+	MCP9808_Interrupt = 0x01 ///> Asserted on crossing a limit until cleared
+} MCP9808_AlertMode_TypeDef;
+
+/**
+ * Hysteresis applied to the limits when the temperature comes back.
+ */
+typedef enum {
+	MCP9808_Hyst_0 = 0x00, ///> 0 C
+	MCP9808_Hyst_1_5 = 0x01, ///> 1.5 C
+	MCP9808_Hyst_3 = 0x02, ///> 3 C
+	MCP9808_Hyst_6 = 0x03 ///> 6 C
+} MCP9808_Hysteresis_TypeDef;
+
+/**
+ * Called from interrupt context when a background read finishes.
+ * temperature is only valid when status is HAL_OK.
+ */
+typedef void (*MCP9808_Callback)(MCP9808_TypeDef *mcp9808, HAL_StatusTypeDef status, float temperature);
+
+/**
+ * Called from interrupt context when every sensor of a sweep has been read.
+ */
+typedef void (*MCP9808_SweepCallback)(MCP9808_Sweep_TypeDef *sweep);
+
 /**
  * Struct to hold an instance of MCP9808.
  */
-typedef struct {
+struct MCP9808 {
 		I2C_HandleTypeDef *hi2c;
 		uint8_t address; ///> Default I2C address is 0x18
 		MCP9808_Resolution_TypeDef resolution;
-} MCP9808_TypeDef;
+		uint16_t config; ///> CONFIG as read by MCP9808_Init() or last written
+		uint8_t rx[2]; ///> Background read buffer
+		volatile uint8_t busy; ///> Background read in progress
+		uint32_t start_tick; ///> When the background read started
+		MCP9808_Callback callback;
+		uint32_t timeouts; ///> Background reads given up on
+		GPIO_TypeDef *alert_port; ///> ALERT pin, NULL if not wired
+		uint16_t alert_pin;
+		uint32_t alerts; ///> ALERT edges seen
+		uint32_t alerts_dropped; ///> ALERT edges lost to a full queue
+};
+
+/**
+ * Change of the ALERT output, queued by MCP9808_GPIO_EXTI_Callback().
+ */
+typedef struct {
+		MCP9808_TypeDef *mcp9808;
+		uint32_t tick; ///> HAL tick of the edge
+		uint8_t active; ///> 1 when asserted, 0 when released
+} MCP9808_AlertEvent_TypeDef;
+
+/**
+ * Sensors read one after the other, each read started from the
+ * completion of the previous one, with no CPU work in between.
+ */
+struct MCP9808_Sweep {
+		MCP9808_TypeDef *devices[MCP9808_MAX_INSTANCES];
+		uint8_t num_devices;
+		float temperature[MCP9808_MAX_INSTANCES]; ///> Readings in device order
+		HAL_StatusTypeDef status[MCP9808_MAX_INSTANCES]; ///> Result of each read
+		uint8_t next; ///> Device being read
+		volatile uint8_t busy;
+		uint32_t start_cycles;
+		uint32_t bus_time_us; ///> Start to end of the last sweep
+		uint32_t sweeps;
+		MCP9808_SweepCallback callback;
+};
+
+/**
+ * Reads a sensor once per conversion at most, right after the
+ * conversion has finished. Driven from the main loop.
+ */
+typedef struct {
+		MCP9808_TypeDef *mcp9808;
+		MCP9808_Mode_TypeDef mode;
+		uint32_t interval; ///> ms between samples, 0 for MCP9808_Sampler_Request() only
+		uint32_t due_tick; ///> When the next step is due
+		uint8_t pending; ///> A sample is scheduled
+		uint8_t converting; ///> One-shot, sensor woken for a conversion
+		uint32_t wake_tick; ///> One-shot, when the conversion started
+		uint32_t sample_tick; ///> When the last sample was read
+		uint32_t samples;
+		uint8_t shutdown_pending; ///> One-shot, shutdown after the last sample failed
+		uint32_t shutdown_errors; ///> Failed shutdowns, the sensor kept converting
+} MCP9808_Sampler_TypeDef;
 
 /**
  * Method defintiions.
  */
-void MCP9808_Init(I2C_HandleTypeDef *hi2c, uint8_t addr);
-HAL_StatusTypeDef MCP9808_MeasureTemperature(float *temperature);
-HAL_StatusTypeDef MCP9808_SetResolution(MCP9808_Resolution_TypeDef resolution);
-HAL_StatusTypeDef MCP9808_GetResolution();
-HAL_StatusTypeDef MCP9808_SetTemperatureLimits(MCP9808_Alarm_TypeDef reg, int16_t limit);
-HAL_StatusTypeDef MCP9808_GetTemperatureLimit(MCP9808_Alarm_TypeDef reg, int16_t *limit);
+HAL_StatusTypeDef MCP9808_Init(MCP9808_TypeDef *mcp9808, I2C_HandleTypeDef *hi2c, uint8_t addr);
+HAL_StatusTypeDef MCP9808_MeasureTemperature(MCP9808_TypeDef *mcp9808, float *temperature);
+HAL_StatusTypeDef MCP9808_MeasureTemperatureQ4(MCP9808_TypeDef *mcp9808, int16_t *temperature);
+HAL_StatusTypeDef MCP9808_SetResolution(MCP9808_TypeDef *mcp9808, MCP9808_Resolution_TypeDef resolution);
+HAL_StatusTypeDef MCP9808_GetResolution(MCP9808_TypeDef *mcp9808);
+HAL_StatusTypeDef MCP9808_SetTemperatureLimits(MCP9808_TypeDef *mcp9808, MCP9808_Alarm_TypeDef reg, int16_t limit);
+HAL_StatusTypeDef MCP9808_GetTemperatureLimit(MCP9808_TypeDef *mcp9808, MCP9808_Alarm_TypeDef reg, int16_t *limit);
+HAL_StatusTypeDef MCP9808_MeasureTemperatureAsync(MCP9808_TypeDef *mcp9808, MCP9808_Callback callback);
+uint8_t MCP9808_IsBusy(MCP9808_TypeDef *mcp9808);
+void MCP9808_CheckTimeout(MCP9808_TypeDef *mcp9808);
+void MCP9808_Sweep_Init(MCP9808_Sweep_TypeDef *sweep, MCP9808_SweepCallback callback);
+HAL_StatusTypeDef MCP9808_Sweep_Add(MCP9808_Sweep_TypeDef *sweep, MCP9808_TypeDef *mcp9808);
+HAL_StatusTypeDef MCP9808_Sweep_Start(MCP9808_Sweep_TypeDef *sweep);
+void MCP9808_Sweep_CheckTimeout(MCP9808_Sweep_TypeDef *sweep);
+HAL_StatusTypeDef MCP9808_SetShutdown(MCP9808_TypeDef *mcp9808, uint8_t shutdown);
+uint32_t MCP9808_ConversionTime(MCP9808_TypeDef *mcp9808);
+HAL_StatusTypeDef MCP9808_Sampler_Init(MCP9808_Sampler_TypeDef *sampler, MCP9808_TypeDef *mcp9808,
+		MCP9808_Mode_TypeDef mode, uint32_t interval);
+HAL_StatusTypeDef MCP9808_Sampler_Request(MCP9808_Sampler_TypeDef *sampler);
+HAL_StatusTypeDef MCP9808_Sampler_Run(MCP9808_Sampler_TypeDef *sampler, float *temperature);
+uint32_t MCP9808_Sampler_NextEvent(MCP9808_Sampler_TypeDef *sampler);
+HAL_StatusTypeDef MCP9808_SetAlert(MCP9808_TypeDef *mcp9808, MCP9808_AlertMode_TypeDef mode,
+		MCP9808_Hysteresis_TypeDef hysteresis, uint8_t critical_only, uint8_t lock_critical);
+void MCP9808_EnableAlert(MCP9808_TypeDef *mcp9808, GPIO_TypeDef *port, uint16_t pin);
+HAL_StatusTypeDef MCP9808_ClearAlert(MCP9808_TypeDef *mcp9808);
+HAL_StatusTypeDef MCP9808_GetAlertFlags(MCP9808_TypeDef *mcp9808, uint8_t *flags);
+uint8_t MCP9808_GetAlertEvent(MCP9808_AlertEvent_TypeDef *event);
+void MCP9808_GPIO_EXTI_Callback(uint16_t pin);
+void MCP9808_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c);
+void MCP9808_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c);
 
 #endif // MCP9808_H_
@@ -0,0 +1,46 @@
+/*
+ ******************************************************************************
+ * @file           : mcp9808_convert.h
+ * @brief          : MCP9808 temperature register conversions.
+ * 						Built using a STM32L476RG.
+ ******************************************************************************
+ * 	Plain C without the HAL, so the conversions also build and are tested
+ * 	on the host (see test/).
+ *
+ * 	T_AMBIENT holds the limit flags in bits 15-13 and the temperature as
+ * 	13-bit two's complement in 1/16 C below them. T_UPPER, T_LOWER and
+ * 	T_CRIT use the same format in 0.25 C steps.
+ ******************************************************************************
+ */
+
+#ifndef MCP9808_CONVERT_H_
+#define MCP9808_CONVERT_H_
+
+#include <stdint.h>
+
+/**
+ * T_UPPER, T_LOWER and T_CRIT bits, two's complement in 0.25 C steps.
+ */
+#define MCP9808_LIMIT_MASK 0x1FFC
+#define MCP9808_LIMIT_MIN_Q4 (-256 * 16) ///> -256 C
+#define MCP9808_LIMIT_MAX_Q4 (256 * 16 - 1) ///> Written as 255.75 C
+#define MCP9808_LIMIT_INVALID 0xFFFF ///> From MCP9808_Q4ToLimit() when out of range
+
+/**
+ * Sign extends the 13-bit two's complement temperature of a T_AMBIENT
+ * value, dropping the limit flags above it. No branches.
+ *
+ * @param raw Register value.
+ * @returns Temperature in 1/16 C.
+ */
+static inline int16_t MCP9808_SignExtend(uint16_t raw) {
+	return (int16_t) ((int16_t) (uint16_t) (raw << 3) >> 3);
+}
+
+int16_t MCP9808_RawToQ4(uint16_t raw);
+uint16_t MCP9808_Q4ToLimit(int16_t q4);
+void MCP9808_RawToQ4Batch(const uint16_t *raw, int16_t *q4, uint16_t count);
+void MCP9808_RawToCentiBatch(const uint16_t *raw, int16_t *centi, uint16_t count);
+void MCP9808_RawToFloatBatch(const uint16_t *raw, float *celsius, uint16_t count);
+
+#endif /* MCP9808_CONVERT_H_ */
@@ -31,6 +31,7 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define IDLE_WAIT_MS 1000 // Longest sleep of the main loop
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -40,19 +41,27 @@
 
 /* Private variables ---------------------------------------------------------*/
 I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma_i2c1_rx;
 
 UART_HandleTypeDef huart2;
 
 /* USER CODE BEGIN PV */
+MCP9808_TypeDef mcp9808;
+MCP9808_Sweep_TypeDef sweep;
+MCP9808_Sampler_TypeDef sampler;
+volatile float temperature = 0.00;
 
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_USART2_UART_Init(void);
 static void MX_I2C1_Init(void);
 /* USER CODE BEGIN PFP */
+static void sweep_done(MCP9808_Sweep_TypeDef *sweep);
+static void show_alerts(void);
 
 /* USER CODE END PFP */
 
@@ -88,6 +97,7 @@ int main(void)
 
 	/* Initialize all configured peripherals */
 	MX_GPIO_Init();
+	MX_DMA_Init();
 	MX_USART2_UART_Init();
 	MX_I2C1_Init();
 	/* USER CODE BEGIN 2 */
@@ -95,7 +105,29 @@ int main(void)
 	/*
 	 * Initialise MCP9808 temperature monitor.
 	 */
-	MCP9808_Init(&hi2c1, 0x18);
+	MCP9808_Init(&mcp9808, &hi2c1, 0x18);
+
+	/*
+	 * Every sensor on the bus read in one go, further sensors
+	 * (0x19 to 0x1F) are initialised and added the same way.
+	 */
+	MCP9808_Sweep_Init(&sweep, sweep_done);
+	MCP9808_Sweep_Add(&sweep, &mcp9808);
+
+	/*
+	 * One reading a second. Continuous so the alarms below are checked on
+	 * every conversion, MCP9808_OneShot shuts the sensor down in between.
+	 */
+	MCP9808_Sampler_Init(&sampler, &mcp9808, MCP9808_Continuous, 1000);
+
+	/*
+	 * Alarms on the ALERT pin below 5 C or above 35 C, critical at 45 C
+	 */
+	MCP9808_SetTemperatureLimits(&mcp9808, MCP9808_T_LOWER_REG, 5 * 16);
+	MCP9808_SetTemperatureLimits(&mcp9808, MCP9808_T_UPPER_REG, 35 * 16);
+	MCP9808_SetTemperatureLimits(&mcp9808, MCP9808_T_CRIT_REG, 45 * 16);
+	MCP9808_SetAlert(&mcp9808, MCP9808_Comparator, MCP9808_Hyst_1_5, 0, 0);
+	MCP9808_EnableAlert(&mcp9808, MCP9808_ALERT_GPIO_Port, MCP9808_ALERT_Pin);
 
 	/* USER CODE END 2 */
 
@@ -104,14 +136,37 @@ int main(void)
 	while (1)
 	{
 
-		float temperature = 0.00;
-		MCP9808_MeasureTemperature(&temperature);
-		HAL_Delay(1000);
-		MCP9808_SetTemperatureLimits(MCP9808_T_UPPER_REG, -100);
-		HAL_Delay(1000);
-		int16_t temp_limit;
-		MCP9808_GetTemperatureLimit(MCP9808_T_UPPER_REG, &temp_limit);
-		HAL_Delay(1000);
+		float value;
+		if (MCP9808_Sampler_Run(&sampler, &value) == HAL_OK) {
+			temperature = value;
+		}
+
+		show_alerts();
+
+		/*
+		 * Or every sensor at once
+		 */
+		//MCP9808_Sweep_Start(&sweep);
+		//HAL_Delay(1000);
+		//MCP9808_Sweep_CheckTimeout(&sweep);
+
+		//int16_t temp_limit;
+		//MCP9808_GetTemperatureLimit(&mcp9808, MCP9808_T_UPPER_REG, &temp_limit);
+
+		/*
+		 * Sleep until the sampler has work: 0 is now, HAL_MAX_DELAY is
+		 * nothing scheduled. The ALERT EXTI wakes the core too, its event
+		 * is shown straight away rather than after the wait.
+		 */
+		uint32_t wait = MCP9808_Sampler_NextEvent(&sampler);
+		if (wait > IDLE_WAIT_MS) {
+			wait = IDLE_WAIT_MS;
+		}
+		uint32_t start = HAL_GetTick();
+		while (HAL_GetTick() - start < wait) {
+			__WFI(); // SysTick or EXTI
+			show_alerts();
+		}
 
 		/* USER CODE END WHILE */
 		/* USER CODE BEGIN 3 */
@@ -251,6 +306,22 @@ static void MX_USART2_UART_Init(void)
 
 }
 
+/**
+ * Enable DMA controller clock
+ */
+static void MX_DMA_Init(void)
+{
+
+	/* DMA controller clock enable */
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	/* DMA interrupt init */
+	/* DMA1_Channel7_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+}
+
 /**
  * @brief GPIO Initialization Function
  * @param None
@@ -282,10 +353,56 @@ static void MX_GPIO_Init(void)
 	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
 	HAL_GPIO_Init(LD2_GPIO_Port, &GPIO_InitStruct);
 
+	/*Configure GPIO pin : MCP9808_ALERT_Pin */
+	GPIO_InitStruct.Pin = MCP9808_ALERT_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	HAL_GPIO_Init(MCP9808_ALERT_GPIO_Port, &GPIO_InitStruct);
+
+	/* EXTI interrupt init*/
+	HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
+	HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+
 }
 
 /* USER CODE BEGIN 4 */
 
+/*
+ * All sensors read, readings are in sweep->temperature[] in the order
+ * the sensors were added.
+ */
+static void sweep_done(MCP9808_Sweep_TypeDef *sweep) {
+	if (sweep->status[0] == HAL_OK) {
+		temperature = sweep->temperature[0];
+	}
+}
+
+/*
+ * LED on while outside the limits, from the queued ALERT events.
+ */
+static void show_alerts(void) {
+	MCP9808_AlertEvent_TypeDef event;
+	while (MCP9808_GetAlertEvent(&event)) {
+		HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, event.active ? GPIO_PIN_SET : GPIO_PIN_RESET);
+	}
+}
+
+/*
+ * HAL callbacks are shared between devices on the bus, hand them over
+ * to the MCP9808 driver.
+ */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+	MCP9808_I2C_MemRxCpltCallback(hi2c);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+	MCP9808_I2C_ErrorCallback(hi2c);
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
+	MCP9808_GPIO_EXTI_Callback(GPIO_Pin);
+}
+
 /* USER CODE END 4 */
 
 /**
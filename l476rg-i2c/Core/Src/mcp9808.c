@@ -10,14 +10,40 @@
  * 	- Read alarms
  * 	- Set resolution
  * 	- Read resolution
+ * 	- Read temperature in the background (interrupt or DMA)
+ * 	- Several sensors, read in one sweep
+ * 	- Sample on conversion boundaries, continuous or one-shot
+ * 	- Alarms on the ALERT pin, queued from its EXTI interrupt
+ * 	- Fixed point readings (Q4, 1/16 C) and batch conversions
  ******************************************************************************
  */
 
 #include "mcp9808.h"
 
-static MCP9808_TypeDef mcp9808;
-static HAL_StatusTypeDef MCP9808_Write(MCP9808_REG_TypeDef *_reg, uint8_t *value);
-static HAL_StatusTypeDef MCP9808_Read(MCP9808_REG_TypeDef *_reg, uint8_t *buf, uint8_t buf_size);
+static MCP9808_TypeDef *instances[MCP9808_MAX_INSTANCES];
+static uint8_t num_instances = 0;
+static MCP9808_Sweep_TypeDef *running_sweep = NULL;
+
+/**
+ * Typical conversion time in ms for each resolution.
+ */
+static const uint16_t conversion_time[] = {30, 65, 130, 250};
+
+/**
+ * Alert events, written by the EXTI interrupt and read by the main loop.
+ */
+static MCP9808_AlertEvent_TypeDef alert_queue[MCP9808_ALERT_QUEUE_SIZE];
+static volatile uint32_t alert_head = 0;
+static volatile uint32_t alert_tail = 0;
+
+static HAL_StatusTypeDef MCP9808_Write(MCP9808_TypeDef *mcp9808, uint8_t reg, uint8_t *value, uint8_t size);
+static HAL_StatusTypeDef MCP9808_Read(MCP9808_TypeDef *mcp9808, uint8_t reg, uint8_t *buf, uint8_t buf_size);
+static HAL_StatusTypeDef MCP9808_WriteConfig(MCP9808_TypeDef *mcp9808, uint16_t config);
+static float MCP9808_ConvertTemperature(const uint8_t *buf);
+static MCP9808_TypeDef* MCP9808_FindBusy(I2C_HandleTypeDef *hi2c);
+static void MCP9808_Complete(MCP9808_TypeDef *mcp9808, HAL_StatusTypeDef status);
+static void MCP9808_Sweep_Next(MCP9808_Sweep_TypeDef *sweep);
+static void MCP9808_Sweep_Done(MCP9808_TypeDef *mcp9808, HAL_StatusTypeDef status, float temperature);
 
 /**
  * Initialise MCP9808 struct with i2c handler and address
@@ -26,89 +52,754 @@ static HAL_StatusTypeDef MCP9808_Read(MCP9808_REG_TypeDef *_reg, uint8_t *buf, u
  * Address (7-bits) is shifted left to make room for the read
  * write bit.
  *
+ * CONFIG is read back rather than assumed to be the power-on 0: a reset
+ * of the MCU leaves the sensor as it was, shut down or with its limits
+ * locked.
+ *
+ * @param mcp9808 A pointer to the instance to set up.
  * @param hi2c A pointer to the I2C handler.
  * @param addr Address of MCP9808 on I2C bus (default 0x18).
+ * @returns res HAL_ERROR if MCP9808_MAX_INSTANCES are already in use,
+ * the I2C status if CONFIG can't be read.
  */
-void MCP9808_Init(I2C_HandleTypeDef *hi2c, uint8_t addr) {
-	mcp9808.hi2c = hi2c;
-	mcp9808.address = addr << 1;
-	mcp9808.resolution = MCP9808_VeryHigh_Res;
+HAL_StatusTypeDef MCP9808_Init(MCP9808_TypeDef *mcp9808, I2C_HandleTypeDef *hi2c, uint8_t addr) {
+
+	uint8_t i = 0;
+	while(i < num_instances && instances[i] != mcp9808) {
+		i++;
+	}
+	if(i == num_instances) {
+		if(num_instances >= MCP9808_MAX_INSTANCES) {
+			return HAL_ERROR;
+		}
+		instances[num_instances++] = mcp9808;
+	}
+
+	memset(mcp9808, 0, sizeof(MCP9808_TypeDef));
+	mcp9808->hi2c = hi2c;
+	mcp9808->address = addr << 1;
+	mcp9808->resolution = MCP9808_VeryHigh_Res;
+
+	uint8_t buf[2];
+	HAL_StatusTypeDef res = MCP9808_Read(mcp9808, MCP9808_CONFIG_REG, buf, sizeof(buf));
+	if(res != HAL_OK) {
+		return res;
+	}
+	// Status bits are not written back
+	mcp9808->config = ((buf[0] << 8) | buf[1]) & ~(MCP9808_CONFIG_ALERT_STAT | MCP9808_CONFIG_INT_CLEAR);
+
+	return HAL_OK;
 }
 
 /**
  * Writes to a MCP9808 register with a value.
  *
- * @param _reg Pointer to a register.
- * @param value The data on which to send.
+ * @param mcp9808 A pointer to the instance.
+ * @param reg Register to write to.
+ * @param value The data on which to send, most significant byte first.
+ * @param size Number of bytes in value.
  * @returns res HAL status code.
  */
-static HAL_StatusTypeDef MCP9808_Write(MCP9808_REG_TypeDef *_reg, uint8_t *value) {
-	uint8_t reg[] = {*_reg, *value};
-	HAL_StatusTypeDef res = HAL_I2C_Master_Transmit(mcp9808.hi2c, mcp9808.address,
-			reg, sizeof(reg), HAL_MAX_DELAY);
-
-	return res;
+static HAL_StatusTypeDef MCP9808_Write(MCP9808_TypeDef *mcp9808, uint8_t reg, uint8_t *value, uint8_t size) {
+	return HAL_I2C_Mem_Write(mcp9808->hi2c, mcp9808->address, reg, I2C_MEMADD_SIZE_8BIT,
+			value, size, MCP9808_TIMEOUT_MS);
 }
 
 /**
- * Read data from MCP9808. Requires a write command to get a reply.
+ * Read data from MCP9808. The register pointer is written and read back
+ * with a repeated start, so no other master can get in between.
  *
- * @param _reg Pointer to a register.
+ * @param mcp9808 A pointer to the instance.
+ * @param reg Register to read from.
  * @param buf A pointer to a buffer to store the response in.
  * @param buf_size The size of the buffer (n values).
  * @returns res HAL status code.
  */
-static HAL_StatusTypeDef MCP9808_Read(MCP9808_REG_TypeDef *_reg, uint8_t *buf, uint8_t buf_size) {
-
-	uint8_t reg[1] = {*_reg};
-	HAL_StatusTypeDef res = HAL_I2C_Master_Transmit(mcp9808.hi2c, mcp9808.address,
-			reg, sizeof(reg), HAL_MAX_DELAY);
-
-
-	if(res != HAL_OK){
-		return res;
-	}
+static HAL_StatusTypeDef MCP9808_Read(MCP9808_TypeDef *mcp9808, uint8_t reg, uint8_t *buf, uint8_t buf_size) {
+	return HAL_I2C_Mem_Read(mcp9808->hi2c, mcp9808->address, reg, I2C_MEMADD_SIZE_8BIT,
+			buf, buf_size, MCP9808_TIMEOUT_MS);
+}
 
-	res = HAL_I2C_Master_Receive(mcp9808.hi2c, mcp9808.address, buf, buf_size, HAL_MAX_DELAY);
+/**
+ * Writes the 16-bit CONFIG register and remembers the value.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param config Register value.
+ * @returns res HAL status code.
+ */
+static HAL_StatusTypeDef MCP9808_WriteConfig(MCP9808_TypeDef *mcp9808, uint16_t config) {
+	uint8_t buf[2] = {config >> 8, config & 0xFF};
+	HAL_StatusTypeDef res = MCP9808_Write(mcp9808, MCP9808_CONFIG_REG, buf, sizeof(buf));
 
-	if(res != HAL_OK){
-		return res;
+	if(res == HAL_OK) {
+		mcp9808->config = config;
 	}
 
 	return res;
 }
 
+/**
+ * Converts the two bytes of the ambient temperature register to
+ * degrees Celsius.
+ *
+ * @param buf Register value, most significant byte first.
+ * @returns Temperature in degrees Celsius.
+ */
+static float MCP9808_ConvertTemperature(const uint8_t *buf) {
+	return MCP9808_SignExtend((buf[0] << 8) | buf[1]) * 0.0625f;
+}
+
 /**
  * Preforms complete measure temperature command in degrees Celsius.
  * Resulting value will be calculated at the devices previously set
  * resolution.
  *
+ * @param mcp9808 A pointer to the instance.
  * @param temperature A pointer to a temperature float to store a returned
  * value from.
  * @returns res HAL status code.
  */
-HAL_StatusTypeDef MCP9808_MeasureTemperature(float *temperature) {
+HAL_StatusTypeDef MCP9808_MeasureTemperature(MCP9808_TypeDef *mcp9808, float *temperature) {
 
-	MCP9808_REG_TypeDef reg = MCP9808_T_AMBIENT_REG;
 	uint8_t buf[2];
-	HAL_StatusTypeDef res = MCP9808_Read(&reg, buf, sizeof(buf));
+	HAL_StatusTypeDef res = MCP9808_Read(mcp9808, MCP9808_T_AMBIENT_REG, buf, sizeof(buf));
 
 	if(res == HAL_OK) {
-		uint8_t upper = buf[0];
-		upper &= 0x1F;
-		uint8_t lower = buf[1];
+		*temperature = MCP9808_ConvertTemperature(buf);
+	}
+
+	return res;
+}
+
+/**
+ * Measures the temperature as Q4 fixed point, 1/16 C per bit
+ * (e.g. 400 is 25.0 C, -8 is -0.5 C). No floating point involved.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param temperature A pointer to store the temperature in.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_MeasureTemperatureQ4(MCP9808_TypeDef *mcp9808, int16_t *temperature) {
+
+	uint8_t buf[2];
+	HAL_StatusTypeDef res = MCP9808_Read(mcp9808, MCP9808_T_AMBIENT_REG, buf, sizeof(buf));
+
+	if(res == HAL_OK) {
+		*temperature = MCP9808_SignExtend((buf[0] << 8) | buf[1]);
+	}
+
+	return res;
+}
+
+/**
+ * Starts a temperature read in the background and returns straight away.
+ * The transfer uses DMA when the I2C handle has a receive DMA channel
+ * linked, interrupts otherwise. The callback is given the result from
+ * interrupt context.
+ *
+ * MCP9808_CheckTimeout() must be called regularly (e.g. from the main
+ * loop) to recover from a read that never finishes.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param callback Function to receive the temperature.
+ * @returns res HAL status code, HAL_BUSY if the sensor or the bus is busy.
+ */
+HAL_StatusTypeDef MCP9808_MeasureTemperatureAsync(MCP9808_TypeDef *mcp9808, MCP9808_Callback callback) {
+
+	if(mcp9808->busy) {
+		return HAL_BUSY;
+	}
+
+	mcp9808->callback = callback;
+	mcp9808->start_tick = HAL_GetTick();
+	mcp9808->busy = 1;
+
+	HAL_StatusTypeDef res;
+	if(mcp9808->hi2c->hdmarx != NULL) {
+		res = HAL_I2C_Mem_Read_DMA(mcp9808->hi2c, mcp9808->address, MCP9808_T_AMBIENT_REG,
+				I2C_MEMADD_SIZE_8BIT, mcp9808->rx, sizeof(mcp9808->rx));
+	} else {
+		res = HAL_I2C_Mem_Read_IT(mcp9808->hi2c, mcp9808->address, MCP9808_T_AMBIENT_REG,
+				I2C_MEMADD_SIZE_8BIT, mcp9808->rx, sizeof(mcp9808->rx));
+	}
+
+	if(res != HAL_OK) {
+		mcp9808->busy = 0;
+	}
+
+	return res;
+}
+
+/**
+ * Whether a background read is in progress.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @returns 1 if busy, 0 otherwise.
+ */
+uint8_t MCP9808_IsBusy(MCP9808_TypeDef *mcp9808) {
+	return mcp9808->busy;
+}
+
+/**
+ * Gives up on a background read that has run for longer than
+ * MCP9808_TIMEOUT_MS. The I2C peripheral is reset and the callback is
+ * given HAL_TIMEOUT.
+ *
+ * @param mcp9808 A pointer to the instance.
+ */
+void MCP9808_CheckTimeout(MCP9808_TypeDef *mcp9808) {
+
+	if(!mcp9808->busy || (HAL_GetTick() - mcp9808->start_tick) < MCP9808_TIMEOUT_MS) {
+		return;
+	}
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint8_t busy = mcp9808->busy;
+	mcp9808->busy = 0;
+	__set_PRIMASK(primask);
+
+	if(!busy) {
+		// Finished meanwhile
+		return;
+	}
+
+	HAL_I2C_DeInit(mcp9808->hi2c);
+	HAL_I2C_Init(mcp9808->hi2c);
+	mcp9808->timeouts++;
+
+	MCP9808_Complete(mcp9808, HAL_TIMEOUT);
+}
+
+/**
+ * Background read complete.
+ * Call from HAL_I2C_MemRxCpltCallback().
+ *
+ * @param hi2c A pointer to the I2C handler.
+ */
+void MCP9808_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+	MCP9808_TypeDef *mcp9808 = MCP9808_FindBusy(hi2c);
+	if(mcp9808 != NULL) {
+		MCP9808_Complete(mcp9808, HAL_OK);
+	}
+}
+
+/**
+ * Background read failed, e.g. the sensor did not acknowledge.
+ * Call from HAL_I2C_ErrorCallback().
+ *
+ * @param hi2c A pointer to the I2C handler.
+ */
+void MCP9808_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+	MCP9808_TypeDef *mcp9808 = MCP9808_FindBusy(hi2c);
+	if(mcp9808 != NULL) {
+		MCP9808_Complete(mcp9808, HAL_ERROR);
+	}
+}
+
+/**
+ * The sensor with a background read running on the I2C bus. The bus
+ * only carries one transfer at a time.
+ *
+ * @param hi2c A pointer to the I2C handler.
+ * @returns The instance, or NULL if none is busy.
+ */
+static MCP9808_TypeDef* MCP9808_FindBusy(I2C_HandleTypeDef *hi2c) {
+	for(uint8_t i = 0; i < num_instances; i++) {
+		if(instances[i]->hi2c == hi2c && instances[i]->busy) {
+			return instances[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Ends the background read and hands the result to the callback.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param status HAL status code of the transfer.
+ */
+static void MCP9808_Complete(MCP9808_TypeDef *mcp9808, HAL_StatusTypeDef status) {
+	mcp9808->busy = 0;
+
+	float temperature = 0.0f;
+	if(status == HAL_OK) {
+		temperature = MCP9808_ConvertTemperature(mcp9808->rx);
+	}
+
+	if(mcp9808->callback != NULL) {
+		mcp9808->callback(mcp9808, status, temperature);
+	}
+}
+
+/**
+ * Set up an empty sweep. Enables the DWT cycle counter to time it.
+ *
+ * @param sweep A pointer to the sweep.
+ * @param callback Function called when all sensors have been read, or NULL.
+ */
+void MCP9808_Sweep_Init(MCP9808_Sweep_TypeDef *sweep, MCP9808_SweepCallback callback) {
+	memset(sweep, 0, sizeof(MCP9808_Sweep_TypeDef));
+	sweep->callback = callback;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * Add an initialised sensor to the sweep. Readings come back in the
+ * order the sensors were added.
+ *
+ * @param sweep A pointer to the sweep.
+ * @param mcp9808 A pointer to the instance.
+ * @returns res HAL_ERROR if the sweep is full.
+ */
+HAL_StatusTypeDef MCP9808_Sweep_Add(MCP9808_Sweep_TypeDef *sweep, MCP9808_TypeDef *mcp9808) {
+	if(sweep->num_devices >= MCP9808_MAX_INSTANCES) {
+		return HAL_ERROR;
+	}
+	sweep->devices[sweep->num_devices++] = mcp9808;
+	return HAL_OK;
+}
+
+/**
+ * Read the temperature of every sensor in the sweep in the background.
+ * Each read is started from the completion interrupt of the one before,
+ * so the bus is never idle waiting for the main loop. A sensor that
+ * fails is skipped, see status[].
+ *
+ * One sweep runs at a time. MCP9808_Sweep_CheckTimeout() must be
+ * called regularly (e.g. from the main loop).
+ *
+ * @param sweep A pointer to the sweep.
+ * @returns res HAL_BUSY if a sweep is already running.
+ */
+HAL_StatusTypeDef MCP9808_Sweep_Start(MCP9808_Sweep_TypeDef *sweep) {
+
+	if(sweep->num_devices == 0) {
+		return HAL_ERROR;
+	}
+	if(running_sweep != NULL) {
+		return HAL_BUSY;
+	}
+
+	running_sweep = sweep;
+	sweep->busy = 1;
+	sweep->next = 0;
+	sweep->start_cycles = DWT->CYCCNT;
+
+	MCP9808_Sweep_Next(sweep);
+
+	return HAL_OK;
+}
+
+/**
+ * Recover from a sweep read that never finishes, the sweep carries on
+ * with the next sensor.
+ *
+ * @param sweep A pointer to the sweep.
+ */
+void MCP9808_Sweep_CheckTimeout(MCP9808_Sweep_TypeDef *sweep) {
+	if(sweep->busy) {
+		MCP9808_CheckTimeout(sweep->devices[sweep->next]);
+	}
+}
+
+/**
+ * Start the read of the next sensor, or finish the sweep.
+ *
+ * @param sweep A pointer to the sweep.
+ */
+static void MCP9808_Sweep_Next(MCP9808_Sweep_TypeDef *sweep) {
+
+	while(sweep->next < sweep->num_devices) {
+		MCP9808_TypeDef *mcp9808 = sweep->devices[sweep->next];
+		HAL_StatusTypeDef res = MCP9808_MeasureTemperatureAsync(mcp9808, MCP9808_Sweep_Done);
+		if(res == HAL_OK) {
+			return;
+		}
+		sweep->status[sweep->next] = res;
+		sweep->next++;
+	}
+
+	uint32_t cycles = DWT->CYCCNT - sweep->start_cycles;
+	sweep->bus_time_us = cycles / (SystemCoreClock / 1000000);
+	sweep->sweeps++;
+	sweep->busy = 0;
+	running_sweep = NULL;
 
-		if((upper & 0x10) == 0x10) {
-			upper &= 0x0F;
-			*temperature = 256 - (upper * 16.0) + (lower / 16.0);
+	if(sweep->callback != NULL) {
+		sweep->callback(sweep);
+	}
+}
+
+/**
+ * A sweep read has finished, store it and move on.
+ */
+static void MCP9808_Sweep_Done(MCP9808_TypeDef *mcp9808, HAL_StatusTypeDef status, float temperature) {
+	MCP9808_Sweep_TypeDef *sweep = running_sweep;
+	if(sweep == NULL || sweep->devices[sweep->next] != mcp9808) {
+		return;
+	}
+
+	sweep->status[sweep->next] = status;
+	if(status == HAL_OK) {
+		sweep->temperature[sweep->next] = temperature;
+	}
+	sweep->next++;
+
+	MCP9808_Sweep_Next(sweep);
+}
+
+/**
+ * Puts the sensor in shutdown or wakes it up. A shut down sensor keeps
+ * its last reading and stops converting. Conversions start again when
+ * it wakes up, the first one is ready MCP9808_ConversionTime() later.
+ *
+ * The sensor ignores shutdown while the critical or window limits are
+ * locked.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param shutdown 1 to shut down, 0 to wake up.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_SetShutdown(MCP9808_TypeDef *mcp9808, uint8_t shutdown) {
+	uint16_t config = mcp9808->config & ~MCP9808_CONFIG_SHDN;
+	if(shutdown) {
+		config |= MCP9808_CONFIG_SHDN;
+	}
+	return MCP9808_WriteConfig(mcp9808, config);
+}
+
+/**
+ * Time one conversion takes at the current resolution, with 10 % for
+ * the sensor's oscillator and 1 ms for the tick.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @returns Conversion time in ms.
+ */
+uint32_t MCP9808_ConversionTime(MCP9808_TypeDef *mcp9808) {
+	uint32_t time = conversion_time[mcp9808->resolution & 0x03];
+	return time + time / 10 + 1;
+}
+
+/**
+ * Set up a sampler for a sensor. Every sample is read once a conversion
+ * has completed since the previous one, so no reading is returned
+ * twice.
+ *
+ * Continuous: the sensor converts all the time and is read every
+ * interval, the first time one conversion after this call.
+ * One-shot: the sensor stays shut down and is woken every interval for
+ * a single conversion, read as soon as it completes and shut down
+ * again.
+ *
+ * The interval is raised to one conversion if shorter. With an
+ * interval of 0 samples are only taken on MCP9808_Sampler_Request().
+ *
+ * @param sampler A pointer to the sampler.
+ * @param mcp9808 A pointer to the instance.
+ * @param mode Continuous or one-shot.
+ * @param interval ms between samples.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_Sampler_Init(MCP9808_Sampler_TypeDef *sampler, MCP9808_TypeDef *mcp9808,
+		MCP9808_Mode_TypeDef mode, uint32_t interval) {
+
+	memset(sampler, 0, sizeof(MCP9808_Sampler_TypeDef));
+	sampler->mcp9808 = mcp9808;
+	sampler->mode = mode;
+
+	uint32_t conversion = MCP9808_ConversionTime(mcp9808);
+	if(interval != 0 && interval < conversion) {
+		interval = conversion;
+	}
+	sampler->interval = interval;
+
+	HAL_StatusTypeDef res = MCP9808_SetShutdown(mcp9808, mode == MCP9808_OneShot);
+	if(res != HAL_OK) {
+		return res;
+	}
+
+	uint32_t now = HAL_GetTick();
+	sampler->pending = (interval != 0);
+	if(mode == MCP9808_Continuous) {
+		// Woken up just now, treat it like the last read
+		sampler->sample_tick = now;
+		sampler->due_tick = now + conversion;
+	} else {
+		sampler->due_tick = now;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Take a sample as soon as possible: straight away in continuous mode
+ * unless the last read was less than a conversion ago, one conversion
+ * from now in one-shot mode.
+ *
+ * @param sampler A pointer to the sampler.
+ * @returns res HAL_BUSY if a sample is already scheduled.
+ */
+HAL_StatusTypeDef MCP9808_Sampler_Request(MCP9808_Sampler_TypeDef *sampler) {
+
+	if(sampler->pending) {
+		return HAL_BUSY;
+	}
+
+	uint32_t now = HAL_GetTick();
+	sampler->due_tick = now;
+	if(sampler->mode == MCP9808_Continuous) {
+		uint32_t fresh_tick = sampler->sample_tick + MCP9808_ConversionTime(sampler->mcp9808);
+		if((int32_t) (fresh_tick - now) > 0) {
+			sampler->due_tick = fresh_tick;
+		}
+	}
+	sampler->pending = 1;
+
+	return HAL_OK;
+}
+
+/**
+ * Does whatever is due: wakes the sensor in one-shot mode, reads it
+ * once its conversion is done. Call from the main loop, at the latest
+ * MCP9808_Sampler_NextEvent() ms after the last call.
+ *
+ * A one-shot sensor that could not be shut down after its sample keeps
+ * converting, that is retried on every call until it goes through
+ * (counted in shutdown_errors).
+ *
+ * @param sampler A pointer to the sampler.
+ * @param temperature A pointer to store a new reading in.
+ * @returns res HAL_OK with a new reading, HAL_BUSY if there is none yet,
+ * error otherwise (retried after MCP9808_TIMEOUT_MS).
+ */
+HAL_StatusTypeDef MCP9808_Sampler_Run(MCP9808_Sampler_TypeDef *sampler, float *temperature) {
+
+	MCP9808_TypeDef *mcp9808 = sampler->mcp9808;
+	if(sampler->shutdown_pending) {
+		if(MCP9808_SetShutdown(mcp9808, 1) == HAL_OK) {
+			sampler->shutdown_pending = 0;
 		} else {
-			*temperature = (upper * 16.0) + (lower / 16.0);
+			sampler->shutdown_errors++;
 		}
 	}
 
+	uint32_t now = HAL_GetTick();
+	if(!sampler->pending || (int32_t) (now - sampler->due_tick) < 0) {
+		return HAL_BUSY;
+	}
+
+	uint32_t conversion = MCP9808_ConversionTime(mcp9808);
+	HAL_StatusTypeDef res;
+
+	if(sampler->mode == MCP9808_OneShot && !sampler->converting) {
+		res = MCP9808_SetShutdown(mcp9808, 0);
+		if(res != HAL_OK) {
+			sampler->due_tick = now + MCP9808_TIMEOUT_MS;
+			return res;
+		}
+		sampler->converting = 1;
+		sampler->shutdown_pending = 0;
+		sampler->wake_tick = now;
+		sampler->due_tick = now + conversion;
+		return HAL_BUSY;
+	}
+
+	res = MCP9808_MeasureTemperature(mcp9808, temperature);
+	if(res != HAL_OK) {
+		sampler->due_tick = now + MCP9808_TIMEOUT_MS;
+		return res;
+	}
+
+	sampler->samples++;
+	sampler->sample_tick = now;
+
+	uint32_t next_tick;
+	uint32_t earliest_tick;
+	if(sampler->mode == MCP9808_OneShot) {
+		sampler->converting = 0;
+		// The reading is good either way, retry the shutdown from the next call
+		if(MCP9808_SetShutdown(mcp9808, 1) != HAL_OK) {
+			sampler->shutdown_pending = 1;
+			sampler->shutdown_errors++;
+		}
+		next_tick = sampler->wake_tick + sampler->interval;
+		earliest_tick = now;
+	} else {
+		next_tick = sampler->due_tick + sampler->interval;
+		earliest_tick = now + conversion;
+	}
+
+	if(sampler->interval == 0) {
+		sampler->pending = 0;
+	} else {
+		// Late, skip rather than read a conversion twice
+		if((int32_t) (earliest_tick - next_tick) > 0) {
+			next_tick = earliest_tick;
+		}
+		sampler->due_tick = next_tick;
+	}
+
+	return HAL_OK;
+}
+
+/**
+ * Time until MCP9808_Sampler_Run() has something to do, at most
+ * MCP9808_TIMEOUT_MS while a failed shutdown is being retried.
+ *
+ * @param sampler A pointer to the sampler.
+ * @returns ms to wait, HAL_MAX_DELAY if no sample is scheduled.
+ */
+uint32_t MCP9808_Sampler_NextEvent(MCP9808_Sampler_TypeDef *sampler) {
+
+	uint32_t retry = sampler->shutdown_pending ? MCP9808_TIMEOUT_MS : HAL_MAX_DELAY;
+	if(!sampler->pending) {
+		return retry;
+	}
+
+	int32_t wait = (int32_t) (sampler->due_tick - HAL_GetTick());
+	if(wait <= 0) {
+		return 0;
+	}
+	return ((uint32_t) wait < retry) ? (uint32_t) wait : retry;
+}
+
+/**
+ * Configure the ALERT output. Limits are set with
+ * MCP9808_SetTemperatureLimits(), the output is open drain and active
+ * low. Shutdown is kept as it was, alerts need the sensor converting.
+ *
+ * Comparator mode follows the temperature: asserted outside the limits,
+ * released once back inside by the hysteresis. Interrupt mode asserts on
+ * every crossing until MCP9808_ClearAlert(), except above T_CRIT where
+ * it stays asserted until the temperature drops below it.
+ *
+ * Hysteresis can't be changed while a limit is locked, and locks set
+ * before are kept.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param mode Comparator or interrupt.
+ * @param hysteresis Hysteresis on the limits.
+ * @param critical_only 1 to alert on T_CRIT only.
+ * @param lock_critical 1 to lock T_CRIT until the sensor is power cycled.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_SetAlert(MCP9808_TypeDef *mcp9808, MCP9808_AlertMode_TypeDef mode,
+		MCP9808_Hysteresis_TypeDef hysteresis, uint8_t critical_only, uint8_t lock_critical) {
+
+	// Locks can only be cleared by a power cycle, keep them in the cache
+	uint16_t config = mcp9808->config & (MCP9808_CONFIG_SHDN | MCP9808_CONFIG_CRIT_LOCK | MCP9808_CONFIG_WIN_LOCK);
+	config |= (hysteresis & 0x03) << MCP9808_CONFIG_HYST_Pos;
+	config |= MCP9808_CONFIG_ALERT_CNT;
+	if(mode == MCP9808_Interrupt) {
+		config |= MCP9808_CONFIG_ALERT_MOD;
+	}
+	if(critical_only) {
+		config |= MCP9808_CONFIG_ALERT_SEL;
+	}
+	if(lock_critical) {
+		config |= MCP9808_CONFIG_CRIT_LOCK;
+	}
+
+	return MCP9808_WriteConfig(mcp9808, config);
+}
+
+/**
+ * Queue the edges of the sensor's ALERT pin, configured as an EXTI
+ * line on both edges with a pull-up.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param port GPIO port of the ALERT pin.
+ * @param pin GPIO pin of the ALERT pin.
+ */
+void MCP9808_EnableAlert(MCP9808_TypeDef *mcp9808, GPIO_TypeDef *port, uint16_t pin) {
+	mcp9808->alert_pin = pin;
+	mcp9808->alert_port = port;
+}
+
+/**
+ * Release the ALERT output in interrupt mode.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_ClearAlert(MCP9808_TypeDef *mcp9808) {
+	uint16_t config = mcp9808->config | MCP9808_CONFIG_INT_CLEAR;
+	uint8_t buf[2] = {config >> 8, config & 0xFF};
+	return MCP9808_Write(mcp9808, MCP9808_CONFIG_REG, buf, sizeof(buf));
+}
+
+/**
+ * Which limits the temperature is outside of, to find out what an
+ * alert was for.
+ *
+ * @param mcp9808 A pointer to the instance.
+ * @param flags A pointer to store MCP9808_FLAG_CRIT, _UPPER and _LOWER in.
+ * @returns res HAL status code.
+ */
+HAL_StatusTypeDef MCP9808_GetAlertFlags(MCP9808_TypeDef *mcp9808, uint8_t *flags) {
+
+	uint8_t buf[2];
+	HAL_StatusTypeDef res = MCP9808_Read(mcp9808, MCP9808_T_AMBIENT_REG, buf, sizeof(buf));
+
+	if(res == HAL_OK) {
+		*flags = buf[0] >> 5;
+	}
+
 	return res;
 }
 
+/**
+ * Take the oldest alert event from the queue. Call from the main loop.
+ *
+ * @param event A pointer to store the event in.
+ * @returns 1 if an event was taken, 0 if the queue is empty.
+ */
+uint8_t MCP9808_GetAlertEvent(MCP9808_AlertEvent_TypeDef *event) {
+
+	uint32_t tail = alert_tail;
+	if(tail == alert_head) {
+		return 0;
+	}
+
+	*event = alert_queue[tail & (MCP9808_ALERT_QUEUE_SIZE - 1)];
+	alert_tail = tail + 1;
+
+	return 1;
+}
+
+/**
+ * An ALERT pin has changed, queue the event. No I2C traffic.
+ * Call from HAL_GPIO_EXTI_Callback().
+ *
+ * @param pin GPIO pin that triggered.
+ */
+void MCP9808_GPIO_EXTI_Callback(uint16_t pin) {
+
+	for(uint8_t i = 0; i < num_instances; i++) {
+		MCP9808_TypeDef *mcp9808 = instances[i];
+		if(mcp9808->alert_port == NULL || mcp9808->alert_pin != pin) {
+			continue;
+		}
+
+		mcp9808->alerts++;
+
+		uint32_t head = alert_head;
+		if(head - alert_tail >= MCP9808_ALERT_QUEUE_SIZE) {
+			mcp9808->alerts_dropped++;
+			continue;
+		}
+
+		MCP9808_AlertEvent_TypeDef *event = &alert_queue[head & (MCP9808_ALERT_QUEUE_SIZE - 1)];
+		event->mcp9808 = mcp9808;
+		event->tick = HAL_GetTick();
+		event->active = HAL_GPIO_ReadPin(mcp9808->alert_port, pin) == GPIO_PIN_RESET;
+		alert_head = head + 1;
+	}
+}
+
 /**
  * Set the resolution of the temperature reading.
  *
@@ -117,18 +808,18 @@ HAL_StatusTypeDef MCP9808_MeasureTemperature(float *temperature) {
  * High = 0.125  (130 ms)
  * VeryHigh = 0.0625 (slowest 250 ms)
  *
+ * @param mcp9808 A pointer to the instance.
  * @param resolution Desired resolution to switch to.
  * @returns res HAL status code.
  */
-HAL_StatusTypeDef MCP9808_SetResolution(MCP9808_Resolution_TypeDef resolution) {
+HAL_StatusTypeDef MCP9808_SetResolution(MCP9808_TypeDef *mcp9808, MCP9808_Resolution_TypeDef resolution) {
 
-	MCP9808_REG_TypeDef reg = MCP9808_RESOLUTION_REG;
 	uint8_t value = resolution & 0x03;
 
-	HAL_StatusTypeDef res = MCP9808_Write(&reg, &value);
+	HAL_StatusTypeDef res = MCP9808_Write(mcp9808, MCP9808_RESOLUTION_REG, &value, sizeof(value));
 
 	if(res == HAL_OK) {
-		mcp9808.resolution = resolution;
+		mcp9808->resolution = resolution;
 	}
 
 	return res;
@@ -142,76 +833,55 @@ HAL_StatusTypeDef MCP9808_SetResolution(MCP9808_Resolution_TypeDef resolution) {
  * High = 0.125  (130 ms) 0x02
  * VeryHigh = 0.0625 (slowest 250 ms) 0x03
  *
+ * @param mcp9808 A pointer to the instance.
  * @returns res HAL status code.
  */
-HAL_StatusTypeDef MCP9808_GetResolution() {
+HAL_StatusTypeDef MCP9808_GetResolution(MCP9808_TypeDef *mcp9808) {
 
-	MCP9808_REG_TypeDef reg = MCP9808_RESOLUTION_REG;
 	uint8_t buf[1];
-	return MCP9808_Read(&reg, buf, sizeof(buf));
+	return MCP9808_Read(mcp9808, MCP9808_RESOLUTION_REG, buf, sizeof(buf));
 }
 
 /**
- * Set upper, lower and critical temperature alarm limits.
+ * Set upper, lower and critical temperature alarm limits. The registers
+ * hold 13-bit two's complement in 0.25 C steps, finer bits of the limit
+ * are dropped (rounding down).
  *
+ * @param mcp9808 A pointer to the instance.
  * @param reg Alarm register to assign limit to.
- * @param limit The temperature limit on which to enforce.
- * @returns res HAL status code.
+ * @param limit The temperature limit in 1/16 C (Q4, e.g. 35 * 16 for 35 C).
+ * @returns res HAL_ERROR for a limit outside -256 C to 255.9375 C,
+ * HAL status code otherwise.
  */
-HAL_StatusTypeDef MCP9808_SetTemperatureLimits(MCP9808_Alarm_TypeDef reg, int16_t limit) {
+HAL_StatusTypeDef MCP9808_SetTemperatureLimits(MCP9808_TypeDef *mcp9808, MCP9808_Alarm_TypeDef reg, int16_t limit) {
 
-	uint8_t buf[2];
-
-	if(limit < 0){
-		limit = -limit;
-		buf[1] = ((limit & 0xFF) >> 4) | 0x10; ///< Mask sign bit to 1 (represents negative limit)
-	} else {
-		buf[1] = (limit & 0xFF) >> 4;
+	uint16_t value = MCP9808_Q4ToLimit(limit);
+	if(value == MCP9808_LIMIT_INVALID) {
+		return HAL_ERROR;
 	}
-	buf[0] = (limit & 0xFF) << 4;
 
-	uint8_t toSend[3] = {reg, buf[1], buf[0]};
-	HAL_StatusTypeDef res = HAL_I2C_Master_Transmit(mcp9808.hi2c, mcp9808.address,
-				toSend, sizeof(toSend), HAL_MAX_DELAY);
-
-	return res;
+	uint8_t toSend[2] = {value >> 8, value & 0xFF};
+	return MCP9808_Write(mcp9808, reg, toSend, sizeof(toSend));
 }
 
 /**
  * Reads a value from an alarm register.
  *
+ * @param mcp9808 A pointer to the instance.
  * @param _reg Alarm register to read limit.
- * @param limit A pointer to store the limit in.
+ * @param limit A pointer to store the limit in, 1/16 C (Q4).
  * @returns res HAL status code.
  */
-HAL_StatusTypeDef MCP9808_GetTemperatureLimit(MCP9808_Alarm_TypeDef _reg, int16_t *limit) {
-
-	uint8_t reg[1] = {_reg};
-	HAL_StatusTypeDef res = HAL_I2C_Master_Transmit(mcp9808.hi2c, mcp9808.address,
-			reg, sizeof(reg), HAL_MAX_DELAY);
-
-
-	if(res != HAL_OK){
-		return res;
-	}
+HAL_StatusTypeDef MCP9808_GetTemperatureLimit(MCP9808_TypeDef *mcp9808, MCP9808_Alarm_TypeDef _reg, int16_t *limit) {
 
 	uint8_t buf[2];
-	res = HAL_I2C_Master_Receive(mcp9808.hi2c, mcp9808.address, buf, sizeof(buf), HAL_MAX_DELAY);
+	HAL_StatusTypeDef res = MCP9808_Read(mcp9808, _reg, buf, sizeof(buf));
 
 	if(res != HAL_OK) {
 		return res;
 	}
 
-	if(buf[0] > 0x10){
-		// Negative value -> sign bit is 1
-		*limit = -((buf[0] & 0xEF) << 4 | (buf[1] & 0xFF) >> 4);
-	} else {
-		// Positive value
-		// Sign bit = 0
-		*limit = (buf[0] & 0xFF) << 4 | (buf[1] & 0xFF) >> 4;
-	}
+	*limit = MCP9808_SignExtend((buf[0] << 8) | buf[1]);
 
 	return res;
 }
-
-
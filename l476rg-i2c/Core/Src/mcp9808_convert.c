@@ -0,0 +1,77 @@
+/*
+ ******************************************************************************
+ * @file           : mcp9808_convert.c
+ * @brief          : MCP9808 temperature register conversions.
+ * 						Built using a STM32L476RG.
+ ******************************************************************************
+ */
+
+#include "mcp9808_convert.h"
+
+/**
+ * Converts a T_AMBIENT register value to Q4 fixed point, 1/16 C per bit.
+ *
+ * @param raw Register value, as read most significant byte first.
+ * @returns Temperature in 1/16 C.
+ */
+int16_t MCP9808_RawToQ4(uint16_t raw) {
+	return MCP9808_SignExtend(raw);
+}
+
+/**
+ * Converts a Q4 temperature to a T_UPPER, T_LOWER or T_CRIT register
+ * value. The registers hold 0.25 C steps, finer bits are dropped
+ * (rounding down).
+ *
+ * @param q4 Temperature in 1/16 C.
+ * @returns Register value, MCP9808_LIMIT_INVALID outside -256 C to
+ * 255.9375 C, which would wrap around in 13 bits.
+ */
+uint16_t MCP9808_Q4ToLimit(int16_t q4) {
+	if(q4 < MCP9808_LIMIT_MIN_Q4 || q4 > MCP9808_LIMIT_MAX_Q4) {
+		return MCP9808_LIMIT_INVALID;
+	}
+	return (uint16_t) q4 & MCP9808_LIMIT_MASK;
+}
+
+/**
+ * Converts T_AMBIENT register values to Q4 fixed point, 1/16 C per bit.
+ *
+ * @param raw Register values.
+ * @param q4 Array to store count temperatures in.
+ * @param count Number of values.
+ */
+void MCP9808_RawToQ4Batch(const uint16_t *raw, int16_t *q4, uint16_t count) {
+	for(uint16_t i = 0; i < count; i++) {
+		q4[i] = MCP9808_SignExtend(raw[i]);
+	}
+}
+
+/**
+ * Converts T_AMBIENT register values to hundredths of a degree,
+ * rounded half up (e.g. 25.0625 C is 2506).
+ *
+ * @param raw Register values.
+ * @param centi Array to store count temperatures in.
+ * @param count Number of values.
+ */
+void MCP9808_RawToCentiBatch(const uint16_t *raw, int16_t *centi, uint16_t count) {
+	for(uint16_t i = 0; i < count; i++) {
+		// x 100 / 16 = x 25 / 4, fits an int16_t for the whole range
+		centi[i] = (int16_t) ((MCP9808_SignExtend(raw[i]) * 25 + 2) >> 2);
+	}
+}
+
+/**
+ * Converts T_AMBIENT register values to degrees Celsius in single
+ * precision, which the FPU handles in hardware.
+ *
+ * @param raw Register values.
+ * @param celsius Array to store count temperatures in.
+ * @param count Number of values.
+ */
+void MCP9808_RawToFloatBatch(const uint16_t *raw, float *celsius, uint16_t count) {
+	for(uint16_t i = 0; i < count; i++) {
+		celsius[i] = MCP9808_SignExtend(raw[i]) * 0.0625f;
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ ******************************************************************************
+ * @file           : bench_mcp9808_convert.c
+ * @brief          : Host benchmark of the MCP9808 temperature conversions
+ * 						against the original double precision one.
+ ******************************************************************************
+ * 	Relative numbers only, the Cortex-M4F has no double precision FPU so
+ * 	the gap is far larger on the target.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "mcp9808_convert.h"
+
+#define NUM_VALUES 4096
+#define ROUNDS 2000
+
+static uint16_t raw[NUM_VALUES];
+static float celsius[NUM_VALUES];
+static int16_t fixed[NUM_VALUES];
+
+/**
+ * The conversion MCP9808_MeasureTemperature() started with, byte by byte
+ * in double precision. Its negative branch is also wrong (256 - x instead
+ * of x - 256), only its cost matters here.
+ *
+ * @param raw Register value.
+ * @returns Temperature in degrees Celsius.
+ */
+static float Original_Convert(uint16_t raw) {
+	uint8_t upper = (raw >> 8) & 0x1F;
+	uint8_t lower = raw & 0xFF;
+
+	if((upper & 0x10) == 0x10) {
+		upper &= 0x0F;
+		return 256 - (upper * 16.0) + (lower / 16.0);
+	}
+	return (upper * 16.0) + (lower / 16.0);
+}
+
+static void Original_Batch(void) {
+	for(uint16_t i = 0; i < NUM_VALUES; i++) {
+		celsius[i] = Original_Convert(raw[i]);
+	}
+}
+
+static void Float_Batch(void) {
+	MCP9808_RawToFloatBatch(raw, celsius, NUM_VALUES);
+}
+
+static void Q4_Batch(void) {
+	MCP9808_RawToQ4Batch(raw, fixed, NUM_VALUES);
+}
+
+static void Centi_Batch(void) {
+	MCP9808_RawToCentiBatch(raw, fixed, NUM_VALUES);
+}
+
+static double Now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Time ROUNDS passes of a batch over NUM_VALUES register values.
+ *
+ * @returns ns per value.
+ */
+static double Bench(void (*batch)(void)) {
+	batch();
+	double start = Now();
+	for(uint16_t round = 0; round < ROUNDS; round++) {
+		batch();
+		// Keep the compiler from merging the rounds
+		__asm__ volatile("" : : "r"(celsius), "r"(fixed) : "memory");
+	}
+	return (Now() - start) * 1e9 / ((double) ROUNDS * NUM_VALUES);
+}
+
+int main(void) {
+	// The whole 13-bit range, every other one with limit flags set
+	for(uint16_t i = 0; i < NUM_VALUES; i++) {
+		raw[i] = (uint16_t) ((i * 2 + 1) & 0x1FFF) | ((i & 1) ? 0xE000 : 0);
+	}
+
+	double original = Bench(Original_Batch);
+	double single = Bench(Float_Batch);
+	double q4 = Bench(Q4_Batch);
+	double centi = Bench(Centi_Batch);
+
+	printf("conversion            ns/value  speedup\n");
+	printf("original (double)     %8.3f  %7.2f\n", original, 1.0);
+	printf("RawToFloatBatch       %8.3f  %7.2f\n", single, original / single);
+	printf("RawToQ4Batch          %8.3f  %7.2f\n", q4, original / q4);
+	printf("RawToCentiBatch       %8.3f  %7.2f\n", centi, original / centi);
+	return 0;
+}
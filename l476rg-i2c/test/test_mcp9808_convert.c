@@ -0,0 +1,131 @@
+/*
+ ******************************************************************************
+ * @file           : test_mcp9808_convert.c
+ * @brief          : Host tests of the MCP9808 temperature conversions.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+
+#include "mcp9808_convert.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+	long a_ = (long) (actual), e_ = (long) (expected); \
+	if(a_ != e_) { \
+		printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+		failures++; \
+	} \
+} while(0)
+
+/**
+ * Register value, Q4, hundredths and degrees of each test temperature.
+ */
+typedef struct {
+	uint16_t raw;
+	int16_t q4;
+	int16_t centi;
+	float celsius;
+} Sample_TypeDef;
+
+static const Sample_TypeDef samples[] = {
+	{0x0190, 400, 2500, 25.0f},
+	{0x0191, 401, 2506, 25.0625f}, // 2506.25 rounds down
+	{0x0000, 0, 0, 0.0f},
+	{0x1FFF, -1, -6, -0.0625f}, // -6.25 rounds up
+	{0x1FF8, -8, -50, -0.5f},
+	{0x1000, -4096, -25600, -256.0f},
+	{0x0FFF, 4095, 25594, 255.9375f}, // 25593.75 rounds up
+	{0x0003, 3, 19, 0.1875f}, // 18.75 rounds up
+	{0x1FFD, -3, -19, -0.1875f}, // -18.75 rounds down
+	{0x0002, 2, 13, 0.125f}, // 12.5 rounds half up
+	{0x1FFE, -2, -12, -0.125f}, // -12.5 rounds half up
+};
+
+#define NUM_SAMPLES (sizeof(samples) / sizeof(samples[0]))
+
+/**
+ * Every conversion of every sample, with the limit flags (bits 15-13)
+ * clear and with each combination of them set.
+ */
+static void test_samples(void) {
+	for(uint16_t flags = 0; flags < 8; flags++) {
+		uint16_t raw[NUM_SAMPLES];
+		for(uint16_t i = 0; i < NUM_SAMPLES; i++) {
+			raw[i] = samples[i].raw | (flags << 13);
+		}
+
+		int16_t q4[NUM_SAMPLES];
+		int16_t centi[NUM_SAMPLES];
+		float celsius[NUM_SAMPLES];
+		MCP9808_RawToQ4Batch(raw, q4, NUM_SAMPLES);
+		MCP9808_RawToCentiBatch(raw, centi, NUM_SAMPLES);
+		MCP9808_RawToFloatBatch(raw, celsius, NUM_SAMPLES);
+
+		for(uint16_t i = 0; i < NUM_SAMPLES; i++) {
+			CHECK_EQ(MCP9808_RawToQ4(raw[i]), samples[i].q4);
+			CHECK_EQ(q4[i], samples[i].q4);
+			CHECK_EQ(centi[i], samples[i].centi);
+			// Multiples of 1/16 are exact in a float
+			if(celsius[i] != samples[i].celsius) {
+				printf("%s:%d: 0x%04x is %f C, expected %f C\n", __FILE__, __LINE__,
+						raw[i], (double) celsius[i], (double) samples[i].celsius);
+				failures++;
+			}
+		}
+	}
+}
+
+/**
+ * The whole 13-bit range against the arithmetic it replaces.
+ */
+static void test_range(void) {
+	for(uint16_t raw = 0; raw < 0x2000; raw++) {
+		int32_t expected = (raw & 0x1000) ? (int32_t) raw - 0x2000 : raw;
+		CHECK_EQ(MCP9808_RawToQ4(raw), expected);
+
+		int16_t centi;
+		MCP9808_RawToCentiBatch(&raw, &centi, 1);
+		// Half up: floor((x * 100 + 8) / 16), C division truncates instead
+		int32_t n = expected * 100 + 8;
+		int32_t rounded = (n >= 0) ? n / 16 : -((15 - n) / 16);
+		CHECK_EQ(centi, rounded);
+	}
+}
+
+/**
+ * Limits round down to 0.25 C, the ones that don't fit in 13 bits are
+ * refused instead of wrapping around.
+ */
+static void test_limits(void) {
+	CHECK_EQ(MCP9808_Q4ToLimit(35 * 16), 0x0230);
+	CHECK_EQ(MCP9808_Q4ToLimit(35 * 16 + 3), 0x0230);
+	CHECK_EQ(MCP9808_Q4ToLimit(-8), 0x1FF8);
+	CHECK_EQ(MCP9808_Q4ToLimit(-1), 0x1FFC); // -0.0625 rounds down to -0.25
+	CHECK_EQ(MCP9808_Q4ToLimit(-256 * 16), 0x1000);
+	CHECK_EQ(MCP9808_Q4ToLimit(256 * 16 - 1), 0x0FFC);
+	CHECK_EQ(MCP9808_Q4ToLimit(256 * 16), MCP9808_LIMIT_INVALID);
+	CHECK_EQ(MCP9808_Q4ToLimit(-256 * 16 - 1), MCP9808_LIMIT_INVALID);
+	CHECK_EQ(MCP9808_Q4ToLimit(INT16_MAX), MCP9808_LIMIT_INVALID);
+	CHECK_EQ(MCP9808_Q4ToLimit(INT16_MIN), MCP9808_LIMIT_INVALID);
+
+	// Every limit in range reads back as itself rounded down
+	for(int32_t q4 = MCP9808_LIMIT_MIN_Q4; q4 <= MCP9808_LIMIT_MAX_Q4; q4++) {
+		CHECK_EQ(MCP9808_RawToQ4(MCP9808_Q4ToLimit((int16_t) q4)), q4 & ~3);
+	}
+}
+
+int main(void) {
+	test_samples();
+	test_range();
+	test_limits();
+
+	if(failures > 0) {
+		printf("%d failures\n", failures);
+		return 1;
+	}
+
+	printf("OK\n");
+	return 0;
+}
@@ -12,11 +12,23 @@
  ******************************************************************************
  * @currently_supports
  *  - Acknowledge active (a!)
+ *  - Bus discovery of all 62 addresses
  *  - Send idenfification (aI!)
+ *  - Identify measurement (aIM!)
  *  - Change address (aAb!)
  *  - Start measurement (aM!)
+ *  - Service requests (a<CR><LF>)
+ *  - Start concurrent measurement (aC!, aCC!)
  *  - Send data (aD0!)
  *  - Start verification (aV!)
+ *  - CRC checked data (aMC!, aCC!, aRCn!)
+ *  - High volume ASCII and binary data (aHA!, aHB!, aDBn!)
+ *  - Continuous measurements (aRn!, aRCn!), streamed (sdi12_stream.h)
+ *  - Non-blocking transactions (SDI12_Submit)
+ *  - Commands chained without a break inside the wake window
+ *  - Retries of unanswered commands with per address statistics
+ *  - Several buses at once, TX/RX swap or half-duplex transport
+ *  - Sensor mode, answering a data recorder (sdi12_sensor.h)
  ******************************************************************************
  */
 
@@ -28,16 +40,193 @@
 #include <stdlib.h>
 
 #include "main.h"
+#include "sdi12_crc.h"
+#include "sdi12_parser.h"
+#include "sdi12_binary.h"
+#include "sdi12_trace.h"
 
 #define MAX_RESPONSE_SIZE 75
 
 /*
- * GPIO Pin, Port and UART for SDI12 functions.
+ * Longest data line (aDn!, aRn!, aRCn!): the address, up to 75 characters
+ * of values, the CRC and CR/LF.
+ */
+#define SDI12_DATA_LINE_SIZE (1 + MAX_RESPONSE_SIZE + SDI12_CRC_SIZE + 2)
+
+/*
+ * Most data commands after a high volume measurement, aD0!...aD999!.
+ */
+#define SDI12_MAX_HV_COMMANDS 1000
+
+/*
+ * Most buses (UARTs) that can be driven at the same time.
+ */
+#define SDI12_MAX_INSTANCES 6
+
+/*
+ * Bus timing in microseconds (1 us timer ticks, 16-bit so max 65535 us).
+ * One character at 1200 baud (7E1) is 8.33 ms, sensors must start
+ * replying within 15 ms of the command and may leave up to 1.66 ms
+ * between characters. Without a start bit 16.67 ms after the command
+ * the recorder may retry.
+ */
+#define SDI12_BREAK_US 12000
+#define SDI12_MARKING_US 9000
+#define SDI12_RETRY_WAIT_US 16700
+#define SDI12_BYTE_TIMEOUT_US 12000
+
+/*
+ * Retries of a command without a response. SDI12_RETRIES retries follow
+ * the command with only a marking (the sensor is still within its wake
+ * window), then the sequence starts over with a new break, up to
+ * SDI12_RETRY_BREAKS times. Addresses that missed SDI12_ABSENT_AFTER
+ * commands in a row are treated as absent and get a single attempt until
+ * they answer again.
+ */
+#define SDI12_RETRIES 3
+#define SDI12_RETRY_BREAKS 1
+#define SDI12_MAX_ATTEMPTS ((SDI12_RETRIES + 1) * (SDI12_RETRY_BREAKS + 1))
+#define SDI12_ABSENT_AFTER 2
+
+/*
+ * The marking after a break is the idle frame the UART sends when its
+ * transmitter is enabled (10 bits, 8.33 ms at 1200 baud) and the command
+ * follows it without any interrupt in between. Define SDI12_TIMER_MARKING
+ * to time the marking with the timer (SDI12_MARKING_US) instead, for
+ * sensors that need more than the minimum.
+ */
+/* #define SDI12_TIMER_MARKING */
+
+/*
+ * Sensors keep listening for a command without a new break for 87 ms
+ * after the last activity on the bus (1 ms tick, so stay a tick short).
+ */
+#define SDI12_WAKE_WINDOW_MS 86
+
+/*
+ * Valid addresses are '0'-'9', 'a'-'z' and 'A'-'Z'.
+ */
+#define SDI12_NUM_ADDRESSES 62
+
+/*
+ * One bit per address, see SDI12_AddressIndex(...).
+ */
+typedef uint64_t SDI12_AddressMap_TypeDef;
+
+/*
+ * Where the transaction engine is up to on the bus.
+ */
+typedef enum {
+    SDI12_STATE_IDLE = 0,
+    SDI12_STATE_BREAK,
+    SDI12_STATE_MARKING,
+    SDI12_STATE_TRANSMIT,
+    SDI12_STATE_RECEIVE
+} SDI12_State_TypeDef;
+
+/*
+ * How the single SDI-12 wire is shared between sending and receiving.
+ * SWAP        -> TX/RX pins swapped on every turnaround (UART disabled
+ *                and re-enabled), no direction pin needed
+ * HALF_DUPLEX -> USART single-wire mode (HDSEL), only the transmitter
+ *                or receiver is enabled and the OE pin sets the direction
+ *                of the line driver. The UART keeps running throughout.
+ */
+typedef enum {
+    SDI12_TRANSPORT_SWAP = 0,
+    SDI12_TRANSPORT_HALF_DUPLEX
+} SDI12_Transport_TypeDef;
+
+typedef struct SDI12_Transaction SDI12_Transaction_TypeDef;
+
+/*
+ * Called from interrupt context once a transaction has finished,
+ * check transaction->Status for the result.
+ */
+typedef void (*SDI12_Callback_TypeDef)(SDI12_Transaction_TypeDef *transaction);
+
+/*
+ * Optional, called from interrupt context with every received character
+ * (including the CR) once the line is in, before the transaction callback.
+ */
+typedef void (*SDI12_ByteCallback_TypeDef)(SDI12_Transaction_TypeDef *transaction, const char c);
+
+/*
+ * A single command/response exchange on the bus.
+ * Cmd and Response must stay valid until the callback has run.
+ * Response is null terminated with the CR/LF removed when it fits.
+ * A line that fills Response before its LF completes with HAL_ERROR,
+ * the rest of it is left on the bus.
+ *
+ * ASCII responses are received as the first character by interrupt, then
+ * the rest of the line in one block ended by the UART character match
+ * (LF) interrupt. FirstByteTick and Latency time the first character.
+ *
+ * Binary responses have no CR/LF, the packet header gives their length.
+ * They are received as two blocks (header, then payload and CRC) by DMA
+ * if the UART has a RX DMA channel linked, by interrupt otherwise.
+ * The UART runs as 8N1 while they arrive, 7E1 would take the MSB of every
+ * byte as the parity bit. ByteCallback is not called for them.
+ */
+struct SDI12_Transaction {
+    const char *Cmd;
+    uint8_t CmdLen;
+    char *Response;
+    uint16_t ResponseLen; // Size of the response buffer
+    volatile uint16_t Count; // Characters received (excluding CR/LF)
+    volatile HAL_StatusTypeDef Status;
+    SDI12_Callback_TypeDef Callback; // May be NULL
+    SDI12_ByteCallback_TypeDef ByteCallback; // May be NULL
+    void *Context; // Passed through untouched for the caller
+    uint8_t SkipBreak; // Send without a break if the sensors are still awake
+    uint8_t Binary; // Response is a binary packet (aDBn!), see below
+    volatile uint32_t FirstByteTick; // HAL_GetTick() at the first character
+    volatile uint16_t Latency; // us from end of command to end of first character, 0 for SDI12_Listen
+    volatile uint8_t Attempts; // Times the command was sent, including retries
+    uint8_t NoRetry; // Give up after the first attempt (bus scans)
+};
+
+/*
+ * What the bus has seen of one address, see SDI12_GetAddressStats(...).
+ */
+typedef struct {
+    uint32_t Transactions;
+    uint32_t Retries; // Commands sent again without a response
+    uint32_t Failures; // Transactions without a complete response
+    uint8_t Missed; // Failures in a row, reset by a response
+    uint16_t Latency; // Of the last response (us)
+    uint16_t MaxLatency;
+} SDI12_AddressStats_TypeDef;
+
+/*
+ * A SDI-12 bus. GPIO Pin, Port, UART and timer for SDI12 functions.
+ * Every function takes the bus to talk on, several buses can have
+ * transactions in progress at once.
  */
 typedef struct {
     UART_HandleTypeDef *Huart;
+    TIM_HandleTypeDef *Htim; // Free running at 1 MHz, used one-shot
     uint32_t Pin;
     GPIO_TypeDef *Port;
+    uint32_t Alternate; // GPIO alternate function of the UART TX pin
+    uint32_t ModeShift; // Position of the pin's bits in the GPIO MODER
+    uint8_t Number; // Order the bus was initialised in, identifies it in traces
+    SDI12_Transport_TypeDef Transport;
+    GPIO_TypeDef *OEPort; // Line driver direction, HALF_DUPLEX only
+    uint32_t OEPin;
+    uint8_t BreakSent; // Last transaction started with a break
+    uint32_t Turnaround; // CPU cycles from end of command to receiver armed (last)
+    uint32_t MaxTurnaround;
+    uint16_t Latency; // Of the last response (us), see SDI12_Transaction_TypeDef
+    volatile SDI12_State_TypeDef State;
+    SDI12_Transaction_TypeDef *Active;
+    volatile uint32_t LastActivityTick; // HAL_GetTick() when the bus was last used
+    uint8_t RxByte;
+    uint16_t RxBlock; // Length of the block being received, 0 for the first character
+    uint16_t RxPending; // Bytes of it outstanding at the last timer check
+    uint8_t Awaiting; // No character of the response seen yet
+    uint16_t Waited; // us waited for the response before the timer was re-armed
+    SDI12_AddressStats_TypeDef Stats[SDI12_NUM_ADDRESSES];
 } SDI12_TypeDef;
 
 /*
@@ -45,23 +234,70 @@ typedef struct {
  * Query = aM!
  * Response = atttn where a = address, t = three numbers indication response
  * time (ttt) and the expected number of values (n)
+ * Also used for concurrent measurements (aC!) which respond with atttnn.
  * Also used for verification response after an aV! command.
  */
 typedef struct {
     char Address;
     uint16_t Time;
-    uint8_t NumValues;
+    uint16_t NumValues;
+    uint8_t UseCRC; // Data responses carry a CRC (aMC!, aCC!, aHA!)
+    uint8_t HighVolume; // aHA!/aHB!, data commands run up to aD999!
 } SDI12_Measure_TypeDef;
 
-void SDI12_Init(UART_HandleTypeDef *huart);
-HAL_StatusTypeDef SDI12_AckActive(const char addr);
-void SDI12_DevicesOnBus(char *const devices);
-HAL_StatusTypeDef SDI12_GetId(const char addr, char response[], uint8_t response_len);
-HAL_StatusTypeDef SDI12_ChangeAddr(char *from_addr, char *to_addr);
-HAL_StatusTypeDef SDI12_StartMeasurement(const char addr, SDI12_Measure_TypeDef *measure_info);
-HAL_StatusTypeDef SDI12_SendData(const char addr, const SDI12_Measure_TypeDef *measurement_info, char *data);
-HAL_StatusTypeDef SDI12_StartVerification(const char addr, SDI12_Measure_TypeDef *verification_info);
-uint16_t SDI12_CheckCRC(char *response);
-HAL_StatusTypeDef SDI12_StartMeasurementCRC(const char addr, SDI12_Measure_TypeDef *measurement_info);
+/*
+ * A run of commands to one sensor. While each command follows the last
+ * response within SDI12_WAKE_WINDOW_MS the sensor is still listening and
+ * the break is skipped, only the marking is sent. Anything else (a long
+ * gap, a failed command, another address) falls back to a break.
+ */
+typedef struct {
+    SDI12_TypeDef *Bus;
+    char Address;
+    uint8_t Awake; // Last command was answered
+    uint16_t Chained; // Commands sent without a break
+    uint16_t Breaks; // Commands that needed a break
+} SDI12_Session_TypeDef;
+
+HAL_StatusTypeDef SDI12_Init(SDI12_TypeDef *sdi12, UART_HandleTypeDef *huart, TIM_HandleTypeDef *htim, GPIO_TypeDef *port, const uint32_t pin);
+HAL_StatusTypeDef SDI12_SetTransport(SDI12_TypeDef *sdi12, const SDI12_Transport_TypeDef transport, GPIO_TypeDef *oe_port, const uint32_t oe_pin);
+HAL_StatusTypeDef SDI12_Submit(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction);
+HAL_StatusTypeDef SDI12_Transfer(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction);
+HAL_StatusTypeDef SDI12_Listen(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction);
+void SDI12_Abort(SDI12_TypeDef *sdi12);
+void SDI12_Session_Begin(SDI12_Session_TypeDef *session, SDI12_TypeDef *sdi12, const char addr);
+HAL_StatusTypeDef SDI12_Session_Transfer(SDI12_Session_TypeDef *session, SDI12_Transaction_TypeDef *transaction);
+void SDI12_Session_End(SDI12_Session_TypeDef *session);
+uint8_t SDI12_IsBusy(SDI12_TypeDef *sdi12);
+const SDI12_AddressStats_TypeDef* SDI12_GetAddressStats(const SDI12_TypeDef *sdi12, const char addr);
+void SDI12_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+void SDI12_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void SDI12_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void SDI12_UART_ErrorCallback(UART_HandleTypeDef *huart);
+void SDI12_UART_IRQHandler(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef SDI12_AckActive(SDI12_TypeDef *sdi12, const char addr);
+HAL_StatusTypeDef SDI12_DiscoverDevices(SDI12_TypeDef *sdi12, SDI12_AddressMap_TypeDef *map, uint32_t *scan_time);
+uint8_t SDI12_DevicesOnBus(SDI12_TypeDef *sdi12, char *const devices, const uint8_t max);
+int8_t SDI12_AddressIndex(const char addr);
+char SDI12_AddressFromIndex(const uint8_t index);
+void SDI12_AddressMap_Set(SDI12_AddressMap_TypeDef *map, const char addr);
+void SDI12_AddressMap_Clear(SDI12_AddressMap_TypeDef *map, const char addr);
+uint8_t SDI12_AddressMap_Test(const SDI12_AddressMap_TypeDef *map, const char addr);
+HAL_StatusTypeDef SDI12_GetId(SDI12_TypeDef *sdi12, const char addr, char response[], uint8_t response_len);
+HAL_StatusTypeDef SDI12_IdentifyMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_ChangeAddr(SDI12_TypeDef *sdi12, char *from_addr, char *to_addr);
+HAL_StatusTypeDef SDI12_StartMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measure_info);
+HAL_StatusTypeDef SDI12_WaitForServiceRequest(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_StartConcurrentMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_StartConcurrentMeasurementCRC(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_SendData(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, char *data);
+HAL_StatusTypeDef SDI12_ReadValues(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, SDI12_Parser_TypeDef *parser);
+HAL_StatusTypeDef SDI12_ReadContinuous(SDI12_TypeDef *sdi12, const char addr, const uint8_t index, const uint8_t use_crc, SDI12_Parser_TypeDef *parser);
+HAL_StatusTypeDef SDI12_StartVerification(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *verification_info);
+HAL_StatusTypeDef SDI12_StartMeasurementCRC(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_StartHighVolumeASCII(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_StartHighVolumeBinary(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info);
+HAL_StatusTypeDef SDI12_ReadBinaryPacket(SDI12_TypeDef *sdi12, const char addr, const uint16_t index, SDI12_BinaryPacket_TypeDef *packet);
+HAL_StatusTypeDef SDI12_ReadBinaryValues(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, SDI12_BinaryPacket_TypeDef *packet, float values[], const uint16_t capacity, uint16_t *count);
 
 #endif // SDI12_
@@ -0,0 +1,66 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_binary.h
+ * @brief          : SDI-12 v1.4 high volume binary (aDBn!) packet decoding.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Packet layout, multi-byte fields little endian:
+ *
+ *   a | size (2) | type (1) | payload (size bytes) | CRC-16 (2)
+ *
+ * The payload is an array of values of a single type. The CRC covers
+ * everything before it and is sent as two binary bytes, not as ASCII.
+ * An empty payload means the sensor has no more data.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_BINARY_
+#define SDI12_BINARY_
+
+#include <string.h>
+#include "main.h"
+#include "sdi12_crc.h"
+
+#define SDI12_BINARY_HEADER_SIZE 4
+#define SDI12_BINARY_CRC_SIZE 2
+#define SDI12_BINARY_MAX_PAYLOAD 1000
+#define SDI12_BINARY_MAX_PACKET (SDI12_BINARY_HEADER_SIZE + SDI12_BINARY_MAX_PAYLOAD + SDI12_BINARY_CRC_SIZE)
+
+/*
+ * Type of the values in the payload.
+ */
+typedef enum {
+    SDI12_BINARY_INVALID = 0, // Invalid request or no data
+    SDI12_BINARY_INT8,
+    SDI12_BINARY_UINT8,
+    SDI12_BINARY_INT16,
+    SDI12_BINARY_UINT16,
+    SDI12_BINARY_INT32,
+    SDI12_BINARY_UINT32,
+    SDI12_BINARY_INT64,
+    SDI12_BINARY_UINT64,
+    SDI12_BINARY_FLOAT32, // IEEE 754
+    SDI12_BINARY_FLOAT64 // IEEE 754
+} SDI12_BinaryType_TypeDef;
+
+/*
+ * A received packet. Data is the buffer the UART receives into, the same
+ * packet can be reused for every aDBn! command.
+ */
+typedef struct {
+    uint8_t Data[SDI12_BINARY_MAX_PACKET];
+    uint16_t Length; // Bytes received
+    // Filled in by SDI12_Binary_Decode(...)
+    char Address;
+    SDI12_BinaryType_TypeDef Type;
+    uint16_t PayloadSize;
+    uint16_t NumValues;
+} SDI12_BinaryPacket_TypeDef;
+
+HAL_StatusTypeDef SDI12_Binary_Decode(SDI12_BinaryPacket_TypeDef *packet);
+uint8_t SDI12_Binary_TypeSize(const SDI12_BinaryType_TypeDef type);
+int64_t SDI12_Binary_GetInt(const SDI12_BinaryPacket_TypeDef *packet, const uint16_t index);
+double SDI12_Binary_GetDouble(const SDI12_BinaryPacket_TypeDef *packet, const uint16_t index);
+uint16_t SDI12_Binary_ToFloat(const SDI12_BinaryPacket_TypeDef *packet, float values[], const uint16_t capacity);
+
+#endif // SDI12_BINARY_
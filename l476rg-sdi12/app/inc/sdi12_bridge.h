@@ -0,0 +1,60 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_bridge.h
+ * @brief          : Raw SDI-12 commands from a host UART onto a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Turns the board into a USB to SDI-12 adapter for commissioning: type
+ * a command such as "0M!" and Enter in a terminal on the ST-LINK virtual
+ * COM port (USART2, 115200 8N1) and the response comes back as a line.
+ * The SDI-12 engine does the break, marking, retries and turnaround, a
+ * command within the wake window of the previous one skips the break.
+ * An empty line comes back when the sensor did not respond, BUSY when
+ * the line was typed before the previous command finished.
+ *
+ * The host UART receives into a circular DMA buffer and is read on the
+ * idle line, half and full events, so no character is lost at 115200.
+ * Responses are sent by DMA. One reply can wait for the previous one to
+ * finish (e.g. BUSY while a response goes out), any beyond that is
+ * counted in RepliesDropped.
+ *
+ * The bridge owns the bus while it runs, don't use the scheduler or
+ * debug_output() alongside it.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_BRIDGE_
+#define SDI12_BRIDGE_
+
+#include "sdi12.h"
+
+#define SDI12_BRIDGE_RX_SIZE 128 // Host receive DMA buffer
+#define SDI12_BRIDGE_MAX_CMD 16
+#define SDI12_BRIDGE_BUSY "BUSY" // Reply to a line the bus could not take
+
+typedef struct {
+    UART_HandleTypeDef *Huart; // Host side, RX and TX DMA channels linked
+    SDI12_TypeDef *Bus;
+    uint8_t Rx[SDI12_BRIDGE_RX_SIZE];
+    uint16_t RxTail; // Next byte of Rx to look at
+    char Line[SDI12_BRIDGE_MAX_CMD]; // Command being typed
+    uint8_t LineLen;
+    char Cmd[SDI12_BRIDGE_MAX_CMD]; // Command on the bus
+    char Response[SDI12_DATA_LINE_SIZE]; // Longest line, aRCn! with CRC and CR/LF
+    uint8_t Tx[SDI12_DATA_LINE_SIZE]; // Reply being sent, CR/LF replaced by ours
+    uint8_t Queued[SDI12_DATA_LINE_SIZE]; // Next reply, sent when Tx is done
+    uint16_t QueuedLen; // 0 when none
+    SDI12_Transaction_TypeDef Transaction;
+    // Statistics
+    uint32_t Commands;
+    uint32_t Timeouts; // Commands without a response
+    uint32_t Dropped; // Lines received while the bus was busy
+    uint32_t RepliesDropped; // Replies lost, the host UART was busy with one queued
+} SDI12_Bridge_TypeDef;
+
+HAL_StatusTypeDef SDI12_Bridge_Init(SDI12_Bridge_TypeDef *bridge, UART_HandleTypeDef *huart, SDI12_TypeDef *bus);
+void SDI12_Bridge_RxEventCallback(UART_HandleTypeDef *huart, const uint16_t size);
+void SDI12_Bridge_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void SDI12_Bridge_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif // SDI12_BRIDGE_
@@ -0,0 +1,58 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_cache.h
+ * @brief          : Per-address cache of SDI-12 sensor metadata.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * A sensor's identification (aI!) and concurrent measurement timing and
+ * value count (aC!) do not change while it stays on the bus, so aI! is
+ * only requested once per boot and the scheduler orders its starts and
+ * sizes its value buffers from the last aC! response.
+ * An entry is dropped when its address stops acknowledging.
+ * Each bus keeps its own cache, addresses are only unique per bus.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_CACHE_
+#define SDI12_CACHE_
+
+#include "sdi12.h"
+
+/*
+ * Which parts of an entry hold data.
+ */
+#define SDI12_CACHE_ID          0x01 // aI!
+#define SDI12_CACHE_CONCURRENT  0x02 // aC!
+
+/*
+ * Identification response, allccccccccmmmmmmvvvxxx...xx
+ * Fields are null terminated with any space padding left in place.
+ */
+typedef struct {
+    char Version[3]; // ll, SDI-12 version ("14" = v1.4)
+    char Vendor[9]; // cccccccc
+    char Model[7]; // mmmmmm
+    char ModelVersion[4]; // vvv
+    char Serial[14]; // xxx...xx, optional
+} SDI12_Ident_TypeDef;
+
+typedef struct {
+    uint8_t Valid; // SDI12_CACHE_ flags
+    SDI12_Ident_TypeDef Ident;
+    SDI12_Measure_TypeDef Concurrent; // Last aC! response
+} SDI12_CacheEntry_TypeDef;
+
+typedef struct {
+    SDI12_TypeDef *Bus;
+    SDI12_CacheEntry_TypeDef Entries[SDI12_NUM_ADDRESSES];
+} SDI12_Cache_TypeDef;
+
+void SDI12_Cache_Init(SDI12_Cache_TypeDef *cache, SDI12_TypeDef *bus);
+SDI12_CacheEntry_TypeDef* SDI12_Cache_Get(SDI12_Cache_TypeDef *cache, const char addr);
+HAL_StatusTypeDef SDI12_Cache_Identify(SDI12_Cache_TypeDef *cache, const char addr, const SDI12_Ident_TypeDef **ident);
+void SDI12_Cache_StoreConcurrent(SDI12_Cache_TypeDef *cache, const char addr, const SDI12_Measure_TypeDef *measure_info);
+uint16_t SDI12_Cache_ExpectedValues(SDI12_Cache_TypeDef *cache, const char addr);
+void SDI12_Cache_Invalidate(SDI12_Cache_TypeDef *cache, const char addr);
+void SDI12_Cache_Sync(SDI12_Cache_TypeDef *cache, const SDI12_AddressMap_TypeDef *present);
+
+#endif // SDI12_CACHE_
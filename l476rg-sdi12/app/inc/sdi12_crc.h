@@ -0,0 +1,39 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_crc.h
+ * @brief          : SDI-12 CRC-16 (v1.3 and above).
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * CRC-16/ARC, polynomial 0xA001 (reflected 0x8005), initial value 0.
+ * Calculated over the whole response from the address up to (not including)
+ * the CRC itself, which is sent as three ASCII characters before the CR/LF.
+ *
+ * Pick the kernel at compile time (default nibble table):
+ *  - SDI12_CRC_BITWISE      no table, 8 shifts per character
+ *  - SDI12_CRC_NIBBLE_TABLE 32 byte table, 2 lookups per character
+ *  - SDI12_CRC_BYTE_TABLE   512 byte table, 1 lookup per character
+ ******************************************************************************
+ */
+
+#ifndef SDI12_CRC_
+#define SDI12_CRC_
+
+#include "main.h"
+
+#if !defined(SDI12_CRC_BITWISE) && !defined(SDI12_CRC_BYTE_TABLE)
+#define SDI12_CRC_NIBBLE_TABLE
+#endif
+
+#define SDI12_CRC_SIZE 3
+
+/*
+ * Number of times a data command is re-sent when its CRC does not match.
+ */
+#define SDI12_CRC_RETRIES 3
+
+uint16_t SDI12_CRC16(const char *data, const uint16_t len);
+void SDI12_CRC_Encode(const uint16_t crc, char ascii[SDI12_CRC_SIZE]);
+uint16_t SDI12_CRC_Decode(const char ascii[SDI12_CRC_SIZE]);
+HAL_StatusTypeDef SDI12_CheckCRC(const char *response, const uint16_t len);
+
+#endif // SDI12_CRC_
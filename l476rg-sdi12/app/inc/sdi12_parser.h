@@ -0,0 +1,56 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_parser.h
+ * @brief          : Streaming parser for SDI-12 data values.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Turns the sign delimited values of aDn!/aRn! responses, e.g.
+ * "0+3.14-12+0.005<CR><LF>", into numbers one character at a time as they
+ * come off the UART. No string buffer, sscanf or strtod required.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_PARSER_
+#define SDI12_PARSER_
+
+#include <stdint.h>
+
+/*
+ * Most values a concurrent measurement (aC!, aCC!) can return, aM! gives
+ * at most 9. High volume measurements (aHA!) can return up to 999, size
+ * their buffers from the count the sensor announces.
+ */
+#define SDI12_MAX_VALUES 99
+
+/*
+ * SDI-12 value as scaled fixed-point, value = Mantissa / 10^Decimals.
+ * The spec allows at most 7 digits so the mantissa always fits.
+ */
+typedef struct {
+    int32_t Mantissa;
+    uint8_t Decimals;
+} SDI12_Value_TypeDef;
+
+/*
+ * Parser state. Values and Capacity are supplied by the caller.
+ */
+typedef struct {
+    SDI12_Value_TypeDef *Values;
+    uint16_t Capacity;
+    uint16_t Count; // Values completed so far
+    uint8_t Overflow; // Set if more than Capacity values were seen
+    // Value currently being parsed
+    uint8_t InValue;
+    uint8_t SeenPoint;
+    uint8_t Digits;
+    int8_t Sign;
+    int32_t Mantissa;
+    uint8_t Decimals;
+} SDI12_Parser_TypeDef;
+
+void SDI12_Parser_Init(SDI12_Parser_TypeDef *parser, SDI12_Value_TypeDef *values, const uint16_t capacity);
+void SDI12_Parser_Feed(SDI12_Parser_TypeDef *parser, const char c);
+void SDI12_Parser_Finish(SDI12_Parser_TypeDef *parser);
+float SDI12_ValueToFloat(const SDI12_Value_TypeDef *value);
+
+#endif // SDI12_PARSER_
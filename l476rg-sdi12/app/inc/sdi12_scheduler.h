@@ -0,0 +1,89 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_scheduler.h
+ * @brief          : Concurrent measurement scheduler for a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Starts a concurrent measurement (aC!) on every sensor of the bus, then
+ * collects the data (aD0!...) from each one as soon as its ttt has
+ * elapsed. A bus cycle takes roughly the longest ttt instead of the sum
+ * of all of them.
+ *
+ * Values are kept in a pool supplied to SDI12_Scheduler_Init(...). Each
+ * sensor gets as many of them as the cache remembers from an earlier
+ * aC!, or as its first aC! response announces. A sensor that later
+ * announces more gets a new, larger share.
+ *
+ * Sensors can instead be measured at their own interval (10 s, 1 min,
+ * 15 min... on the same bus) with SDI12_Scheduler_SetInterval(...) and
+ * SDI12_Scheduler_Run(...). Use either the cycle functions or Run, not
+ * both on the same scheduler.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_SCHEDULER_
+#define SDI12_SCHEDULER_
+
+#include "sdi12.h"
+#include "sdi12_cache.h"
+
+#define SDI12_SCHEDULER_MAX_SENSORS 10
+#define SDI12_SCHEDULER_COLLECT_SLACK_MS 1000 // Collection this late past ttt misses its deadline, a few aDn! of other sensors
+
+/*
+ * Where each sensor is up to in the current cycle.
+ */
+typedef enum {
+    SDI12_SLOT_IDLE = 0,
+    SDI12_SLOT_MEASURING, // aC! accepted, waiting for ttt to elapse
+    SDI12_SLOT_DONE, // Data collected
+    SDI12_SLOT_ERROR // aC! or aDn! failed, see Status
+} SDI12_SlotState_TypeDef;
+
+/*
+ * A sensor on the bus.
+ * Values end up in the sensor's share of the pool (Parser.Values,
+ * Parser.Capacity), Parser.Count holds how many were received this cycle.
+ */
+typedef struct {
+    char Address;
+    SDI12_Parser_TypeDef Parser;
+    SDI12_Measure_TypeDef Info;
+    uint32_t ReadyTick; // HAL_GetTick() value the data will be ready at
+    uint16_t Latency; // us from the end of aC! to its first response character
+    SDI12_SlotState_TypeDef State;
+    HAL_StatusTypeDef Status;
+    // Periodic measurements, see SDI12_Scheduler_SetInterval(...)
+    uint32_t Interval; // ms between aC! commands, 0 when only run in cycles
+    uint32_t DueTick; // HAL_GetTick() value the next aC! is due at
+    uint32_t Samples; // Measurements collected
+    uint32_t Missed; // Deadlines missed: intervals skipped and late collections
+    uint32_t MaxLateness; // Longest delay of an aC! past its DueTick (ms)
+    uint32_t MaxCollectLateness; // Longest delay of a collection past its ReadyTick (ms)
+} SDI12_Slot_TypeDef;
+
+typedef struct {
+    SDI12_TypeDef *Bus;
+    SDI12_Cache_TypeDef *Cache; // Optional, NULL to run without one
+    SDI12_Slot_TypeDef Slots[SDI12_SCHEDULER_MAX_SENSORS];
+    uint8_t NumSlots;
+    SDI12_Value_TypeDef *Pool; // Values shared out between the sensors
+    uint16_t PoolSize;
+    uint16_t PoolUsed;
+    uint8_t Pending; // Slots still measuring in this cycle
+    uint32_t StartTick;
+    uint32_t CycleTime; // Duration of the last completed cycle (ms)
+    uint32_t Missed; // Deadlines missed over all sensors
+} SDI12_Scheduler_TypeDef;
+
+void SDI12_Scheduler_Init(SDI12_Scheduler_TypeDef *scheduler, SDI12_TypeDef *bus, SDI12_Cache_TypeDef *cache, SDI12_Value_TypeDef *pool, const uint16_t pool_size);
+HAL_StatusTypeDef SDI12_Scheduler_Add(SDI12_Scheduler_TypeDef *scheduler, const char addr);
+HAL_StatusTypeDef SDI12_Scheduler_Discover(SDI12_Scheduler_TypeDef *scheduler);
+HAL_StatusTypeDef SDI12_Scheduler_StartCycle(SDI12_Scheduler_TypeDef *scheduler);
+uint8_t SDI12_Scheduler_Poll(SDI12_Scheduler_TypeDef *scheduler);
+HAL_StatusTypeDef SDI12_Scheduler_RunCycle(SDI12_Scheduler_TypeDef *scheduler);
+HAL_StatusTypeDef SDI12_Scheduler_SetInterval(SDI12_Scheduler_TypeDef *scheduler, const char addr, const uint32_t interval);
+SDI12_Slot_TypeDef* SDI12_Scheduler_Run(SDI12_Scheduler_TypeDef *scheduler);
+uint32_t SDI12_Scheduler_NextEvent(const SDI12_Scheduler_TypeDef *scheduler);
+
+#endif // SDI12_SCHEDULER_
@@ -0,0 +1,98 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_sensor.h
+ * @brief          : SDI-12 sensor side, answers commands from a data recorder.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * The board shows up on the bus as a sensor at Address. Everything runs
+ * from the UART interrupts and nothing blocks. The application formats the
+ * responses ahead of time (SDI12_Sensor_SetData(...) etc.), so answering a
+ * command is copying a buffer into the UART.
+ *
+ *   break | aD0! | marking (8.33 ms) | a+21.50<CR><LF>
+ *
+ * The marking is the idle frame the UART sends when its transmitter is
+ * enabled, so the response starts ~8.5 ms after the '!' of the command,
+ * inside the 15 ms the spec allows.
+ *
+ * A break reaches the UART as a 0x00 character with a framing error
+ * (>= 8.33 ms of spacing). Spacing of 12 ms is always seen as a break and
+ * less than 6.5 ms never is, as the spec asks of a sensor.
+ *
+ * Supports a!, ?!, aI!, aM!, aC!, aD0! and aR0!, other commands are not
+ * answered. The line is turned around by swapping TX/RX like
+ * SDI12_TRANSPORT_SWAP.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_SENSOR_
+#define SDI12_SENSOR_
+
+#include "sdi12.h"
+
+/*
+ * Most UARTs that can act as a sensor at the same time.
+ */
+#define SDI12_SENSOR_MAX_INSTANCES 2
+
+/*
+ * Sensors go back to sleep (ignore commands until the next break) after
+ * 100 ms without activity on the bus.
+ */
+#define SDI12_SENSOR_WAKE_MS 100
+
+#define SDI12_SENSOR_MAX_CMD 8
+#define SDI12_SENSOR_MAX_IDENT 34 // 2 + 8 + 6 + 3 + 13 characters
+#define SDI12_SENSOR_MAX_DATA (MAX_RESPONSE_SIZE + 1) // Values of a data line and the terminator
+
+typedef enum {
+    SDI12_SENSOR_SLEEP = 0, // Waiting for a break
+    SDI12_SENSOR_LISTEN, // Awake, collecting a command
+    SDI12_SENSOR_RESPOND // Sending a response
+} SDI12_SensorState_TypeDef;
+
+typedef struct SDI12_Sensor SDI12_Sensor_TypeDef;
+
+/*
+ * Called from interrupt context when the recorder starts a measurement,
+ * type is 'M' or 'C'. Return straight away and hand the values over with
+ * SDI12_Sensor_SetData(...) when they are ready.
+ */
+typedef void (*SDI12_SensorCallback_TypeDef)(SDI12_Sensor_TypeDef *sensor, const char type);
+
+/*
+ * Responses are stored without the address and CR/LF, null terminated.
+ * Change them with the SDI12_Sensor_Set...(...) functions, which keep
+ * them consistent with the interrupts.
+ */
+struct SDI12_Sensor {
+    UART_HandleTypeDef *Huart;
+    char Address;
+    char Identification[SDI12_SENSOR_MAX_IDENT]; // aI!
+    char Measurement[5]; // aM!, tttn
+    char Concurrent[6]; // aC!, tttnn
+    char Data[SDI12_SENSOR_MAX_DATA]; // aD0! and aR0!, e.g. "+21.50"
+    SDI12_SensorCallback_TypeDef MeasureCallback; // May be NULL
+    void *Context; // Passed through untouched for the caller
+    volatile SDI12_SensorState_TypeDef State;
+    volatile uint32_t LastActivityTick;
+    uint8_t ServiceRequest; // aM! with ttt > 0 is waiting for its data
+    uint8_t RxByte;
+    char Cmd[SDI12_SENSOR_MAX_CMD];
+    uint8_t CmdLen;
+    char Tx[SDI12_DATA_LINE_SIZE];
+    // Statistics
+    uint32_t Breaks;
+    uint32_t Commands; // Answered
+    uint32_t Ignored; // For other addresses or not supported
+};
+
+HAL_StatusTypeDef SDI12_Sensor_Init(SDI12_Sensor_TypeDef *sensor, UART_HandleTypeDef *huart, const char addr);
+void SDI12_Sensor_SetIdentification(SDI12_Sensor_TypeDef *sensor, const char *ident);
+void SDI12_Sensor_SetMeasurement(SDI12_Sensor_TypeDef *sensor, const uint16_t time, const uint8_t num_values);
+void SDI12_Sensor_SetData(SDI12_Sensor_TypeDef *sensor, const char *data);
+void SDI12_Sensor_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void SDI12_Sensor_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void SDI12_Sensor_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+#endif // SDI12_SENSOR_
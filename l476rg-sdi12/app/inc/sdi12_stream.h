@@ -0,0 +1,85 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_stream.h
+ * @brief          : Continuous measurement (aRn!) streaming for a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Sensors that support continuous measurements answer aRn! (or aRCn!) with
+ * their latest values straight away. Polling them at a fixed period gives
+ * many more samples per second than a M/D sequence, which waits for ttt and
+ * needs a second command for the data.
+ *
+ * Each round reads every channel once, the parsed values are queued in a
+ * ring buffer for the application to drain with SDI12_Stream_Read(...).
+ ******************************************************************************
+ */
+
+#ifndef SDI12_STREAM_
+#define SDI12_STREAM_
+
+#include "sdi12.h"
+
+#define SDI12_STREAM_MAX_CHANNELS 8
+#define SDI12_STREAM_BUFFER_SIZE 16 // Samples, power of 2
+#define SDI12_STREAM_MAX_VALUES (MAX_RESPONSE_SIZE / 2) // Per aRn! response, a full line of 2 character values ("+1")
+
+/*
+ * A sensor and which of its continuous measurements (aR0!...aR9!) to read.
+ */
+typedef struct {
+    char Address;
+    uint8_t Index; // n of aRn!
+    uint8_t UseCRC; // Send aRCn! instead
+} SDI12_Channel_TypeDef;
+
+/*
+ * Values of one channel from one round.
+ */
+typedef struct {
+    uint32_t Tick; // HAL_GetTick() value the response was read at
+    char Address;
+    uint8_t Index;
+    uint8_t Count;
+    SDI12_Value_TypeDef Values[SDI12_STREAM_MAX_VALUES];
+} SDI12_Sample_TypeDef;
+
+/*
+ * Achieved sampling, from SDI12_Stream_GetStats(...).
+ */
+typedef struct {
+    uint32_t Rounds;
+    uint32_t Samples; // Successful reads, queued or not
+    uint32_t Errors; // Reads with no or a bad response
+    uint32_t Overruns; // Samples dropped because the buffer was full
+    uint32_t Missed; // Rounds skipped because the bus fell behind
+    float Rate; // Samples per second since SDI12_Stream_Start(...)
+    uint32_t MinInterval; // Shortest time between round starts (ms)
+    uint32_t MaxInterval; // Longest time between round starts (ms)
+    uint32_t Jitter; // MaxInterval - MinInterval (ms)
+} SDI12_StreamStats_TypeDef;
+
+typedef struct {
+    SDI12_TypeDef *Bus;
+    SDI12_Channel_TypeDef Channels[SDI12_STREAM_MAX_CHANNELS];
+    uint8_t NumChannels;
+    uint32_t Period; // ms between round starts, 0 for back to back
+    uint32_t NextTick;
+    // Ring buffer, written by SDI12_Stream_Poll(...) only
+    SDI12_Sample_TypeDef Buffer[SDI12_STREAM_BUFFER_SIZE];
+    volatile uint16_t Head;
+    volatile uint16_t Tail;
+    // Statistics
+    uint32_t StartTick;
+    uint32_t LastRoundTick;
+    SDI12_StreamStats_TypeDef Stats;
+} SDI12_Stream_TypeDef;
+
+void SDI12_Stream_Init(SDI12_Stream_TypeDef *stream, SDI12_TypeDef *bus, const uint32_t period);
+HAL_StatusTypeDef SDI12_Stream_AddChannel(SDI12_Stream_TypeDef *stream, const char addr, const uint8_t index, const uint8_t use_crc);
+void SDI12_Stream_Start(SDI12_Stream_TypeDef *stream);
+uint8_t SDI12_Stream_Poll(SDI12_Stream_TypeDef *stream);
+uint8_t SDI12_Stream_Read(SDI12_Stream_TypeDef *stream, SDI12_Sample_TypeDef *sample);
+uint16_t SDI12_Stream_Available(const SDI12_Stream_TypeDef *stream);
+void SDI12_Stream_GetStats(const SDI12_Stream_TypeDef *stream, SDI12_StreamStats_TypeDef *stats);
+
+#endif // SDI12_STREAM_
@@ -0,0 +1,68 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_trace.h
+ * @brief          : Timestamped trace of SDI-12 transaction phases.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Opt-in, define SDI12_TRACE to build it in. Without it the trace points
+ * in the driver compile to nothing.
+ *
+ * Every phase of a transaction is recorded with the DWT cycle counter in
+ * a RAM ring, the newest SDI12_TRACE_SIZE records are kept:
+ *
+ *   BREAK  MARKING  TX_DONE  FIRST_BYTE  COMPLETE
+ *     |-------|--------|----------|----------|
+ *      break   marking   sensor     rest of
+ *              + command latency    the line
+ *
+ * RETRY records sit between TX_DONE and the next MARKING/BREAK when a
+ * command went unanswered.
+ *
+ * SDI12_Trace_Dump() sends the ring over the USART2 debug link, little
+ * endian:
+ *
+ *   "SDT1" | count (2) | SystemCoreClock (4) | count x record (8)
+ *   record = cycles (4) | event (1) | bus (1) | address (1) | detail (1)
+ *
+ * detail is the attempt number for RETRY and the HAL status for COMPLETE.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_TRACE_
+#define SDI12_TRACE_
+
+#include <string.h>
+#include "main.h"
+
+/* #define SDI12_TRACE */
+
+#define SDI12_TRACE_SIZE 256 // Records, power of 2
+
+typedef enum {
+    SDI12_TRACE_BREAK = 1,
+    SDI12_TRACE_MARKING,
+    SDI12_TRACE_TX_DONE,
+    SDI12_TRACE_FIRST_BYTE,
+    SDI12_TRACE_RETRY,
+    SDI12_TRACE_COMPLETE
+} SDI12_TraceEvent_TypeDef;
+
+typedef struct {
+    uint32_t Cycles; // DWT->CYCCNT
+    uint8_t Event;
+    uint8_t Bus; // Order the bus was initialised in
+    char Address;
+    uint8_t Detail;
+} SDI12_TraceRecord_TypeDef;
+
+#if defined(SDI12_TRACE)
+#define SDI12_TRACE_EVENT(bus, event, addr, detail) SDI12_Trace_Record(bus, event, addr, detail)
+#else
+#define SDI12_TRACE_EVENT(bus, event, addr, detail)
+#endif
+
+void SDI12_Trace_Record(const uint8_t bus, const SDI12_TraceEvent_TypeDef event, const char addr, const uint8_t detail);
+uint16_t SDI12_Trace_Available(void);
+void SDI12_Trace_Dump(void);
+
+#endif // SDI12_TRACE_
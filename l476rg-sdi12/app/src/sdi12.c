@@ -14,182 +14,1074 @@
  ******************************************************************************
  * @currently_supports
  *  - Acknowledge active (a!)
+ *  - Bus discovery of all 62 addresses
  *  - Send idenfification (aI!)
+ *  - Identify measurement (aIM!)
  *  - Change address (aAb!)
  *  - Start measurement (aM!)
- *  - Send data (aD0!)
+ *  - Service requests (a<CR><LF>)
+ *  - Start concurrent measurement (aC!, aCC!)
+ *  - Send data (aD0!...aD9!), parsed as it arrives
  *  - Start verification (aV!)
+ *  - CRC checked data (aMC!, aCC!, aRCn!)
+ *  - High volume ASCII and binary data (aHA!, aHB!, aDBn!)
+ *  - Continuous measurements (aRn!, aRCn!), streamed (sdi12_stream.h)
+ *  - Non-blocking transactions (SDI12_Submit), driven by interrupts
+ *  - Commands chained without a break inside the wake window
+ *  - Retries of unanswered commands with per address statistics
+ *  - Several buses at once, TX/RX swap or half-duplex transport
  ******************************************************************************
  */
 
 #include "sdi12.h"
 
-SDI12_TypeDef sdi12;
+/*
+ * Every initialised bus, so the shared HAL callbacks can find theirs.
+ */
+static SDI12_TypeDef *instances[SDI12_MAX_INSTANCES];
+static uint8_t num_instances = 0;
+
+/*
+ * Trace point for the active transaction, see sdi12_trace.h.
+ */
+#define SDI12_TRACE_ACTIVE(sdi12, event, detail) \
+    SDI12_TRACE_EVENT((sdi12)->Number, event, ((sdi12)->Active->Cmd != NULL) ? (sdi12)->Active->Cmd[0] : 0, detail)
+
+/* Private member functions */
+static HAL_StatusTypeDef SDI12_QueryDevice(SDI12_TypeDef *sdi12, const char cmd[], const uint8_t cmd_len, char *response, const uint8_t response_len);
+static void SDI12_StartTimer(SDI12_TypeDef *sdi12, const uint32_t us);
+static void SDI12_StopTimer(SDI12_TypeDef *sdi12);
+static void SDI12_SetPinMode(SDI12_TypeDef *sdi12, const uint32_t mode);
+static void SDI12_SetSwap(SDI12_TypeDef *sdi12, const uint32_t swap);
+static void SDI12_SetDirection(SDI12_TypeDef *sdi12, const uint8_t transmit);
+static void SDI12_SetBinaryFrame(SDI12_TypeDef *sdi12, const uint8_t binary);
+static void SDI12_StartBreak(SDI12_TypeDef *sdi12);
+static void SDI12_StartMarking(SDI12_TypeDef *sdi12);
+static uint8_t SDI12_Retry(SDI12_TypeDef *sdi12);
+static void SDI12_UpdateStats(SDI12_TypeDef *sdi12, const SDI12_Transaction_TypeDef *transaction, const HAL_StatusTypeDef status);
+static void SDI12_StartTransmit(SDI12_TypeDef *sdi12);
+static void SDI12_Complete(SDI12_TypeDef *sdi12, const HAL_StatusTypeDef status);
+static void SDI12_ParseMeasurement(const char response[], SDI12_Measure_TypeDef *measure_info);
+static void SDI12_FeedParser(SDI12_Transaction_TypeDef *transaction, const char c);
+static HAL_StatusTypeDef SDI12_QueryData(SDI12_Session_TypeDef *session, SDI12_Transaction_TypeDef *transaction, const uint8_t use_crc);
+static uint32_t SDI12_Alternate(const USART_TypeDef *instance);
+static SDI12_TypeDef* SDI12_FindUart(const UART_HandleTypeDef *huart);
+static HAL_StatusTypeDef SDI12_ReceiveBlock(SDI12_TypeDef *sdi12, const uint16_t len);
+static uint16_t SDI12_RxOutstanding(SDI12_TypeDef *sdi12);
+static void SDI12_EndLine(SDI12_TypeDef *sdi12, const uint16_t received);
+static HAL_StatusTypeDef SDI12_ReadBinary(SDI12_Session_TypeDef *session, const uint16_t index, SDI12_BinaryPacket_TypeDef *packet);
+static uint8_t SDI12_DataCommand(char cmd[], const char addr, const char *type, const uint16_t index);
+
+/*
+ * Initialise a bus with its UART, timer, TX Pin and TX Pin GPIO Port.
+ * Each bus needs its own UART and timer, the buses then run independently
+ * of each other (USART1/2/3, UART4/5 and LPUART1).
+ *
+ * The timer must tick at 1 MHz (TIM6 with a prescaler of 9 from the
+ * 10 MHz APB1 timer clock). It is switched to one-pulse mode here so every
+ * state of a transaction can arm it for a single timeout.
+ *
+ * Returns HAL_ERROR if SDI12_MAX_INSTANCES buses are already in use or
+ * the UART has no known alternate function.
+ */
+HAL_StatusTypeDef SDI12_Init(SDI12_TypeDef *sdi12, UART_HandleTypeDef *huart, TIM_HandleTypeDef *htim, GPIO_TypeDef *port, const uint32_t pin) {
+    uint32_t alternate = SDI12_Alternate(huart->Instance);
+    if (alternate == 0xFF) {
+        return HAL_ERROR;
+    }
+
+    // Re-initialising a bus keeps its slot
+    uint8_t i = 0;
+    while (i < num_instances && instances[i] != sdi12) {
+        i++;
+    }
+    if (i == num_instances) {
+        if (num_instances >= SDI12_MAX_INSTANCES) {
+            return HAL_ERROR;
+        }
+        instances[num_instances++] = sdi12;
+    }
+
+    sdi12->Number = i;
+    sdi12->Huart = huart;
+    sdi12->Htim = htim;
+    sdi12->Pin = pin;
+    sdi12->Port = port;
+    sdi12->Alternate = alternate;
+    sdi12->ModeShift = POSITION_VAL(pin) * 2;
+    sdi12->Transport = SDI12_TRANSPORT_SWAP;
+    sdi12->OEPort = NULL;
+    sdi12->Turnaround = 0;
+    sdi12->MaxTurnaround = 0;
+    sdi12->Latency = 0;
+    sdi12->State = SDI12_STATE_IDLE;
+    sdi12->Active = NULL;
+    sdi12->LastActivityTick = HAL_GetTick() - SDI12_WAKE_WINDOW_MS;
+    sdi12->RxBlock = 0;
+    sdi12->Awaiting = 0;
+    memset(sdi12->Stats, 0, sizeof(sdi12->Stats));
+
+    SET_BIT(htim->Instance->CR1, TIM_CR1_OPM);
+
+    // Character match on the LF ending every ASCII line. LF has even
+    // parity 0, so it matches with or without the parity bit (7E1).
+    // ADD can only be written while the UART is disabled.
+    __HAL_UART_DISABLE(huart);
+    MODIFY_REG(huart->Instance->CR2, USART_CR2_ADD, (uint32_t) 0x0a << USART_CR2_ADD_Pos);
+    __HAL_UART_ENABLE(huart);
+
+    // Configure the pin once, after this only its mode is switched
+    GPIO_InitTypeDef GPIO_InitStruct = { 0 };
+    GPIO_InitStruct.Pin = pin;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = alternate;
+    HAL_GPIO_Init(port, &GPIO_InitStruct);
+
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    // Cycle counter for the turnaround measurement
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    return HAL_OK;
+}
+
+/*
+ * Pick how the bus turns the line around, see SDI12_Transport_TypeDef.
+ * oe_port/oe_pin drive the line driver direction (high = transmit) and
+ * are required for SDI12_TRANSPORT_HALF_DUPLEX, ignored otherwise.
+ * Re-initialises the UART with its existing settings.
+ */
+HAL_StatusTypeDef SDI12_SetTransport(SDI12_TypeDef *sdi12, const SDI12_Transport_TypeDef transport, GPIO_TypeDef *oe_port, const uint32_t oe_pin) {
+    if (sdi12->State != SDI12_STATE_IDLE) {
+        return HAL_BUSY;
+    }
+    if (transport == SDI12_TRANSPORT_HALF_DUPLEX && oe_port == NULL) {
+        return HAL_ERROR;
+    }
+
+    // Both transports transmit on the TX pin
+    UART_HandleTypeDef *huart = sdi12->Huart;
+    huart->AdvancedInit.AdvFeatureInit |= UART_ADVFEATURE_SWAP_INIT;
+    huart->AdvancedInit.Swap = UART_ADVFEATURE_SWAP_DISABLE;
+
+    HAL_StatusTypeDef res;
+    if (transport == SDI12_TRANSPORT_HALF_DUPLEX) {
+        res = HAL_HalfDuplex_Init(huart);
+    } else {
+        res = HAL_UART_Init(huart); // Clears HDSEL
+    }
+    if (res != HAL_OK) {
+        return res;
+    }
+
+    sdi12->Transport = transport;
+    sdi12->OEPort = oe_port;
+    sdi12->OEPin = oe_pin;
+    sdi12->MaxTurnaround = 0;
+    SDI12_SetDirection(sdi12, 0);
+
+    return HAL_OK;
+}
+
+/*
+ * Start a transaction on the bus and return straight away.
+ * Each command goes through the following states, all of them
+ * driven from the timer and UART interrupts.
+ *
+ * Break (12 ms)
+      │                          380 - 810 ms
+      ▼      Command              Response
+    ┌───┐  ┌─┐ ┌─┐ ┌─┐           ┌─┐ ┌─┐ ┌─┐
+    │   │  │ │ │ │ │ │           │ │ │ │ │ │
+────┘   └──┘ └─┘ └─┘ └───────────┘ └─┘ └─┘ └─
+          ▲               Max
+          │          ◄───15 ms───►
+      Marking (8.3 ms)
+ *
+ * BREAK    -> pin driven as GPIO, timer armed for SDI12_BREAK_US
+ * MARKING  -> pin handed back to the UART, which sends an idle frame as
+ *             the marking and then the command by itself
+ *             (transactions with SkipBreak start here while the sensors
+ *             are still awake, see SDI12_WAKE_WINDOW_MS)
+ * TRANSMIT -> command sent with HAL_UART_Transmit_IT
+ *             (and again from MARKING or BREAK when there is no response,
+ *             see SDI12_RETRIES)
+ * RECEIVE  -> first character with HAL_UART_Receive_IT (timed for the
+ *             latency), the rest of the line as one block by DMA until
+ *             the character match interrupt sees the LF. The timer
+ *             guards the first character and the progress of the block.
+ *
+ * Uses a single UART pin (TX) and cycles between TX and RX to
+ * send and receive commands (respectively).
+ *
+ * CPU work per command before the response, the rest is hardware:
+ *  - Submit: 2 register writes (BSRR, MODER), timer armed
+ *  - Break timer interrupt: MODER write, TX/RX swap, TE toggle, first
+ *    character written
+ *  - One TXE interrupt per command character, then TC
+ *  - Two interrupts per response line (first character, LF)
+ * The break could not move into the UART: a break character is only
+ * 10 bits (8.33 ms at 1200 baud) and the SDI-12 break is >= 12 ms.
+ * On the wire that is 12 ms break and 8.33 ms marking ahead of the
+ * command, 9 ms less than the HAL_Delay marking (test/bench_sdi12).
+ *
+ * Returns HAL_BUSY if a transaction is already on the bus.
+ */
+HAL_StatusTypeDef SDI12_Submit(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction) {
+    if (transaction == NULL || transaction->Cmd == NULL || transaction->CmdLen == 0
+            || transaction->Response == NULL || transaction->ResponseLen == 0) {
+        return HAL_ERROR;
+    }
+
+    if (sdi12->State != SDI12_STATE_IDLE) {
+        return HAL_BUSY;
+    }
+
+    transaction->Count = 0;
+    transaction->Attempts = 0;
+    transaction->Status = HAL_BUSY;
+    sdi12->Active = transaction;
+    sdi12->Awaiting = 1;
+
+    if (transaction->SkipBreak && (HAL_GetTick() - sdi12->LastActivityTick) < SDI12_WAKE_WINDOW_MS) {
+        sdi12->BreakSent = 0;
+        SDI12_StartMarking(sdi12);
+        return HAL_OK;
+    }
+
+    SDI12_StartBreak(sdi12);
+
+    return HAL_OK;
+}
+
+/*
+ * Receive a line without sending a command first (no break, marking or
+ * command). Used to catch unsolicited lines such as service requests.
+ * There is no timeout on the first character, the caller ends the wait
+ * with SDI12_Abort() when it no longer cares. Characters after the first
+ * are guarded by SDI12_BYTE_TIMEOUT_US as usual.
+ */
+HAL_StatusTypeDef SDI12_Listen(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction) {
+    if (transaction == NULL || transaction->Response == NULL || transaction->ResponseLen == 0) {
+        return HAL_ERROR;
+    }
+
+    if (sdi12->State != SDI12_STATE_IDLE) {
+        return HAL_BUSY;
+    }
+
+    transaction->Count = 0;
+    transaction->Attempts = 0;
+    transaction->Status = HAL_BUSY;
+    sdi12->Active = transaction;
+    sdi12->Awaiting = 1;
+
+    SDI12_SetDirection(sdi12, 0);
+    sdi12->State = SDI12_STATE_RECEIVE;
+    if (HAL_UART_Receive_IT(sdi12->Huart, &sdi12->RxByte, 1) != HAL_OK) {
+        SDI12_Complete(sdi12, HAL_ERROR);
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Cancel the active transaction (if any). It completes with HAL_TIMEOUT
+ * and its callback runs from the caller's context.
+ */
+void SDI12_Abort(SDI12_TypeDef *sdi12) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (sdi12->State == SDI12_STATE_BREAK || sdi12->State == SDI12_STATE_MARKING) {
+        // Release the line and give the pin back to the UART
+        HAL_GPIO_WritePin(sdi12->Port, (uint16_t) sdi12->Pin, GPIO_PIN_RESET);
+        SDI12_SetPinMode(sdi12, GPIO_MODE_AF_PP);
+    }
+
+    if (sdi12->State != SDI12_STATE_IDLE) {
+        HAL_UART_Abort(sdi12->Huart);
+        SDI12_Complete(sdi12, HAL_TIMEOUT);
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Statistics of addr on this bus, NULL if it is not a valid address.
+ */
+const SDI12_AddressStats_TypeDef* SDI12_GetAddressStats(const SDI12_TypeDef *sdi12, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index < 0) {
+        return NULL;
+    }
+    return &sdi12->Stats[index];
+}
+
+/*
+ * Returns 1 while a transaction is on the bus.
+ */
+uint8_t SDI12_IsBusy(SDI12_TypeDef *sdi12) {
+    return sdi12->State != SDI12_STATE_IDLE;
+}
+
+/*
+ * Blocking version of SDI12_Submit. Sleeps between interrupts until the
+ * transaction has finished and returns its status.
+ */
+HAL_StatusTypeDef SDI12_Transfer(SDI12_TypeDef *sdi12, SDI12_Transaction_TypeDef *transaction) {
+    HAL_StatusTypeDef res = SDI12_Submit(sdi12, transaction);
+    if (res != HAL_OK) {
+        return res;
+    }
+
+    while (transaction->Status == HAL_BUSY) {
+        __WFI();
+    }
+
+    return transaction->Status;
+}
+
+/*
+ * Start a session of chained commands to addr.
+ */
+void SDI12_Session_Begin(SDI12_Session_TypeDef *session, SDI12_TypeDef *sdi12, const char addr) {
+    session->Bus = sdi12;
+    session->Address = addr;
+    session->Awake = 0;
+    session->Chained = 0;
+    session->Breaks = 0;
+}
+
+/*
+ * Blocking transfer within a session. Skips the break if the sensor
+ * answered the previous command of the session and is still awake.
+ *
+ *   aD0! (break 12 ms + marking 8.3 ms) a+1.2 | aD1! (marking 8.3 ms) ...
+ */
+HAL_StatusTypeDef SDI12_Session_Transfer(SDI12_Session_TypeDef *session, SDI12_Transaction_TypeDef *transaction) {
+    transaction->SkipBreak = session->Awake && transaction->Cmd[0] == session->Address;
+
+    HAL_StatusTypeDef res = SDI12_Transfer(session->Bus, transaction);
+    if (res == HAL_BUSY) {
+        return res;
+    }
+
+    if (session->Bus->BreakSent) {
+        session->Breaks++;
+    } else {
+        session->Chained++;
+    }
+    // Without a response the sensor may have gone back to sleep
+    session->Awake = (res == HAL_OK && transaction->Count > 0);
+
+    return res;
+}
+
+/*
+ * Close a session, the next command to the sensor gets a break.
+ */
+void SDI12_Session_End(SDI12_Session_TypeDef *session) {
+    session->Awake = 0;
+}
+
+/*
+ * Blocking command/response used by the command functions.
+ */
+static HAL_StatusTypeDef SDI12_QueryDevice(SDI12_TypeDef *sdi12, const char cmd[], const uint8_t cmd_len, char response[], const uint8_t response_len) {
+    SDI12_Transaction_TypeDef transaction = { 0 };
+    transaction.Cmd = cmd;
+    transaction.CmdLen = cmd_len;
+    transaction.Response = response;
+    transaction.ResponseLen = response_len;
+
+    return SDI12_Transfer(sdi12, &transaction);
+}
+
+/*
+ * Timer expired, move on to the next state.
+ * Call from HAL_TIM_PeriodElapsedCallback().
+ */
+void SDI12_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+    SDI12_TypeDef *sdi12 = NULL;
+    for (uint8_t i = 0; i < num_instances; i++) {
+        if (instances[i]->Htim == htim) {
+            sdi12 = instances[i];
+        }
+    }
+    if (sdi12 == NULL) {
+        return;
+    }
+
+    switch (sdi12->State) {
+    case SDI12_STATE_BREAK:
+        HAL_GPIO_WritePin(sdi12->Port, (uint16_t) sdi12->Pin, GPIO_PIN_RESET);
+        SDI12_SetPinMode(sdi12, GPIO_MODE_AF_PP);
+        SDI12_StartMarking(sdi12);
+        break;
+
+    case SDI12_STATE_MARKING:
+        SDI12_StartTransmit(sdi12);
+        break;
+
+    case SDI12_STATE_RECEIVE:
+        // Blocks have no interrupt per character, keep waiting as long
+        // as characters came in since the last check.
+        if (sdi12->RxBlock > 0) {
+            uint16_t outstanding = SDI12_RxOutstanding(sdi12);
+            if (outstanding < sdi12->RxPending) {
+                sdi12->RxPending = outstanding;
+                sdi12->Awaiting = 0;
+                SDI12_StartTimer(sdi12, SDI12_BYTE_TIMEOUT_US);
+                break;
+            }
+        }
+
+        if (sdi12->Awaiting) {
+            // A start bit is all the spec asks for within the retry
+            // wait, give that character time to finish.
+            if (READ_BIT(sdi12->Huart->Instance->ISR, USART_ISR_BUSY)) {
+                sdi12->Awaiting = 0;
+                sdi12->Waited = SDI12_RETRY_WAIT_US;
+                SDI12_StartTimer(sdi12, SDI12_BYTE_TIMEOUT_US);
+                break;
+            }
+
+            HAL_UART_AbortReceive(sdi12->Huart);
+            if (SDI12_Retry(sdi12)) {
+                break;
+            }
+            SDI12_Complete(sdi12, HAL_TIMEOUT);
+            break;
+        }
+
+        // No more characters within the allowed time.
+        HAL_UART_AbortReceive(sdi12->Huart);
+        SDI12_Complete(sdi12, HAL_TIMEOUT);
+        break;
 
-// This value changes depending on the MCU.
+    default:
+        break;
+    }
+}
+
+/*
+ * Command has left the UART, turn the line around and wait for the
+ * first character of the response.
+ * Call from HAL_UART_TxCpltCallback().
+ */
+void SDI12_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_TypeDef *sdi12 = SDI12_FindUart(huart);
+    if (sdi12 == NULL || sdi12->State != SDI12_STATE_TRANSMIT) {
+        return;
+    }
+
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    uint32_t start = DWT->CYCCNT;
+#endif
+
+    SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_TX_DONE, sdi12->Active->Attempts);
+
+    // Put the SDI-12 pin into RX mode so the sensor response can be read.
+    SDI12_SetDirection(sdi12, 0);
+    sdi12->State = SDI12_STATE_RECEIVE;
+    sdi12->Awaiting = 1;
+    sdi12->Waited = 0;
+    SDI12_StartTimer(sdi12, SDI12_RETRY_WAIT_US);
+    HAL_StatusTypeDef res;
+    if (sdi12->Active->Binary) {
+        SDI12_SetBinaryFrame(sdi12, 1);
+        res = SDI12_ReceiveBlock(sdi12, SDI12_BINARY_HEADER_SIZE);
+    } else {
+        res = HAL_UART_Receive_IT(sdi12->Huart, &sdi12->RxByte, 1);
+    }
+
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    sdi12->Turnaround = DWT->CYCCNT - start;
+    if (sdi12->Turnaround > sdi12->MaxTurnaround) {
+        sdi12->MaxTurnaround = sdi12->Turnaround;
+    }
+#endif
+
+    if (res != HAL_OK) {
+        SDI12_Complete(sdi12, HAL_ERROR);
+    }
+}
+
+/*
+ * A character of the response has arrived. Stores it and re-arms the
+ * receiver until a LF is seen or the buffer is full.
+ * For binary responses a whole block has arrived instead, the header is
+ * followed by the payload and CRC it announces.
+ * Call from HAL_UART_RxCpltCallback().
+ */
+void SDI12_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_TypeDef *sdi12 = SDI12_FindUart(huart);
+    if (sdi12 == NULL || sdi12->State != SDI12_STATE_RECEIVE) {
+        return;
+    }
+
+    SDI12_Transaction_TypeDef *transaction = sdi12->Active;
+    // Not Awaiting, the timer clears that as soon as a start bit is seen
+    if (transaction->Count == 0) {
+        SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_FIRST_BYTE, 0);
+    }
+    sdi12->Awaiting = 0;
+    if (transaction->Binary) {
+        transaction->Count += sdi12->RxBlock;
+        if (transaction->Count > SDI12_BINARY_HEADER_SIZE) {
+            SDI12_Complete(sdi12, HAL_OK);
+            return;
+        }
+
+        uint16_t size = (uint8_t) transaction->Response[1] | ((uint8_t) transaction->Response[2] << 8);
+        SDI12_StartTimer(sdi12, SDI12_BYTE_TIMEOUT_US);
+        if (SDI12_ReceiveBlock(sdi12, size + SDI12_BINARY_CRC_SIZE) != HAL_OK) {
+            SDI12_Complete(sdi12, HAL_ERROR);
+        }
+        return;
+    }
+
+    if (sdi12->RxBlock > 0) {
+        // The line filled the buffer before its LF
+        SDI12_EndLine(sdi12, sdi12->RxBlock);
+        return;
+    }
+
+    // First character, the timer has been running since the command
+    // left (not for SDI12_Listen)
+    transaction->FirstByteTick = HAL_GetTick();
+    transaction->Latency = READ_BIT(sdi12->Htim->Instance->CR1, TIM_CR1_CEN) ? (uint16_t) (sdi12->Waited + __HAL_TIM_GET_COUNTER(sdi12->Htim)) : 0;
+    sdi12->Latency = transaction->Latency;
+
+    uint8_t c = sdi12->RxByte;
+    transaction->Response[transaction->Count++] = c;
+    if (transaction->ByteCallback != NULL) {
+        transaction->ByteCallback(transaction, c);
+    }
+
+    if (c == 0x0a || transaction->Count >= transaction->ResponseLen) {
+        SDI12_Complete(sdi12, (c == 0x0a) ? HAL_OK : HAL_ERROR);
+        return;
+    }
+
+    // The rest of the line without an interrupt per character
+    SDI12_StartTimer(sdi12, SDI12_BYTE_TIMEOUT_US);
+    __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_CMF);
+    __HAL_UART_ENABLE_IT(huart, UART_IT_CM);
+    if (SDI12_ReceiveBlock(sdi12, transaction->ResponseLen - transaction->Count) != HAL_OK) {
+        SDI12_Complete(sdi12, HAL_ERROR);
+    }
+}
+
+/*
+ * Framing, parity or overrun error on the SDI-12 UART.
+ * Call from HAL_UART_ErrorCallback().
+ */
+void SDI12_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    SDI12_TypeDef *sdi12 = SDI12_FindUart(huart);
+    if (sdi12 == NULL || sdi12->State == SDI12_STATE_IDLE) {
+        return;
+    }
+
+    HAL_UART_Abort(sdi12->Huart);
+    SDI12_Complete(sdi12, HAL_ERROR);
+}
+
+/*
+ * The LF of a line has arrived (character match), the line is complete.
+ * The HAL leaves the character match flag alone, call from the UART's
+ * IRQ handler after HAL_UART_IRQHandler() so a character received by
+ * interrupt is already stored.
+ */
+void SDI12_UART_IRQHandler(UART_HandleTypeDef *huart) {
+    SDI12_TypeDef *sdi12 = SDI12_FindUart(huart);
+    if (sdi12 == NULL || !__HAL_UART_GET_FLAG(huart, UART_FLAG_CMF)) {
+        return;
+    }
+    __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_CMF);
+
+    // Binary data may contain 0x0a as well
+    if (sdi12->State != SDI12_STATE_RECEIVE || sdi12->RxBlock == 0 || sdi12->Active->Binary) {
+        return;
+    }
+
+    uint16_t received = sdi12->RxBlock - SDI12_RxOutstanding(sdi12);
+    HAL_UART_AbortReceive(huart);
+    SDI12_EndLine(sdi12, received);
+}
+
+/*
+ * Break must be >= 12 ms, the pin is driven high as a GPIO.
+ */
+static void SDI12_StartBreak(SDI12_TypeDef *sdi12) {
+    SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_BREAK, 0);
+    sdi12->BreakSent = 1;
+    sdi12->State = SDI12_STATE_BREAK;
+
+    if (sdi12->Transport == SDI12_TRANSPORT_HALF_DUPLEX) {
+        HAL_GPIO_WritePin(sdi12->OEPort, (uint16_t) sdi12->OEPin, GPIO_PIN_SET);
+    }
+    HAL_GPIO_WritePin(sdi12->Port, (uint16_t) sdi12->Pin, GPIO_PIN_SET);
+    SDI12_SetPinMode(sdi12, GPIO_MODE_OUTPUT_PP);
+    SDI12_StartTimer(sdi12, SDI12_BREAK_US);
+}
+
+/*
+ * Marking must be >= 8.3 ms. Put TX on the SDI-12 data pin so the idle
+ * UART holds the line at marking and the command can follow.
+ */
+static void SDI12_StartMarking(SDI12_TypeDef *sdi12) {
+    SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_MARKING, 0);
+    SDI12_SetDirection(sdi12, 1);
+    sdi12->State = SDI12_STATE_MARKING;
+#if defined(SDI12_TIMER_MARKING)
+    SDI12_StartTimer(sdi12, SDI12_MARKING_US);
+#else
+    // Re-enabling the transmitter queues an idle frame (the marking)
+    // ahead of the first character of the command.
+    CLEAR_BIT(sdi12->Huart->Instance->CR1, USART_CR1_TE);
+    SET_BIT(sdi12->Huart->Instance->CR1, USART_CR1_TE);
+    SDI12_StartTransmit(sdi12);
+#endif
+}
+
+/*
+ * Hand the command to the UART.
+ */
+static void SDI12_StartTransmit(SDI12_TypeDef *sdi12) {
+    sdi12->State = SDI12_STATE_TRANSMIT;
+    sdi12->Active->Attempts++;
+    if (HAL_UART_Transmit_IT(sdi12->Huart, (uint8_t*) sdi12->Active->Cmd, sdi12->Active->CmdLen) != HAL_OK) {
+        SDI12_Complete(sdi12, HAL_ERROR);
+    }
+}
+
+/*
+ * Nothing came back SDI12_RETRY_WAIT_US after the command, send it again
+ * straight away. The retries after a break only need a marking, every
+ * SDI12_RETRIES + 1 attempts a new break wakes the sensors up again.
+ * Returns 0 when the transaction should give up instead.
+ */
+static uint8_t SDI12_Retry(SDI12_TypeDef *sdi12) {
+    SDI12_Transaction_TypeDef *transaction = sdi12->Active;
+    const SDI12_AddressStats_TypeDef *stats = SDI12_GetAddressStats(sdi12, transaction->Cmd[0]);
+
+    if (transaction->NoRetry || transaction->Attempts >= SDI12_MAX_ATTEMPTS
+            || (stats != NULL && stats->Missed >= SDI12_ABSENT_AFTER)) {
+        return 0;
+    }
+
+    SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_RETRY, transaction->Attempts);
+    sdi12->RxBlock = 0;
+    if (transaction->Binary) {
+        SDI12_SetBinaryFrame(sdi12, 0);
+    }
+    if (transaction->Attempts % (SDI12_RETRIES + 1) == 0) {
+        SDI12_StartBreak(sdi12);
+    } else {
+        SDI12_StartMarking(sdi12);
+    }
+
+    return 1;
+}
+
+/*
+ * Count the finished transaction against the address it was sent to.
+ */
+static void SDI12_UpdateStats(SDI12_TypeDef *sdi12, const SDI12_Transaction_TypeDef *transaction, const HAL_StatusTypeDef status) {
+    int8_t index = SDI12_AddressIndex(transaction->Cmd[0]);
+    if (index < 0) {
+        return;
+    }
+
+    SDI12_AddressStats_TypeDef *stats = &sdi12->Stats[index];
+    stats->Transactions++;
+    stats->Retries += transaction->Attempts - 1;
+
+    if (sdi12->Awaiting) {
+        stats->Failures++;
+        if (stats->Missed < UINT8_MAX) {
+            stats->Missed++;
+        }
+        return;
+    }
+
+    // Answered, but the line never completed (timeout or UART error)
+    stats->Missed = 0;
+    if (status != HAL_OK) {
+        stats->Failures++;
+        return;
+    }
+
+    stats->Latency = transaction->Latency;
+    if (stats->Latency > stats->MaxLatency) {
+        stats->MaxLatency = stats->Latency;
+    }
+}
+
+/*
+ * Finish the active transaction. Strips the trailing CR/LF, null terminates
+ * the response if there is room, releases the bus and runs the callback.
+ */
+static void SDI12_Complete(SDI12_TypeDef *sdi12, const HAL_StatusTypeDef status) {
+    SDI12_StopTimer(sdi12);
+    __HAL_UART_DISABLE_IT(sdi12->Huart, UART_IT_CM);
+    sdi12->RxBlock = 0;
+
+    // Never leave the line driver on, e.g. after a failed transmit
+    if (sdi12->Transport == SDI12_TRANSPORT_HALF_DUPLEX) {
+        SDI12_SetDirection(sdi12, 0);
+    }
+
+    SDI12_Transaction_TypeDef *transaction = sdi12->Active;
+    if (transaction->Binary) {
+        SDI12_SetBinaryFrame(sdi12, 0);
+    }
+    SDI12_TRACE_ACTIVE(sdi12, SDI12_TRACE_COMPLETE, status);
+    if (transaction->Attempts > 0) {
+        SDI12_UpdateStats(sdi12, transaction, status);
+    }
+
+    uint16_t i = transaction->Count;
+    while (i > 0 && !transaction->Binary) {
+        char c = transaction->Response[i - 1];
+        if (c == 0x0a || c == 0x0d) {
+            transaction->Response[i - 1] = 0;
+            i--;
+        } else {
+            break;
+        }
+    }
+    if (i < transaction->ResponseLen) {
+        transaction->Response[i] = 0;
+    }
+    transaction->Count = i;
+
+    sdi12->Active = NULL;
+    sdi12->State = SDI12_STATE_IDLE;
+    sdi12->LastActivityTick = HAL_GetTick();
+
+    transaction->Status = status;
+    if (transaction->Callback != NULL) {
+        transaction->Callback(transaction);
+    }
+}
+
+/*
+ * Arm the one-shot timer to fire after us microseconds (max 65535).
+ */
+static void SDI12_StartTimer(SDI12_TypeDef *sdi12, const uint32_t us) {
+    __HAL_TIM_DISABLE(sdi12->Htim);
+    __HAL_TIM_SET_AUTORELOAD(sdi12->Htim, us - 1);
+    __HAL_TIM_SET_COUNTER(sdi12->Htim, 0);
+    __HAL_TIM_CLEAR_FLAG(sdi12->Htim, TIM_FLAG_UPDATE);
+    __HAL_TIM_ENABLE_IT(sdi12->Htim, TIM_IT_UPDATE);
+    __HAL_TIM_ENABLE(sdi12->Htim);
+}
+
+static void SDI12_StopTimer(SDI12_TypeDef *sdi12) {
+    __HAL_TIM_DISABLE_IT(sdi12->Htim, TIM_IT_UPDATE);
+    __HAL_TIM_DISABLE(sdi12->Htim);
+    __HAL_TIM_CLEAR_FLAG(sdi12->Htim, TIM_FLAG_UPDATE);
+}
+
+/*
+ * Switch the SDI-12 pin between GPIO output (for the break) and the
+ * UART alternate function. Only the mode bits change, everything else
+ * was set up by SDI12_Init(...), so this is a single register write
+ * instead of a HAL_GPIO_Init() per switch.
+ */
+static void SDI12_SetPinMode(SDI12_TypeDef *sdi12, const uint32_t mode) {
+    MODIFY_REG(sdi12->Port->MODER, GPIO_MODER_MODE0 << sdi12->ModeShift, (mode & GPIO_MODER_MODE0) << sdi12->ModeShift);
+}
+
+/*
+ * Receive the next len bytes of a response after what has been received
+ * so far. DMA if the UART has a RX channel, interrupts otherwise.
+ */
+static HAL_StatusTypeDef SDI12_ReceiveBlock(SDI12_TypeDef *sdi12, const uint16_t len) {
+    SDI12_Transaction_TypeDef *transaction = sdi12->Active;
+    if (transaction->Count + len > transaction->ResponseLen) {
+        return HAL_ERROR;
+    }
+
+    uint8_t *block = (uint8_t*) &transaction->Response[transaction->Count];
+    sdi12->RxBlock = len;
+    sdi12->RxPending = len;
+    if (sdi12->Huart->hdmarx != NULL) {
+        return HAL_UART_Receive_DMA(sdi12->Huart, block, len);
+    }
+    return HAL_UART_Receive_IT(sdi12->Huart, block, len);
+}
+
+/*
+ * Bytes of the current block not received yet.
+ */
+static uint16_t SDI12_RxOutstanding(SDI12_TypeDef *sdi12) {
+    if (sdi12->Huart->hdmarx != NULL) {
+        return (uint16_t) __HAL_DMA_GET_COUNTER(sdi12->Huart->hdmarx);
+    }
+    return sdi12->Huart->RxXferCount;
+}
+
+/*
+ * Hand the received part of a line to the transaction and complete it.
+ * Without a LF at its end the line did not fit in the buffer.
+ */
+static void SDI12_EndLine(SDI12_TypeDef *sdi12, const uint16_t received) {
+    SDI12_Transaction_TypeDef *transaction = sdi12->Active;
+    uint16_t end = transaction->Count + received;
+    char c = 0;
+
+    for (uint16_t i = transaction->Count; i < end; i++) {
+        // DMA stores the parity bit with the character
+        c = transaction->Response[i] & 0x7f;
+        transaction->Response[i] = c;
+        if (transaction->ByteCallback != NULL) {
+            transaction->ByteCallback(transaction, c);
+        }
+    }
+    transaction->Count = end;
+
+    SDI12_Complete(sdi12, (c == 0x0a) ? HAL_OK : HAL_ERROR);
+}
+
+/*
+ * Bus the UART belongs to, or NULL if it is not a SDI-12 bus.
+ */
+static SDI12_TypeDef* SDI12_FindUart(const UART_HandleTypeDef *huart) {
+    for (uint8_t i = 0; i < num_instances; i++) {
+        if (instances[i]->Huart == huart) {
+            return instances[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * TX pin alternate function of the UART, this value changes depending
+ * on the MCU. Returns 0xFF for an unknown UART.
+ */
+static uint32_t SDI12_Alternate(const USART_TypeDef *instance) {
 #if defined (STM32L083xx) || defined (STM32L073xx)
-// NUCLEO-L073RZ
-#define GPIO_AF_USART1 GPIO_AF4_USART1
+    // NUCLEO-L073RZ
+    if (instance == USART1 || instance == USART2) {
+        return GPIO_AF4_USART1;
+    }
+    if (instance == LPUART1) {
+        return GPIO_AF6_LPUART1;
+    }
 #elif defined(STM32L471xx) || defined(STM32L475xx) || defined(STM32L476xx) || defined(STM32L485xx) || defined(STM32L486xx)
-#define GPIO_AF_USART1 GPIO_AF7_USART1
+    if (instance == USART1 || instance == USART2 || instance == USART3) {
+        return GPIO_AF7_USART1;
+    }
+    if (instance == UART4 || instance == UART5 || instance == LPUART1) {
+        return GPIO_AF8_UART4;
+    }
 #endif
+    return 0xFF;
+}
+
+/*
+ * Point the line towards the sensors (transmit) or back at the UART.
+ * With SDI12_TRANSPORT_HALF_DUPLEX the UART stays enabled, only TE/RE
+ * and the OE pin change. Enabling the transmitter sends an idle frame,
+ * which is the marking before a command.
+ */
+static void SDI12_SetDirection(SDI12_TypeDef *sdi12, const uint8_t transmit) {
+    if (sdi12->Transport != SDI12_TRANSPORT_HALF_DUPLEX) {
+        SDI12_SetSwap(sdi12, transmit ? UART_ADVFEATURE_SWAP_DISABLE : UART_ADVFEATURE_SWAP_ENABLE);
+        return;
+    }
+
+    USART_TypeDef *usart = sdi12->Huart->Instance;
+    if (transmit) {
+        HAL_GPIO_WritePin(sdi12->OEPort, (uint16_t) sdi12->OEPin, GPIO_PIN_SET);
+        MODIFY_REG(usart->CR1, USART_CR1_TE | USART_CR1_RE, USART_CR1_TE);
+    } else {
+        MODIFY_REG(usart->CR1, USART_CR1_TE | USART_CR1_RE, USART_CR1_RE);
+        HAL_GPIO_WritePin(sdi12->OEPort, (uint16_t) sdi12->OEPin, GPIO_PIN_RESET);
+    }
+}
 
-/* Private member functions */
-static HAL_StatusTypeDef SDI12_QueryDevice(const char cmd[], const uint8_t cmd_len, char *response, const uint8_t response_len);
-static HAL_StatusTypeDef SDI12_ReceiveLine(char buffer[], const uint8_t max, uint8_t *const count);
+/*
+ * Binary packets are 8 bit bytes without parity, received as 8N1 instead of
+ * 7E1. Both frames are 10 bits long, only the parity bit turns into the MSB.
+ * Init.Parity is kept in step so the HAL neither masks the MSB nor enables
+ * the parity error interrupt. The UART must be idle, PCE is only writable
+ * while it is disabled.
+ */
+static void SDI12_SetBinaryFrame(SDI12_TypeDef *sdi12, const uint8_t binary) {
+    UART_HandleTypeDef *huart = sdi12->Huart;
+    huart->Init.Parity = binary ? UART_PARITY_NONE : UART_PARITY_EVEN;
+    __HAL_UART_DISABLE(huart);
+    MODIFY_REG(huart->Instance->CR1, USART_CR1_PCE | USART_CR1_PS, huart->Init.Parity);
+    __HAL_UART_ENABLE(huart);
+}
 
 /*
- * Initialise with UART, TX Pin and TX Pin GPIO Port.
+ * Swap the TX/RX pins of the UART. This seems to be the minimum amount
+ * of code required for the swap to happen.
  */
-void SDI12_Init(UART_HandleTypeDef *huart) {
-    sdi12.Huart = huart;
-    sdi12.Pin = SDI12_COM_Pin;
-    sdi12.Port = SDI12_COM_GPIO_Port;
+static void SDI12_SetSwap(SDI12_TypeDef *sdi12, const uint32_t swap) {
+    __HAL_UART_DISABLE(sdi12->Huart);
+    MODIFY_REG(sdi12->Huart->Instance->CR2, USART_CR2_SWAP, swap);
+    __HAL_UART_ENABLE(sdi12->Huart);
 }
 
 /*
- * Main function to deal with SDI12 commands and responses.
- * Struture is as follows.
- *
- * Break (12 ms)
-      │                          380 - 810 ms
-      ▼      Command              Response
-    ┌───┐  ┌─┐ ┌─┐ ┌─┐           ┌─┐ ┌─┐ ┌─┐
-    │   │  │ │ │ │ │ │           │ │ │ │ │ │
-────┘   └──┘ └─┘ └─┘ └───────────┘ └─┘ └─┘ └─
-          ▲               Max
-          │          ◄───15 ms───►
-      Marking (8.3 ms)
+ * Simple SDI12 command to determine if a device is active on the queried address.
+ * Expected response {'0', '\r', '\n'} where '0' is the address.
+ */
+HAL_StatusTypeDef SDI12_AckActive(SDI12_TypeDef *sdi12, const char addr) {
+    char cmd[3] = { addr, '!', 0x00 };
+    char response[3] = { 0, 0, 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 2, response, 3);
+    return result;
+}
+
+/*
+ * Probe every valid address ('0'-'9', 'a'-'z', 'A'-'Z') with a!
+ * and mark the ones that answer in map.
  *
+ * Only the first probe sends a break, the rest follow within the
+ * SDI12_WAKE_WINDOW_MS of the previous probe so the sensors are still
+ * listening. An empty address costs the marking, the command and the
+ * retry wait (~42 ms) instead of a break, the 110 ms timeout and a
+ * 200 ms pause. Probes are not retried, every empty address would
+ * otherwise take SDI12_MAX_ATTEMPTS attempts.
  *
- * Uses a single UART pin (TX) and cycles between TX and RX to
- * send and receive commands (respectively).
+ * scan_time (optional) receives the duration of the scan in ms.
  */
-static HAL_StatusTypeDef SDI12_QueryDevice(const char cmd[], const uint8_t cmd_len, char response[], const uint8_t response_len) {
-
-    // Setup GPIO pin for break
-    GPIO_InitTypeDef GPIO_InitStruct = { 0 };
-    GPIO_InitStruct.Pin = sdi12.Pin;
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-    GPIO_InitStruct.Pull = GPIO_NOPULL;
-    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-    HAL_GPIO_Init(sdi12.Port, &GPIO_InitStruct);
+HAL_StatusTypeDef SDI12_DiscoverDevices(SDI12_TypeDef *sdi12, SDI12_AddressMap_TypeDef *map, uint32_t *scan_time) {
+    uint32_t start = HAL_GetTick();
+    *map = 0;
 
-    // Break must be >= 12 ms
-    HAL_GPIO_WritePin(sdi12.Port, (uint16_t) sdi12.Pin, GPIO_PIN_SET);
-    HAL_Delay(12);
+    for (uint8_t i = 0; i < SDI12_NUM_ADDRESSES; i++) {
+        char addr = SDI12_AddressFromIndex(i);
+        char cmd[3] = { addr, '!', 0x00 };
+        char response[3] = { 0 };
 
-    // Marking must be >= 8.3 ms
-    HAL_GPIO_WritePin(sdi12.Port, (uint16_t) sdi12.Pin, GPIO_PIN_RESET);
-    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-    GPIO_InitStruct.Alternate = GPIO_AF_USART1;
-    HAL_GPIO_Init(sdi12.Port, &GPIO_InitStruct);
-    HAL_Delay(9);
+        SDI12_Transaction_TypeDef transaction = { 0 };
+        transaction.Cmd = cmd;
+        transaction.CmdLen = 2;
+        transaction.Response = response;
+        transaction.ResponseLen = sizeof(response);
+        transaction.SkipBreak = 1;
+        transaction.NoRetry = 1;
 
-    HAL_StatusTypeDef res;
+        HAL_StatusTypeDef result = SDI12_Transfer(sdi12, &transaction);
+        if (result == HAL_BUSY || result == HAL_ERROR) {
+            return result;
+        }
 
-    // Put TX on the SDI-12 data pin so a command can be sent. This seems to be
-    // the minimum amount of code required for the swap to happen.
-    __HAL_UART_DISABLE(sdi12.Huart);
-    MODIFY_REG(sdi12.Huart->Instance->CR2, USART_CR2_SWAP, UART_ADVFEATURE_SWAP_DISABLE);
-    __HAL_UART_ENABLE(sdi12.Huart);
+        if (result == HAL_OK && transaction.Count == 1 && response[0] == addr) {
+            SDI12_AddressMap_Set(map, addr);
+        }
+    }
 
-    // Transmit
-    res = HAL_UART_Transmit(sdi12.Huart, (uint8_t*) cmd, cmd_len, 1000);
-    if (res != HAL_OK) {
-        return res;
+    if (scan_time != NULL) {
+        *scan_time = HAL_GetTick() - start;
     }
 
-    uint8_t count = 0;
-    res = SDI12_ReceiveLine(response, response_len, &count);
-    return res;
+    return HAL_OK;
 }
 
 /*
- * Receive a CR/LF terminated string from the sensor.
- *
- * buffer - the buffer to store received characters. Will contain the CR/LF characters
- *          if they are read off the data line and they fit within the buffer.
- * max - the maximum number of characters to receive - ie the size of buffer.
- * count - the number of characters received is written to count.
- *
- * HAL_ERROR or HAL_TIMEOUT may be returned, otherwise HAL_OK.
+ * Used to populate a list of connected device addresses.
+ * Writes at most max addresses to devices and returns how many were found.
  */
-static HAL_StatusTypeDef SDI12_ReceiveLine(char buffer[], const uint8_t max, uint8_t *const count) {
-    if (buffer == 0 || max == 0 || count == 0) {
-        return HAL_ERROR;
-    }
-
-    // Put the SDI-12 pin into RX mode so the sensor response can be read.
-    __HAL_UART_DISABLE(sdi12.Huart);
-    MODIFY_REG(sdi12.Huart->Instance->CR2, USART_CR2_SWAP, UART_ADVFEATURE_SWAP_ENABLE);
-    __HAL_UART_ENABLE(sdi12.Huart);
-
-    // Receive up to max chars, break on CR/LF pair.
-    HAL_StatusTypeDef res = HAL_OK;
-    uint8_t i = 0;
-    uint8_t c;
-    while (i < max) {
-        // Wait for up to 100ms for each character before timing out. This is to
-        // handle waiting for the first character after a command has been sent,
-        // where you are meant to have 3 retries with the last being after 100ms.
-        res = HAL_UART_Receive(sdi12.Huart, &c, 1, 110);
-        if (res == HAL_TIMEOUT) {
-            break;
-        }
-
-        buffer[i++] = c;
-        if (c == 0x0a) {
-            break;
-        }
+uint8_t SDI12_DevicesOnBus(SDI12_TypeDef *sdi12, char *const devices, const uint8_t max) {
+    SDI12_AddressMap_TypeDef map;
+    if (SDI12_DiscoverDevices(sdi12, &map, NULL) != HAL_OK) {
+        return 0;
     }
 
-    while (i > 0) {
-        c = buffer[i - 1];
-        if (c == 0x0a || c == 0x0d) {
-            buffer[i - 1] = 0;
-            i--;
-        } else {
-            break;
+    uint8_t index = 0;
+    for (uint8_t i = 0; i < SDI12_NUM_ADDRESSES && index < max; i++) {
+        char addr = SDI12_AddressFromIndex(i);
+        if (SDI12_AddressMap_Test(&map, addr)) {
+            devices[index++] = addr;
         }
     }
 
-    *count = i;
-    return res;
+    return index;
 }
 
 /*
- * Simple SDI12 command to determine if a device is active on the queried address.
- * Expected response {'0', '\r', '\n'} where '0' is the address.
+ * Position of addr in the address space ('0'-'9' = 0-9, 'a'-'z' = 10-35,
+ * 'A'-'Z' = 36-61) or -1 if it is not a valid address.
  */
-HAL_StatusTypeDef SDI12_AckActive(const char addr) {
-    char cmd[3] = { addr, '!', 0x00 };
-    char response[3] = { 0, 0, 0 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 2, response, 3);
-    return result;
+int8_t SDI12_AddressIndex(const char addr) {
+    if (addr >= '0' && addr <= '9') {
+        return addr - '0';
+    }
+    if (addr >= 'a' && addr <= 'z') {
+        return addr - 'a' + 10;
+    }
+    if (addr >= 'A' && addr <= 'Z') {
+        return addr - 'A' + 36;
+    }
+    return -1;
 }
 
 /*
- * Used to populate a list of connected device addresses.
+ * Inverse of SDI12_AddressIndex(...).
  */
-void SDI12_DevicesOnBus(char *const devices) {
-    uint8_t index = 0;
-    for (char i = '0'; i <= '9'; i++) {
-        HAL_StatusTypeDef result = SDI12_AckActive(i);
-        if (result == HAL_OK) {
-            devices[index++] = i;
-        }
+char SDI12_AddressFromIndex(const uint8_t index) {
+    if (index < 10) {
+        return '0' + index;
+    }
+    if (index < 36) {
+        return 'a' + index - 10;
+    }
+    return 'A' + index - 36;
+}
+
+void SDI12_AddressMap_Set(SDI12_AddressMap_TypeDef *map, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index >= 0) {
+        *map |= (uint64_t) 1 << index;
+    }
+}
 
-        HAL_Delay(200);
+void SDI12_AddressMap_Clear(SDI12_AddressMap_TypeDef *map, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index >= 0) {
+        *map &= ~((uint64_t) 1 << index);
     }
 }
 
+uint8_t SDI12_AddressMap_Test(const SDI12_AddressMap_TypeDef *map, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    return index >= 0 && ((*map >> index) & 1);
+}
+
 /*
  * Issue the 'aI!' command.
  */
-HAL_StatusTypeDef SDI12_GetId(const char addr, char response[], uint8_t response_len) {
+HAL_StatusTypeDef SDI12_GetId(SDI12_TypeDef *sdi12, const char addr, char response[], uint8_t response_len) {
     char cmd[] = { addr, 'I', '!', 0x00 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 3, response, response_len);
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 3, response, response_len);
+    return result;
+}
+
+/*
+ * Identify measurement (aIM!), SDI-12 v1.4.
+ * Returns the atttn a aM! would give without starting a measurement.
+ */
+HAL_StatusTypeDef SDI12_IdentifyMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[] = { addr, 'I', 'M', '!', 0x00 };
+    char response[7] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 4, response, 7);
+
+    SDI12_ParseMeasurement(response, measurement_info);
+
     return result;
 }
 
@@ -198,10 +1090,10 @@ HAL_StatusTypeDef SDI12_GetId(const char addr, char response[], uint8_t response
  * May not work on all devices. Only those who support this feature.
  * Expected response {'1', '\r', '\n'} where '1' is the new address
  */
-HAL_StatusTypeDef SDI12_ChangeAddr(char *from_addr, char *to_addr) {
+HAL_StatusTypeDef SDI12_ChangeAddr(SDI12_TypeDef *sdi12, char *from_addr, char *to_addr) {
     char cmd[5] = { *from_addr, 'A', *to_addr, '!', 0x00 };
     char response[3] = { 0 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 5, response, 3);
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 5, response, 3);
     return result;
 }
 
@@ -215,29 +1107,92 @@ HAL_StatusTypeDef SDI12_ChangeAddr(char *from_addr, char *to_addr) {
  * Expected response as = atttn -> address (a), 3 numbers representing processing time (t)
  * and n results (n).
  */
-HAL_StatusTypeDef SDI12_StartMeasurement(const char addr, SDI12_Measure_TypeDef *measurement_info) {
+HAL_StatusTypeDef SDI12_StartMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
     char cmd[4] = { addr, 'M', '!', 0x00 };
     char response[7] = { 0 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 3, response, 7);
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 3, response, 7);
+
+    SDI12_ParseMeasurement(response, measurement_info);
+
+    return result;
+}
+
+/*
+ * Wait for the sensor to finish a measurement started with
+ * SDI12_StartMeasurement(...) (or aMC!/aV!).
+ *
+ * Sensors send a service request (a<CR><LF>) the moment their data is ready,
+ * which is usually well before the ttt they advertised. The receiver is
+ * armed straight after the aM! response and this returns as soon as the
+ * service request from addr arrives, or at the ttt deadline if it never does.
+ * Either way the data can then be collected with SDI12_SendData(...).
+ *
+ * Must be called immediately after the M command, the deadline is counted
+ * from now.
+ */
+HAL_StatusTypeDef SDI12_WaitForServiceRequest(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info) {
+    if (measurement_info->Time == 0) {
+        return HAL_OK; // Data is ready now
+    }
+
+    uint32_t deadline = HAL_GetTick() + (uint32_t) measurement_info->Time * 1000;
+
+    while ((int32_t) (HAL_GetTick() - deadline) < 0) {
+        char response[3] = { 0 };
+        SDI12_Transaction_TypeDef transaction = { 0 };
+        transaction.Response = response;
+        transaction.ResponseLen = sizeof(response);
+
+        HAL_StatusTypeDef res = SDI12_Listen(sdi12, &transaction);
+        if (res != HAL_OK) {
+            return res;
+        }
 
-    // Check for valid response
-    if (response[0] != '\0') {
-        // Address of queried device (a)
-        measurement_info->Address = response[0];
+        while (transaction.Status == HAL_BUSY && (int32_t) (HAL_GetTick() - deadline) < 0) {
+            __WFI();
+        }
+        SDI12_Abort(sdi12);
 
-        // Extract time from response to be converted to uint16_t
-        char time_buf[3];
-        for (uint8_t i = 1; i < 4; i++) {
-            time_buf[i - 1] = response[i];
+        // Anything else (noise, other sensors) is ignored until the deadline
+        if (transaction.Status == HAL_OK && transaction.Count == 1 && response[0] == addr) {
+            return HAL_OK;
         }
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Start concurrent measurement (aC!). Same idea as SDI12_StartMeasurement(...)
+ * except the sensor does not hold the bus while it measures, so other sensors
+ * can be started (and read) while this one is busy.
+ * Sensors do not send a service request for concurrent measurements, the
+ * caller must wait the full ttt before calling SDI12_SendData(...).
+ * Expected response as = atttnn -> address (a), 3 numbers representing
+ * processing time (t) and up to 99 results (nn).
+ */
+HAL_StatusTypeDef SDI12_StartConcurrentMeasurement(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[4] = { addr, 'C', '!', 0x00 };
+    char response[8] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 3, response, 8);
+
+    SDI12_ParseMeasurement(response, measurement_info);
+
+    return result;
+}
 
-        // Convert time_buf (ttt) into uint16_t
-        uint16_t time;
-        measurement_info->Time = sscanf(time_buf, "%hd", &time);
+/*
+ * Concurrent measurement with CRC (aCC!). Response format is the same as
+ * SDI12_StartConcurrentMeasurement(...), the data returned by the following
+ * D commands carries a CRC.
+ */
+HAL_StatusTypeDef SDI12_StartConcurrentMeasurementCRC(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[5] = { addr, 'C', 'C', '!', 0x00 };
+    char response[8] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 4, response, 8);
 
-        // Number of values to expect in measurement (n)
-        measurement_info->NumValues = response[4] - '0'; // char to uint8_t
-    };
+    SDI12_ParseMeasurement(response, measurement_info);
+    measurement_info->UseCRC = 1;
 
     return result;
 }
@@ -247,53 +1202,199 @@ HAL_StatusTypeDef SDI12_StartMeasurement(const char addr, SDI12_Measure_TypeDef
  * command. Called until the number of measurements (obtained in a M command)
  * are received.
  * The populated array (data) should have sufficient size to hold all values
- * returned from the sensor (approx upto 10 * 75 = 750).
+ * returned from the sensor (upto 10 * 75 + 1 = 751).
+ * After a MC/CC command the CRC of every response is checked (and removed
+ * from data).
  */
-HAL_StatusTypeDef SDI12_SendData(const char addr, const SDI12_Measure_TypeDef *measurement_info, char *data) {
+HAL_StatusTypeDef SDI12_SendData(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, char *data) {
 
     uint16_t index = 0; // Holds position in data array
-    uint8_t n_values = 0; // Holds index of number of values received
+    uint16_t n_values = 0; // Holds index of number of values received
+
+    // aD1! onwards follow straight on without a break
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, sdi12, addr);
 
-    // Loop through until all the data has been captured (matching NumValues)
+    // Loop through aD0!...aD9! until all the data has been captured (matching NumValues)
     char cmd[] = { addr, 'D', 0, '!', 0x00 };
-    for (char i = '0'; i < '9'; i++) {
-        cmd[2] = i;
-        char response[MAX_RESPONSE_SIZE + 1] = { 0 };
-        HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 4, response,
-        MAX_RESPONSE_SIZE);
+    for (uint8_t i = 0; i < 10; i++) {
+        cmd[2] = '0' + i;
+        char response[SDI12_DATA_LINE_SIZE + 1] = { 0 };
+        SDI12_Transaction_TypeDef transaction = { 0 };
+        transaction.Cmd = cmd;
+        transaction.CmdLen = 4;
+        transaction.Response = response;
+        transaction.ResponseLen = SDI12_DATA_LINE_SIZE;
+        HAL_StatusTypeDef result = SDI12_QueryData(&session, &transaction, measurement_info->UseCRC);
         if (result != HAL_OK) {
             return result;
         }
 
-        uint8_t res_index = 0;
-        for (uint8_t x = 1; x < MAX_RESPONSE_SIZE; x++) {
+        // Everything after the address, CR/LF and CRC are already gone
+        for (uint16_t x = 1; x < transaction.Count; x++) {
             // Total number of + and - should equal measurement_info->NumValues if all values have been received
             if (response[x] == '+' || response[x] == '-') {
                 n_values++;
             }
-            // No need to go search beyond received data
-            if (response[x] == '\0') {
-                break;
-            }
-
-            res_index++;
         }
 
-        if (res_index > 0) {
-            memcpy(&data[index], &response[1], res_index);
-            index += res_index;
+        if (transaction.Count > 1) {
+            memcpy(&data[index], &response[1], transaction.Count - 1);
+            index += transaction.Count - 1;
             data[index] = 0;
         }
 
         // All values received
-        if (n_values == measurement_info->NumValues) {
+        if (n_values >= measurement_info->NumValues) {
+            return HAL_OK;
+        }
+    }
+
+    return HAL_ERROR;
+}
+
+/*
+ * Send a data command (aDn!). When use_crc is set the CRC is checked and
+ * stripped from the response, the command is sent again up to
+ * SDI12_CRC_RETRIES times if it does not match.
+ */
+static HAL_StatusTypeDef SDI12_QueryData(SDI12_Session_TypeDef *session, SDI12_Transaction_TypeDef *transaction, const uint8_t use_crc) {
+    HAL_StatusTypeDef result = HAL_ERROR;
+
+    for (uint8_t attempt = 0; attempt <= SDI12_CRC_RETRIES; attempt++) {
+        result = SDI12_Session_Transfer(session, transaction);
+        if (result != HAL_OK || !use_crc) {
+            return result;
+        }
+
+        if (SDI12_CheckCRC(transaction->Response, transaction->Count) == HAL_OK) {
+            transaction->Count -= SDI12_CRC_SIZE;
+            transaction->Response[transaction->Count] = '\0';
+            return HAL_OK;
+        }
+        result = HAL_ERROR;
+    }
+
+    return result;
+}
+
+/*
+ * Same as SDI12_SendData(...) except the values are parsed straight into
+ * parser as each character arrives instead of being copied out as text.
+ * Only the current line is buffered (SDI12_DATA_LINE_SIZE).
+ *
+ * parser must have been set up with SDI12_Parser_Init(...) and hold at
+ * least measurement_info->NumValues values. Returns HAL_ERROR with
+ * parser->Overflow set if the sensor sent more values than that.
+ *
+ * With CRC responses each line is only parsed once its CRC has been
+ * checked, so values from a corrupted line never reach the parser.
+ *
+ * After a high volume ASCII measurement (aHA!) this runs through
+ * aD0!...aD999! instead of stopping at aD9!.
+ */
+HAL_StatusTypeDef SDI12_ReadValues(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, SDI12_Parser_TypeDef *parser) {
+    char cmd[8];
+    char response[SDI12_DATA_LINE_SIZE + 1];
+
+    SDI12_Transaction_TypeDef transaction = { 0 };
+    transaction.Cmd = cmd;
+    transaction.Response = response;
+    transaction.ResponseLen = SDI12_DATA_LINE_SIZE;
+    transaction.ByteCallback = measurement_info->UseCRC ? NULL : SDI12_FeedParser;
+    transaction.Context = parser;
+
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, sdi12, addr);
+
+    uint16_t commands = measurement_info->HighVolume ? SDI12_MAX_HV_COMMANDS : 10;
+    for (uint16_t i = 0; i < commands; i++) {
+        transaction.CmdLen = SDI12_DataCommand(cmd, addr, "D", i);
+        uint16_t count = parser->Count;
+
+        HAL_StatusTypeDef result = SDI12_QueryData(&session, &transaction, measurement_info->UseCRC);
+        if (result == HAL_OK && measurement_info->UseCRC) {
+            for (uint16_t x = 0; x < transaction.Count; x++) {
+                SDI12_Parser_Feed(parser, response[x]);
+            }
+        }
+        SDI12_Parser_Finish(parser);
+        if (result != HAL_OK) {
+            return result;
+        }
+        if (parser->Overflow) {
+            return HAL_ERROR;
+        }
+
+        // All values received
+        if (parser->Count >= measurement_info->NumValues) {
             return HAL_OK;
         }
+
+        // Sensor has nothing more to send
+        if (parser->Count == count) {
+            break;
+        }
     }
 
     return HAL_ERROR;
 }
 
+/*
+ * Read a continuous measurement (aRn!, or aRCn! with use_crc) straight
+ * into parser. Sensors supporting these answer with the latest values
+ * at once, there is no ttt to wait for and no aDn! round trip.
+ *
+ * parser is not re-initialised, values are appended to it.
+ * Returns HAL_ERROR if another sensor answered, the response holds
+ * no values (continuous measurement n not supported) or more than
+ * parser has room for (parser->Overflow set).
+ */
+HAL_StatusTypeDef SDI12_ReadContinuous(SDI12_TypeDef *sdi12, const char addr, const uint8_t index, const uint8_t use_crc, SDI12_Parser_TypeDef *parser) {
+    if (index > 9) {
+        return HAL_ERROR;
+    }
+
+    char cmd[] = { addr, 'R', 'C', '0' + index, '!', 0x00 };
+    uint8_t cmd_len = 5;
+    if (!use_crc) {
+        // aRn!
+        cmd[2] = '0' + index;
+        cmd[3] = '!';
+        cmd_len = 4;
+    }
+    char response[SDI12_DATA_LINE_SIZE + 1];
+
+    SDI12_Transaction_TypeDef transaction = { 0 };
+    transaction.Cmd = cmd;
+    transaction.CmdLen = cmd_len;
+    transaction.Response = response;
+    transaction.ResponseLen = SDI12_DATA_LINE_SIZE;
+    transaction.ByteCallback = use_crc ? NULL : SDI12_FeedParser;
+    transaction.Context = parser;
+
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, sdi12, addr);
+
+    uint16_t count = parser->Count;
+    HAL_StatusTypeDef result = SDI12_QueryData(&session, &transaction, use_crc);
+    if (result == HAL_OK && use_crc) {
+        for (uint16_t x = 0; x < transaction.Count; x++) {
+            SDI12_Parser_Feed(parser, response[x]);
+        }
+    }
+    SDI12_Parser_Finish(parser);
+    if (result != HAL_OK) {
+        return result;
+    }
+
+    if (transaction.Count == 0 || response[0] != addr || parser->Count == count || parser->Overflow) {
+        return HAL_ERROR;
+    }
+
+    return HAL_OK;
+}
+
 /*
  * Request verification command (aV!) containing system information (a = address).
  * Basically system diagnostics of the sensor.
@@ -305,92 +1406,201 @@ HAL_StatusTypeDef SDI12_SendData(const char addr, const SDI12_Measure_TypeDef *m
  * Up to the manufacturer to decide on what is included. As such this command may not
  * return information on all devices.
  */
-HAL_StatusTypeDef SDI12_StartVerification(const char addr, SDI12_Measure_TypeDef *verification_info) {
+HAL_StatusTypeDef SDI12_StartVerification(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *verification_info) {
     char cmd[] = { addr, 'V', '!', 0x00 };
     char response[7] = { 0 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 3, response, 7);
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 3, response, 7);
 
-    // Check for valid response
-    if (response[0] != '\0') {
-        // Address of queried device (a)
-        verification_info->Address = response[0];
+    SDI12_ParseMeasurement(response, verification_info);
 
-        // Extract time from response to be converted to uint16_t
-        char time_buf[3];
-        for (uint8_t i = 1; i < 4; i++) {
-            time_buf[i - 1] = response[i];
-        }
+    return result;
+}
 
-        // Convert time_buf (ttt) into uint16_t
-        uint16_t time;
-        verification_info->Time = sscanf(time_buf, "%hd", &time);
+/*
+ * Start measurment with CRC for error checking.
+ * Vitually the same as the SDI12_StartMeasurement(...) function,
+ * however, a CRC is preformed with sensors using >1.3 of the
+ * SDI-12 specification.
+ * The responses to the following SDI12_SendData(...) or SDI12_ReadValues(...)
+ * are CRC checked and re-requested if corrupted. Sensors below version 1.3
+ * do not support this command.
+ */
+HAL_StatusTypeDef SDI12_StartMeasurementCRC(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[5] = { addr, 'M', 'C', '!', 0x00 };
+    char response[7] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 4, response, 7);
 
-        // Number of values to expect in measurement (n)
-        verification_info->NumValues = response[4] - '0'; // char to uint8_t
-    };
+    SDI12_ParseMeasurement(response, measurement_info);
+    measurement_info->UseCRC = 1;
 
     return result;
 }
 
 /*
- * Cyclic Redundancy Check (CRC).
- * Part of the >1.3 SDI-12 specification.
- * Error detection for line transmission.
+ * Start a high volume ASCII measurement (aHA!, v1.4), for sensors with
+ * more values than fit in aD0!...aD9!. Response is atttnnn.
+ * Read the data with SDI12_ReadValues(...) once ttt has elapsed, the
+ * data responses always carry a CRC.
  */
-uint16_t SDI12_CheckCRC(char *response) {
-    uint16_t crc = 0;
-    const uint8_t timeout = 9;
-    uint8_t i = 0;
-    while (response[i] != '\r' && i < timeout) {
-        crc ^= response[i]; // XOR character
-        for (uint8_t c = 0; c > 8; c++) {
-            if (crc & 1) { // LSB  = 1
-                crc >>= 1;  // One bit right
-                crc ^= 0xA001; // XOR 0xA001
-            } else {
-                crc >>= 1; // One bit right
-            }
+HAL_StatusTypeDef SDI12_StartHighVolumeASCII(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[] = { addr, 'H', 'A', '!', 0x00 };
+    char response[9] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 4, response, 9);
+
+    SDI12_ParseMeasurement(response, measurement_info);
+    measurement_info->UseCRC = 1;
+    measurement_info->HighVolume = 1;
+
+    return result;
+}
+
+/*
+ * Start a high volume binary measurement (aHB!, v1.4). Response is atttnnn.
+ * Read the data with SDI12_ReadBinaryValues(...) or packet by packet with
+ * SDI12_ReadBinaryPacket(...) once ttt has elapsed.
+ */
+HAL_StatusTypeDef SDI12_StartHighVolumeBinary(SDI12_TypeDef *sdi12, const char addr, SDI12_Measure_TypeDef *measurement_info) {
+    char cmd[] = { addr, 'H', 'B', '!', 0x00 };
+    char response[9] = { 0 };
+    HAL_StatusTypeDef result = SDI12_QueryDevice(sdi12, cmd, 4, response, 9);
+
+    SDI12_ParseMeasurement(response, measurement_info);
+    measurement_info->HighVolume = 1;
+
+    return result;
+}
+
+/*
+ * Request binary packet index (aDB0!...aDB999!) into packet and decode
+ * its header. The packet is re-requested if its CRC does not match.
+ * Up to 1006 bytes arrive in one transaction, DMA keeps the CPU free.
+ */
+HAL_StatusTypeDef SDI12_ReadBinaryPacket(SDI12_TypeDef *sdi12, const char addr, const uint16_t index, SDI12_BinaryPacket_TypeDef *packet) {
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, sdi12, addr);
+
+    return SDI12_ReadBinary(&session, index, packet);
+}
+
+/*
+ * SDI12_ReadBinaryPacket(...) as part of a session, so consecutive
+ * packets and CRC retries skip the break.
+ */
+static HAL_StatusTypeDef SDI12_ReadBinary(SDI12_Session_TypeDef *session, const uint16_t index, SDI12_BinaryPacket_TypeDef *packet) {
+    if (index >= SDI12_MAX_HV_COMMANDS) {
+        return HAL_ERROR;
+    }
+
+    char addr = session->Address;
+    char cmd[8];
+    SDI12_Transaction_TypeDef transaction = { 0 };
+    transaction.Cmd = cmd;
+    transaction.CmdLen = SDI12_DataCommand(cmd, addr, "DB", index);
+    transaction.Response = (char*) packet->Data;
+    transaction.ResponseLen = SDI12_BINARY_MAX_PACKET;
+    transaction.Binary = 1;
+
+    HAL_StatusTypeDef result = HAL_ERROR;
+    for (uint8_t attempt = 0; attempt <= SDI12_CRC_RETRIES; attempt++) {
+        result = SDI12_Session_Transfer(session, &transaction);
+        if (result != HAL_OK) {
+            return result;
+        }
+
+        packet->Length = transaction.Count;
+        result = SDI12_Binary_Decode(packet);
+        if (result == HAL_OK) {
+            return (packet->Address == addr) ? HAL_OK : HAL_ERROR;
         }
-        i++;
     }
 
-    return crc;
+    return result;
 }
 
 /*
- * Start measurment with CRC for error checking.
- * Vitually the same as the SDI12_StartMeasurement(...) function,
- * however, a CRC is preformed with sensors using >1.3 of the
- * SDI-12 specification.
- * If this function is called on sensors below version 1.3 no
- * errors will through and the function will operate the same as
- * SDI12_StartMeasurement(...)
+ * Collect the values of a high volume binary measurement as floats,
+ * one aDBn! packet after the other. packet is only used as the receive
+ * buffer. count is set to the number of values stored.
  */
-HAL_StatusTypeDef SDI12_StartMeasurementCRC(const char addr, SDI12_Measure_TypeDef *measurement_info) {
-    char cmd[5] = { addr, 'M', 'C', '!', 0x00 };
-    char response[9] = { 0 };
-    HAL_StatusTypeDef result = SDI12_QueryDevice(cmd, 5, response, 9);
+HAL_StatusTypeDef SDI12_ReadBinaryValues(SDI12_TypeDef *sdi12, const char addr, const SDI12_Measure_TypeDef *measurement_info, SDI12_BinaryPacket_TypeDef *packet, float values[], const uint16_t capacity, uint16_t *count) {
+    *count = 0;
 
-    // Check for valid response
-    if (response[0] != '\0') {
-        // Address of queried device (a)
-        measurement_info->Address = response[0];
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, sdi12, addr);
 
-        // Extract time from response to be converted to uint16_t
-        char time_buf[3];
-        for (uint8_t i = 1; i < 4; i++) {
-            time_buf[i - 1] = response[i];
+    for (uint16_t i = 0; i < SDI12_MAX_HV_COMMANDS; i++) {
+        HAL_StatusTypeDef result = SDI12_ReadBinary(&session, i, packet);
+        if (result != HAL_OK) {
+            return result;
         }
 
-        // Convert time_buf (ttt) into uint16_t
-        uint16_t time;
-        measurement_info->Time = sscanf(time_buf, "%hd", &time);
+        // Sensor has nothing more to send
+        if (packet->NumValues == 0) {
+            break;
+        }
 
-        // Number of values to expect in measurement (n)
-        measurement_info->NumValues = response[4] - '0'; // char to uint8_t
-    };
+        *count += SDI12_Binary_ToFloat(packet, &values[*count], capacity - *count);
+        if (*count >= measurement_info->NumValues || *count >= capacity) {
+            return HAL_OK;
+        }
+    }
 
-    SDI12_CheckCRC(response);
+    return (*count >= measurement_info->NumValues) ? HAL_OK : HAL_ERROR;
+}
 
-    return result;
+/*
+ * Build a data command, a + type + index + !, e.g. "0D12!" or "0DB3!".
+ * cmd must hold 8 characters. Returns the command length.
+ */
+static uint8_t SDI12_DataCommand(char cmd[], const char addr, const char *type, const uint16_t index) {
+    uint8_t len = 0;
+    cmd[len++] = addr;
+    while (*type != '\0') {
+        cmd[len++] = *type++;
+    }
+    if (index >= 100) {
+        cmd[len++] = '0' + index / 100;
+    }
+    if (index >= 10) {
+        cmd[len++] = '0' + (index / 10) % 10;
+    }
+    cmd[len++] = '0' + index % 10;
+    cmd[len++] = '!';
+    cmd[len] = 0x00;
+
+    return len;
+}
+
+/*
+ * Decode a atttn (M, V), atttnn (C) or atttnnn (HA, HB) response into
+ * measure_info.
+ * Left untouched if the response is empty.
+ */
+static void SDI12_ParseMeasurement(const char response[], SDI12_Measure_TypeDef *measure_info) {
+    if (response[0] == '\0') {
+        return;
+    }
+
+    // Address of queried device (a)
+    measure_info->Address = response[0];
+    measure_info->UseCRC = 0;
+    measure_info->HighVolume = 0;
+
+    // Time in seconds until the measurement is ready (ttt)
+    uint16_t time = 0;
+    for (uint8_t i = 1; i < 4 && response[i] >= '0' && response[i] <= '9'; i++) {
+        time = time * 10 + (response[i] - '0');
+    }
+    measure_info->Time = time;
+
+    // Number of values to expect in measurement (n, nn or nnn)
+    uint16_t num_values = 0;
+    for (uint8_t i = 4; i < 7 && response[i] >= '0' && response[i] <= '9'; i++) {
+        num_values = num_values * 10 + (response[i] - '0');
+    }
+    measure_info->NumValues = num_values;
+}
+
+static void SDI12_FeedParser(SDI12_Transaction_TypeDef *transaction, const char c) {
+    SDI12_Parser_Feed((SDI12_Parser_TypeDef*) transaction->Context, c);
 }
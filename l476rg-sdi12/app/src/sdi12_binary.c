@@ -0,0 +1,186 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_binary.c
+ * @brief          : SDI-12 v1.4 high volume binary (aDBn!) packet decoding.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * The Cortex-M4 is little endian like the packet, so values are copied
+ * straight out of the payload. memcpy keeps unaligned values safe.
+ ******************************************************************************
+ */
+
+#include "sdi12_binary.h"
+
+static const uint8_t SDI12_Binary_Sizes[] = {
+    0, // SDI12_BINARY_INVALID
+    1, 1, // INT8, UINT8
+    2, 2, // INT16, UINT16
+    4, 4, // INT32, UINT32
+    8, 8, // INT64, UINT64
+    4, // FLOAT32
+    8 // FLOAT64
+};
+
+/*
+ * Check a received packet (length and CRC) and fill in its header fields.
+ * Returns HAL_ERROR if it is truncated, corrupted or of an unknown type.
+ */
+HAL_StatusTypeDef SDI12_Binary_Decode(SDI12_BinaryPacket_TypeDef *packet) {
+    if (packet->Length < SDI12_BINARY_HEADER_SIZE + SDI12_BINARY_CRC_SIZE) {
+        return HAL_ERROR;
+    }
+
+    const uint8_t *data = packet->Data;
+    uint16_t size = data[1] | (data[2] << 8);
+    if (size > SDI12_BINARY_MAX_PAYLOAD
+            || packet->Length != SDI12_BINARY_HEADER_SIZE + size + SDI12_BINARY_CRC_SIZE) {
+        return HAL_ERROR;
+    }
+
+    uint16_t crc_offset = SDI12_BINARY_HEADER_SIZE + size;
+    uint16_t crc = data[crc_offset] | (data[crc_offset + 1] << 8);
+    if (SDI12_CRC16((const char*) data, crc_offset) != crc) {
+        return HAL_ERROR;
+    }
+
+    uint8_t type_size = SDI12_Binary_TypeSize((SDI12_BinaryType_TypeDef) data[3]);
+    if (size > 0 && (type_size == 0 || size % type_size != 0)) {
+        return HAL_ERROR;
+    }
+
+    packet->Address = (char) data[0];
+    packet->Type = (SDI12_BinaryType_TypeDef) data[3];
+    packet->PayloadSize = size;
+    packet->NumValues = (type_size > 0) ? size / type_size : 0;
+
+    return HAL_OK;
+}
+
+/*
+ * Size in bytes of one value of type, 0 if it is not a known type.
+ */
+uint8_t SDI12_Binary_TypeSize(const SDI12_BinaryType_TypeDef type) {
+    if ((uint32_t) type >= sizeof(SDI12_Binary_Sizes)) {
+        return 0;
+    }
+    return SDI12_Binary_Sizes[type];
+}
+
+/*
+ * Value index of an integer packet. Floats are truncated,
+ * UINT64 values above INT64_MAX wrap.
+ */
+int64_t SDI12_Binary_GetInt(const SDI12_BinaryPacket_TypeDef *packet, const uint16_t index) {
+    const uint8_t *p = &packet->Data[SDI12_BINARY_HEADER_SIZE + index * SDI12_Binary_TypeSize(packet->Type)];
+
+    switch (packet->Type) {
+    case SDI12_BINARY_INT8: {
+        int8_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_UINT8:
+        return *p;
+    case SDI12_BINARY_INT16: {
+        int16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_UINT16: {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_INT32: {
+        int32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_UINT32: {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_INT64:
+    case SDI12_BINARY_UINT64: {
+        int64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_FLOAT32:
+    case SDI12_BINARY_FLOAT64:
+        return (int64_t) SDI12_Binary_GetDouble(packet, index);
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Value index of any packet as a double.
+ */
+double SDI12_Binary_GetDouble(const SDI12_BinaryPacket_TypeDef *packet, const uint16_t index) {
+    const uint8_t *p = &packet->Data[SDI12_BINARY_HEADER_SIZE + index * SDI12_Binary_TypeSize(packet->Type)];
+
+    switch (packet->Type) {
+    case SDI12_BINARY_FLOAT32: {
+        float v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_FLOAT64: {
+        double v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    case SDI12_BINARY_UINT64: {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return (double) v;
+    }
+    default:
+        return (double) SDI12_Binary_GetInt(packet, index);
+    }
+}
+
+/*
+ * Convert up to capacity values of the packet to float.
+ * The type is only looked at once per packet, not per value.
+ * Returns the number of values written.
+ */
+uint16_t SDI12_Binary_ToFloat(const SDI12_BinaryPacket_TypeDef *packet, float values[], const uint16_t capacity) {
+    uint16_t n = (packet->NumValues < capacity) ? packet->NumValues : capacity;
+    const uint8_t *p = &packet->Data[SDI12_BINARY_HEADER_SIZE];
+
+    switch (packet->Type) {
+    case SDI12_BINARY_INT8:
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = (int8_t) p[i];
+        }
+        break;
+    case SDI12_BINARY_UINT8:
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = p[i];
+        }
+        break;
+    case SDI12_BINARY_INT16:
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = (int16_t) (p[2 * i] | (p[2 * i + 1] << 8));
+        }
+        break;
+    case SDI12_BINARY_UINT16:
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = (uint16_t) (p[2 * i] | (p[2 * i + 1] << 8));
+        }
+        break;
+    case SDI12_BINARY_FLOAT32:
+        memcpy(values, p, n * sizeof(float));
+        break;
+    default:
+        for (uint16_t i = 0; i < n; i++) {
+            values[i] = (float) SDI12_Binary_GetDouble(packet, i);
+        }
+        break;
+    }
+
+    return n;
+}
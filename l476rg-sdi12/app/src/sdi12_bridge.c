@@ -0,0 +1,203 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_bridge.c
+ * @brief          : Raw SDI-12 commands from a host UART onto a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Latency added by the bridge is the idle line detection (one character,
+ * 87 us at 115200) before the command is submitted, everything after
+ * that runs from interrupts.
+ ******************************************************************************
+ */
+
+#include "sdi12_bridge.h"
+
+static SDI12_Bridge_TypeDef *bridge_instance = NULL;
+
+static void SDI12_Bridge_Feed(SDI12_Bridge_TypeDef *bridge, const char c);
+static void SDI12_Bridge_Submit(SDI12_Bridge_TypeDef *bridge);
+static void SDI12_Bridge_Done(SDI12_Transaction_TypeDef *transaction);
+static void SDI12_Bridge_Reply(SDI12_Bridge_TypeDef *bridge, const char *reply, uint16_t len);
+static uint16_t SDI12_Bridge_Format(uint8_t *out, const char *reply, uint16_t len);
+
+/*
+ * Forward lines received on huart to bus. The bus must have been set up
+ * with SDI12_Init(...).
+ */
+HAL_StatusTypeDef SDI12_Bridge_Init(SDI12_Bridge_TypeDef *bridge, UART_HandleTypeDef *huart, SDI12_TypeDef *bus) {
+    if (huart->hdmarx == NULL || huart->hdmatx == NULL) {
+        return HAL_ERROR;
+    }
+
+    memset(bridge, 0, sizeof(SDI12_Bridge_TypeDef));
+    bridge->Huart = huart;
+    bridge->Bus = bus;
+    bridge_instance = bridge;
+
+    return HAL_UARTEx_ReceiveToIdle_DMA(huart, bridge->Rx, SDI12_BRIDGE_RX_SIZE);
+}
+
+/*
+ * Host characters are in up to position size of the DMA buffer.
+ * Call from HAL_UARTEx_RxEventCallback().
+ */
+void SDI12_Bridge_RxEventCallback(UART_HandleTypeDef *huart, const uint16_t size) {
+    SDI12_Bridge_TypeDef *bridge = bridge_instance;
+    if (bridge == NULL || bridge->Huart != huart) {
+        return;
+    }
+
+    // The full buffer event reports the end of the buffer, which is where the DMA wrapped to
+    uint16_t head = (size >= SDI12_BRIDGE_RX_SIZE) ? 0 : size;
+    while (bridge->RxTail != head) {
+        SDI12_Bridge_Feed(bridge, (char) bridge->Rx[bridge->RxTail]);
+        bridge->RxTail++;
+        if (bridge->RxTail >= SDI12_BRIDGE_RX_SIZE) {
+            bridge->RxTail = 0;
+        }
+    }
+}
+
+/*
+ * A reply has gone out, send the one waiting if there is one.
+ * Call from HAL_UART_TxCpltCallback().
+ */
+void SDI12_Bridge_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_Bridge_TypeDef *bridge = bridge_instance;
+    if (bridge == NULL || bridge->Huart != huart) {
+        return;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint16_t len = bridge->QueuedLen;
+    if (len > 0) {
+        memcpy(bridge->Tx, bridge->Queued, len);
+        bridge->QueuedLen = 0;
+    }
+    __set_PRIMASK(primask);
+
+    if (len > 0 && HAL_UART_Transmit_DMA(huart, bridge->Tx, len) != HAL_OK) {
+        bridge->RepliesDropped++;
+    }
+}
+
+/*
+ * Reception stops on an overrun, start it again.
+ * Call from HAL_UART_ErrorCallback().
+ */
+void SDI12_Bridge_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    SDI12_Bridge_TypeDef *bridge = bridge_instance;
+    if (bridge == NULL || bridge->Huart != huart || huart->RxState != HAL_UART_STATE_READY) {
+        return;
+    }
+
+    bridge->RxTail = 0;
+    bridge->LineLen = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(huart, bridge->Rx, SDI12_BRIDGE_RX_SIZE);
+}
+
+/*
+ * Build up the typed line, CR or LF sends it.
+ */
+static void SDI12_Bridge_Feed(SDI12_Bridge_TypeDef *bridge, const char c) {
+    if (c == '\r' || c == '\n') {
+        if (bridge->LineLen > 0) {
+            SDI12_Bridge_Submit(bridge);
+            bridge->LineLen = 0;
+        }
+        return;
+    }
+
+    if (bridge->LineLen < SDI12_BRIDGE_MAX_CMD) {
+        bridge->Line[bridge->LineLen++] = c;
+    }
+}
+
+/*
+ * Put the typed line on the bus, the response is sent back from
+ * SDI12_Bridge_Done(...). A line typed while the previous command is
+ * still running is answered with BUSY.
+ */
+static void SDI12_Bridge_Submit(SDI12_Bridge_TypeDef *bridge) {
+    if (SDI12_IsBusy(bridge->Bus)) {
+        bridge->Dropped++;
+        SDI12_Bridge_Reply(bridge, SDI12_BRIDGE_BUSY, sizeof(SDI12_BRIDGE_BUSY) - 1);
+        return;
+    }
+
+    memcpy(bridge->Cmd, bridge->Line, bridge->LineLen);
+
+    SDI12_Transaction_TypeDef *transaction = &bridge->Transaction;
+    memset(transaction, 0, sizeof(SDI12_Transaction_TypeDef));
+    transaction->Cmd = bridge->Cmd;
+    transaction->CmdLen = bridge->LineLen;
+    transaction->Response = bridge->Response;
+    transaction->ResponseLen = sizeof(bridge->Response);
+    transaction->Callback = SDI12_Bridge_Done;
+    transaction->Context = bridge;
+    transaction->SkipBreak = 1;
+
+    if (SDI12_Submit(bridge->Bus, transaction) != HAL_OK) {
+        bridge->Dropped++;
+        SDI12_Bridge_Reply(bridge, SDI12_BRIDGE_BUSY, sizeof(SDI12_BRIDGE_BUSY) - 1);
+        return;
+    }
+    bridge->Commands++;
+}
+
+/*
+ * Response (or nothing) received, send it to the host with CR/LF.
+ */
+static void SDI12_Bridge_Done(SDI12_Transaction_TypeDef *transaction) {
+    SDI12_Bridge_TypeDef *bridge = (SDI12_Bridge_TypeDef*) transaction->Context;
+    if (transaction->Status != HAL_OK) {
+        bridge->Timeouts++;
+    }
+
+    uint16_t len = (transaction->Status == HAL_OK) ? transaction->Count : 0;
+    SDI12_Bridge_Reply(bridge, bridge->Response, len);
+}
+
+/*
+ * Send a line to the host with CR/LF. While the host UART is still
+ * sending the previous line it waits in Queued, sent from
+ * SDI12_Bridge_UART_TxCpltCallback(...).
+ */
+static void SDI12_Bridge_Reply(SDI12_Bridge_TypeDef *bridge, const char *reply, uint16_t len) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (bridge->Huart->gState != HAL_UART_STATE_READY) {
+        if (bridge->QueuedLen > 0) {
+            bridge->RepliesDropped++;
+        } else {
+            bridge->QueuedLen = SDI12_Bridge_Format(bridge->Queued, reply, len);
+        }
+        __set_PRIMASK(primask);
+        return;
+    }
+    __set_PRIMASK(primask);
+
+    len = SDI12_Bridge_Format(bridge->Tx, reply, len);
+    if (HAL_UART_Transmit_DMA(bridge->Huart, bridge->Tx, len) != HAL_OK) {
+        bridge->RepliesDropped++;
+    }
+}
+
+/*
+ * reply without the sensor's own CR/LF, then ours, so an empty line only
+ * ever means no response. Returns the length in out.
+ */
+static uint16_t SDI12_Bridge_Format(uint8_t *out, const char *reply, uint16_t len) {
+    while (len > 0 && (reply[len - 1] == '\r' || reply[len - 1] == '\n')) {
+        len--;
+    }
+    if (len > SDI12_DATA_LINE_SIZE - 2) {
+        len = SDI12_DATA_LINE_SIZE - 2;
+    }
+
+    memcpy(out, reply, len);
+    out[len++] = '\r';
+    out[len++] = '\n';
+    return len;
+}
@@ -0,0 +1,132 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_cache.c
+ * @brief          : Per-address cache of SDI-12 sensor metadata.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ */
+
+#include "sdi12_cache.h"
+
+/*
+ * Identification response is at most 1 + 2 + 8 + 6 + 3 + 13 characters.
+ */
+#define SDI12_IDENT_SIZE 33
+
+static void SDI12_Cache_CopyField(char *dst, const char response[], const uint8_t response_len, const uint8_t offset, const uint8_t len);
+
+/*
+ * Empty cache for the sensors of bus.
+ */
+void SDI12_Cache_Init(SDI12_Cache_TypeDef *cache, SDI12_TypeDef *bus) {
+    memset(cache, 0, sizeof(SDI12_Cache_TypeDef));
+    cache->Bus = bus;
+}
+
+/*
+ * Cache entry for addr, or NULL if nothing is known about it.
+ */
+SDI12_CacheEntry_TypeDef* SDI12_Cache_Get(SDI12_Cache_TypeDef *cache, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index < 0 || cache->Entries[index].Valid == 0) {
+        return NULL;
+    }
+    return &cache->Entries[index];
+}
+
+/*
+ * Identification of addr, only issues aI! the first time.
+ */
+HAL_StatusTypeDef SDI12_Cache_Identify(SDI12_Cache_TypeDef *cache, const char addr, const SDI12_Ident_TypeDef **ident) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index < 0) {
+        return HAL_ERROR;
+    }
+
+    SDI12_CacheEntry_TypeDef *entry = &cache->Entries[index];
+    if (!(entry->Valid & SDI12_CACHE_ID)) {
+        // Room for the CR/LF so a full-length reply is read to its end
+        char response[SDI12_IDENT_SIZE + 2 + 1] = { 0 };
+        HAL_StatusTypeDef result = SDI12_GetId(cache->Bus, addr, response, SDI12_IDENT_SIZE + 2);
+        if (result != HAL_OK || response[0] != addr) {
+            SDI12_Cache_Invalidate(cache, addr);
+            return (result != HAL_OK) ? result : HAL_ERROR;
+        }
+
+        uint8_t len = strcspn(response, "\r\n");
+        response[len] = 0;
+        SDI12_Ident_TypeDef *id = &entry->Ident;
+        SDI12_Cache_CopyField(id->Version, response, len, 1, 2);
+        SDI12_Cache_CopyField(id->Vendor, response, len, 3, 8);
+        SDI12_Cache_CopyField(id->Model, response, len, 11, 6);
+        SDI12_Cache_CopyField(id->ModelVersion, response, len, 17, 3);
+        SDI12_Cache_CopyField(id->Serial, response, len, 20, 13);
+        entry->Valid |= SDI12_CACHE_ID;
+    }
+
+    if (ident != NULL) {
+        *ident = &entry->Ident;
+    }
+    return HAL_OK;
+}
+
+/*
+ * Keep the response of a successful aC!.
+ */
+void SDI12_Cache_StoreConcurrent(SDI12_Cache_TypeDef *cache, const char addr, const SDI12_Measure_TypeDef *measure_info) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index >= 0) {
+        cache->Entries[index].Concurrent = *measure_info;
+        cache->Entries[index].Valid |= SDI12_CACHE_CONCURRENT;
+    }
+}
+
+/*
+ * Number of values the last aC! of addr announced, 0 if unknown.
+ * Used to size value buffers before the first measurement.
+ */
+uint16_t SDI12_Cache_ExpectedValues(SDI12_Cache_TypeDef *cache, const char addr) {
+    SDI12_CacheEntry_TypeDef *entry = SDI12_Cache_Get(cache, addr);
+    if (entry == NULL || !(entry->Valid & SDI12_CACHE_CONCURRENT)) {
+        return 0;
+    }
+    return entry->Concurrent.NumValues;
+}
+
+/*
+ * Forget addr, e.g. when it stops acknowledging or its address changes.
+ */
+void SDI12_Cache_Invalidate(SDI12_Cache_TypeDef *cache, const char addr) {
+    int8_t index = SDI12_AddressIndex(addr);
+    if (index >= 0) {
+        memset(&cache->Entries[index], 0, sizeof(SDI12_CacheEntry_TypeDef));
+    }
+}
+
+/*
+ * Drop every address that is not in present, the result of
+ * SDI12_DiscoverDevices(...).
+ */
+void SDI12_Cache_Sync(SDI12_Cache_TypeDef *cache, const SDI12_AddressMap_TypeDef *present) {
+    for (uint8_t i = 0; i < SDI12_NUM_ADDRESSES; i++) {
+        if (!((*present >> i) & 1)) {
+            memset(&cache->Entries[i], 0, sizeof(SDI12_CacheEntry_TypeDef));
+        }
+    }
+}
+
+/*
+ * Copy the len character field at offset of the response and null
+ * terminate it. Fields past the end of a short response are left empty.
+ */
+static void SDI12_Cache_CopyField(char *dst, const char response[], const uint8_t response_len, const uint8_t offset, const uint8_t len) {
+    uint8_t n = 0;
+    if (response_len > offset) {
+        n = response_len - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dst, &response[offset], n);
+    }
+    dst[n] = '\0';
+}
@@ -0,0 +1,106 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_parser.c
+ * @brief          : Streaming parser for SDI-12 data values.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Every value starts with a '+' or '-' and ends at the next sign or at any
+ * other non numeric character (CR, LF or the CRC characters). Anything
+ * outside of a value, such as the leading address, is skipped.
+ *
+ *   0  +  3  .  1  4  -  1  2  CR LF
+ *   |  [-----------]  [-----]  |
+ * skip    value 0     value 1  end
+ *
+ ******************************************************************************
+ */
+
+#include "sdi12_parser.h"
+
+#define SDI12_MAX_DIGITS 9
+
+static const float SDI12_InvPow10[SDI12_MAX_DIGITS + 1] = {
+    1.0f, 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f, 1e-8f, 1e-9f
+};
+
+static void SDI12_Parser_EndValue(SDI12_Parser_TypeDef *parser);
+
+/*
+ * Start parsing into values (capacity entries).
+ */
+void SDI12_Parser_Init(SDI12_Parser_TypeDef *parser, SDI12_Value_TypeDef *values, const uint16_t capacity) {
+    parser->Values = values;
+    parser->Capacity = capacity;
+    parser->Count = 0;
+    parser->Overflow = 0;
+    parser->InValue = 0;
+}
+
+/*
+ * Feed the next received character. Safe to call from interrupt context.
+ */
+void SDI12_Parser_Feed(SDI12_Parser_TypeDef *parser, const char c) {
+    if (c == '+' || c == '-') {
+        SDI12_Parser_EndValue(parser);
+        parser->InValue = 1;
+        parser->SeenPoint = 0;
+        parser->Digits = 0;
+        parser->Sign = (c == '-') ? -1 : 1;
+        parser->Mantissa = 0;
+        parser->Decimals = 0;
+        return;
+    }
+
+    if (!parser->InValue) {
+        return;
+    }
+
+    if (c >= '0' && c <= '9') {
+        // Ignore digits beyond what the spec allows rather than overflow
+        if (parser->Digits < SDI12_MAX_DIGITS) {
+            parser->Mantissa = parser->Mantissa * 10 + (c - '0');
+            parser->Decimals += parser->SeenPoint;
+            parser->Digits++;
+        }
+    } else if (c == '.' && !parser->SeenPoint) {
+        parser->SeenPoint = 1;
+    } else {
+        SDI12_Parser_EndValue(parser);
+    }
+}
+
+/*
+ * Complete the value in progress, if any. Call once the whole response
+ * has been fed in case it did not end with a CR/LF.
+ */
+void SDI12_Parser_Finish(SDI12_Parser_TypeDef *parser) {
+    SDI12_Parser_EndValue(parser);
+}
+
+/*
+ * Convert a parsed value to single precision float.
+ */
+float SDI12_ValueToFloat(const SDI12_Value_TypeDef *value) {
+    return (float) value->Mantissa * SDI12_InvPow10[value->Decimals];
+}
+
+static void SDI12_Parser_EndValue(SDI12_Parser_TypeDef *parser) {
+    if (!parser->InValue) {
+        return;
+    }
+    parser->InValue = 0;
+
+    // A lone sign is not a value
+    if (parser->Digits == 0) {
+        return;
+    }
+
+    if (parser->Count >= parser->Capacity) {
+        parser->Overflow = 1;
+        return;
+    }
+
+    SDI12_Value_TypeDef *value = &parser->Values[parser->Count++];
+    value->Mantissa = parser->Sign * parser->Mantissa;
+    value->Decimals = parser->Decimals;
+}
@@ -0,0 +1,421 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_scheduler.c
+ * @brief          : Concurrent measurement scheduler for a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Sequential (aM!) cycle, every sensor blocks the bus for its ttt:
+ *
+ *   M0 ttt0 D0 | M1 ttt1 D1 | M2 ttt2 D2       -> sum(ttt)
+ *
+ * Concurrent (aC!) cycle, conversions overlap:
+ *
+ *   C0 C1 C2 ...... D1 ... D0 ...... D2        -> max(ttt)
+ *
+ * Periodic, every sensor on its own interval, the bus does whichever
+ * start (C) or collection (D) has the earliest deadline:
+ *
+ *   C0 C1 .. D0 .. D1 .. C0 .. D0 .. C0 C1 .. D0 D1 ..
+ *
+ ******************************************************************************
+ */
+
+#include "sdi12_scheduler.h"
+
+static SDI12_Slot_TypeDef* SDI12_Scheduler_NextReady(SDI12_Scheduler_TypeDef *scheduler, const uint32_t now);
+static SDI12_Slot_TypeDef* SDI12_Scheduler_NextDue(SDI12_Scheduler_TypeDef *scheduler, const uint32_t now);
+static uint16_t SDI12_Scheduler_KnownTime(const SDI12_Scheduler_TypeDef *scheduler, const SDI12_Slot_TypeDef *slot);
+static uint8_t SDI12_Scheduler_Start(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot);
+static void SDI12_Scheduler_Collect(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot);
+static HAL_StatusTypeDef SDI12_Scheduler_Reserve(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot, const uint16_t count);
+
+/*
+ * Clear all sensors from the scheduler and attach it to bus.
+ * cache may be NULL, it must belong to the same bus otherwise.
+ * The values of every sensor are stored in pool (pool_size entries).
+ */
+void SDI12_Scheduler_Init(SDI12_Scheduler_TypeDef *scheduler, SDI12_TypeDef *bus, SDI12_Cache_TypeDef *cache, SDI12_Value_TypeDef *pool, const uint16_t pool_size) {
+    memset(scheduler, 0, sizeof(SDI12_Scheduler_TypeDef));
+    scheduler->Bus = bus;
+    scheduler->Cache = cache;
+    scheduler->Pool = pool;
+    scheduler->PoolSize = pool_size;
+}
+
+/*
+ * Add a sensor to be measured every cycle. Its share of the value pool
+ * is reserved now if the cache knows how many values it returns, once
+ * its first aC! response says so otherwise.
+ * Returns HAL_ERROR if the scheduler is full.
+ */
+HAL_StatusTypeDef SDI12_Scheduler_Add(SDI12_Scheduler_TypeDef *scheduler, const char addr) {
+    if (scheduler->NumSlots >= SDI12_SCHEDULER_MAX_SENSORS) {
+        return HAL_ERROR;
+    }
+
+    SDI12_Slot_TypeDef *slot = &scheduler->Slots[scheduler->NumSlots++];
+    memset(slot, 0, sizeof(SDI12_Slot_TypeDef));
+    slot->Address = addr;
+    SDI12_Parser_Init(&slot->Parser, NULL, 0);
+
+    if (scheduler->Cache != NULL) {
+        // No room is not an error yet, the first aC! tries again
+        SDI12_Scheduler_Reserve(scheduler, slot, SDI12_Cache_ExpectedValues(scheduler->Cache, addr));
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Scan the bus and add every sensor found that is not in the scheduler
+ * yet. With a cache, the entries of sensors that left the bus are
+ * dropped and each new sensor is identified (aI!, only sent once per
+ * sensor) before it is added, one that does not identify is skipped.
+ * Returns HAL_ERROR if the scan failed or the scheduler is full.
+ */
+HAL_StatusTypeDef SDI12_Scheduler_Discover(SDI12_Scheduler_TypeDef *scheduler) {
+    SDI12_AddressMap_TypeDef present;
+    HAL_StatusTypeDef res = SDI12_DiscoverDevices(scheduler->Bus, &present, NULL);
+    if (res != HAL_OK) {
+        return res;
+    }
+    if (scheduler->Cache != NULL) {
+        SDI12_Cache_Sync(scheduler->Cache, &present);
+    }
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        SDI12_AddressMap_Clear(&present, scheduler->Slots[i].Address);
+    }
+
+    for (uint8_t i = 0; i < SDI12_NUM_ADDRESSES; i++) {
+        char addr = SDI12_AddressFromIndex(i);
+        if (!SDI12_AddressMap_Test(&present, addr)) {
+            continue;
+        }
+        if (scheduler->Cache != NULL && SDI12_Cache_Identify(scheduler->Cache, addr, NULL) != HAL_OK) {
+            continue;
+        }
+        res = SDI12_Scheduler_Add(scheduler, addr);
+        if (res != HAL_OK) {
+            return res;
+        }
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Issue aC! to every sensor and note when each one will be ready.
+ * Sensors that fail to respond are marked SDI12_SLOT_ERROR and skipped
+ * for the rest of the cycle, and dropped from the metadata cache.
+ *
+ * Sensors with the longest known ttt (from the cache) are started first
+ * so the slowest conversion overlaps the most bus traffic.
+ */
+HAL_StatusTypeDef SDI12_Scheduler_StartCycle(SDI12_Scheduler_TypeDef *scheduler) {
+    if (scheduler->Pending > 0) {
+        return HAL_BUSY;
+    }
+
+    scheduler->StartTick = HAL_GetTick();
+
+    // Insertion sort of the start order, longest ttt first
+    uint8_t order[SDI12_SCHEDULER_MAX_SENSORS];
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        uint16_t time = SDI12_Scheduler_KnownTime(scheduler, &scheduler->Slots[i]);
+        uint8_t j = i;
+        while (j > 0 && SDI12_Scheduler_KnownTime(scheduler, &scheduler->Slots[order[j - 1]]) < time) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        if (SDI12_Scheduler_Start(scheduler, &scheduler->Slots[order[i]])) {
+            scheduler->Pending++;
+        }
+    }
+
+    if (scheduler->Pending == 0) {
+        scheduler->CycleTime = HAL_GetTick() - scheduler->StartTick;
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Collect data from at most one sensor whose measurement is ready
+ * (earliest deadline first), so the caller can do other work between
+ * bus transactions.
+ * Returns 1 once every sensor of the cycle has been dealt with.
+ */
+uint8_t SDI12_Scheduler_Poll(SDI12_Scheduler_TypeDef *scheduler) {
+    if (scheduler->Pending == 0) {
+        return 1;
+    }
+
+    SDI12_Slot_TypeDef *slot = SDI12_Scheduler_NextReady(scheduler, HAL_GetTick());
+    if (slot == NULL) {
+        return 0;
+    }
+
+    SDI12_Scheduler_Collect(scheduler, slot);
+    scheduler->Pending--;
+
+    if (scheduler->Pending == 0) {
+        scheduler->CycleTime = HAL_GetTick() - scheduler->StartTick;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Run a complete cycle, sleeping while no sensor is ready.
+ * Returns HAL_ERROR if any sensor failed, the other sensors' data is
+ * still valid.
+ */
+HAL_StatusTypeDef SDI12_Scheduler_RunCycle(SDI12_Scheduler_TypeDef *scheduler) {
+    HAL_StatusTypeDef res = SDI12_Scheduler_StartCycle(scheduler);
+    if (res != HAL_OK) {
+        return res;
+    }
+
+    while (!SDI12_Scheduler_Poll(scheduler)) {
+        __WFI();
+    }
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        if (scheduler->Slots[i].State == SDI12_SLOT_ERROR) {
+            return HAL_ERROR;
+        }
+    }
+
+    return HAL_OK;
+}
+
+/*
+ * Measure addr every interval ms from now on, driven by
+ * SDI12_Scheduler_Run(...).
+ * Returns HAL_ERROR if the sensor has not been added.
+ */
+HAL_StatusTypeDef SDI12_Scheduler_SetInterval(SDI12_Scheduler_TypeDef *scheduler, const char addr, const uint32_t interval) {
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        SDI12_Slot_TypeDef *slot = &scheduler->Slots[i];
+        if (slot->Address == addr) {
+            slot->Interval = interval;
+            slot->DueTick = HAL_GetTick();
+            return HAL_OK;
+        }
+    }
+
+    return HAL_ERROR;
+}
+
+/*
+ * Do the most urgent bus work that is due, earliest deadline first:
+ * collect the data of a sensor whose ttt has elapsed (deadline: its
+ * ready time) or start the next measurement of a sensor (deadline: its
+ * due time). One sensor per call so the caller stays responsive.
+ *
+ * A start that is a whole interval late skips that interval (counted in
+ * Missed) and the sensor keeps its original phase. A collection more than
+ * SDI12_SCHEDULER_COLLECT_SLACK_MS past the sensor's ttt, e.g. because the
+ * caller was busy elsewhere, counts as missed too.
+ *
+ * Returns the slot whose data was just collected (check its State),
+ * NULL otherwise.
+ */
+SDI12_Slot_TypeDef* SDI12_Scheduler_Run(SDI12_Scheduler_TypeDef *scheduler) {
+    uint32_t now = HAL_GetTick();
+    SDI12_Slot_TypeDef *ready = SDI12_Scheduler_NextReady(scheduler, now);
+    SDI12_Slot_TypeDef *due = SDI12_Scheduler_NextDue(scheduler, now);
+
+    if (ready != NULL && (due == NULL || (int32_t) (ready->ReadyTick - due->DueTick) <= 0)) {
+        uint32_t late = now - ready->ReadyTick;
+        if (late > ready->MaxCollectLateness) {
+            ready->MaxCollectLateness = late;
+        }
+        if (late > SDI12_SCHEDULER_COLLECT_SLACK_MS) {
+            ready->Missed++;
+            scheduler->Missed++;
+        }
+        SDI12_Scheduler_Collect(scheduler, ready);
+        return ready;
+    }
+    if (due == NULL) {
+        return NULL;
+    }
+
+    uint32_t lateness = now - due->DueTick;
+    if (lateness > due->MaxLateness) {
+        due->MaxLateness = lateness;
+    }
+    uint32_t missed = lateness / due->Interval;
+    due->Missed += missed;
+    scheduler->Missed += missed;
+    due->DueTick += (missed + 1) * due->Interval;
+
+    SDI12_Scheduler_Start(scheduler, due);
+
+    return NULL;
+}
+
+/*
+ * ms until SDI12_Scheduler_Run(...) has work, 0 if it has some now.
+ * The caller can sleep that long. UINT32_MAX if nothing is coming up.
+ */
+uint32_t SDI12_Scheduler_NextEvent(const SDI12_Scheduler_TypeDef *scheduler) {
+    uint32_t now = HAL_GetTick();
+    uint32_t next = UINT32_MAX;
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        const SDI12_Slot_TypeDef *slot = &scheduler->Slots[i];
+        uint32_t tick;
+        if (slot->State == SDI12_SLOT_MEASURING) {
+            tick = slot->ReadyTick;
+        } else if (slot->Interval > 0) {
+            tick = slot->DueTick;
+        } else {
+            continue;
+        }
+
+        int32_t wait = (int32_t) (tick - now);
+        if (wait <= 0) {
+            return 0;
+        }
+        if ((uint32_t) wait < next) {
+            next = (uint32_t) wait;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * Measuring slot with the earliest ready time that has passed, or NULL.
+ */
+static SDI12_Slot_TypeDef* SDI12_Scheduler_NextReady(SDI12_Scheduler_TypeDef *scheduler, const uint32_t now) {
+    SDI12_Slot_TypeDef *next = NULL;
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        SDI12_Slot_TypeDef *slot = &scheduler->Slots[i];
+        if (slot->State != SDI12_SLOT_MEASURING) {
+            continue;
+        }
+        // Signed difference copes with the tick wrapping
+        if ((int32_t) (now - slot->ReadyTick) < 0) {
+            continue;
+        }
+        if (next == NULL || (int32_t) (slot->ReadyTick - next->ReadyTick) < 0) {
+            next = slot;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * Periodic slot not measuring with the earliest due time that has
+ * passed, or NULL.
+ */
+static SDI12_Slot_TypeDef* SDI12_Scheduler_NextDue(SDI12_Scheduler_TypeDef *scheduler, const uint32_t now) {
+    SDI12_Slot_TypeDef *next = NULL;
+
+    for (uint8_t i = 0; i < scheduler->NumSlots; i++) {
+        SDI12_Slot_TypeDef *slot = &scheduler->Slots[i];
+        if (slot->Interval == 0 || slot->State == SDI12_SLOT_MEASURING) {
+            continue;
+        }
+        if ((int32_t) (now - slot->DueTick) < 0) {
+            continue;
+        }
+        if (next == NULL || (int32_t) (slot->DueTick - next->DueTick) < 0) {
+            next = slot;
+        }
+    }
+
+    return next;
+}
+
+/*
+ * Issue aC! to the slot's sensor and note when it will be ready.
+ * A sensor that fails to respond is marked SDI12_SLOT_ERROR and dropped
+ * from the metadata cache. So is one announcing more values than the
+ * pool has room for, with Status HAL_ERROR.
+ * Returns 1 if the sensor is now measuring.
+ */
+static uint8_t SDI12_Scheduler_Start(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot) {
+    slot->Status = SDI12_StartConcurrentMeasurement(scheduler->Bus, slot->Address, &slot->Info);
+    slot->Latency = scheduler->Bus->Latency;
+
+    if (slot->Status != HAL_OK || slot->Info.Address != slot->Address) {
+        slot->State = SDI12_SLOT_ERROR;
+        if (scheduler->Cache != NULL) {
+            SDI12_Cache_Invalidate(scheduler->Cache, slot->Address);
+        }
+        return 0;
+    }
+    if (scheduler->Cache != NULL) {
+        SDI12_Cache_StoreConcurrent(scheduler->Cache, slot->Address, &slot->Info);
+    }
+
+    slot->Status = SDI12_Scheduler_Reserve(scheduler, slot, slot->Info.NumValues);
+    if (slot->Status != HAL_OK) {
+        slot->State = SDI12_SLOT_ERROR;
+        return 0;
+    }
+    SDI12_Parser_Init(&slot->Parser, slot->Parser.Values, slot->Parser.Capacity);
+
+    // ttt counts from the end of the aC! response
+    slot->ReadyTick = HAL_GetTick() + (uint32_t) slot->Info.Time * 1000;
+    slot->State = SDI12_SLOT_MEASURING;
+
+    return 1;
+}
+
+/*
+ * Read the data of a slot whose measurement is ready.
+ */
+static void SDI12_Scheduler_Collect(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot) {
+    slot->Status = SDI12_ReadValues(scheduler->Bus, slot->Address, &slot->Info, &slot->Parser);
+    slot->State = (slot->Status == HAL_OK) ? SDI12_SLOT_DONE : SDI12_SLOT_ERROR;
+    if (slot->Status == HAL_OK) {
+        slot->Samples++;
+    }
+}
+
+/*
+ * Make sure the slot holds at least count values, taking a new share of
+ * the pool if its current one is too small (the old one is not reused).
+ * Returns HAL_ERROR if the pool has no room left.
+ */
+static HAL_StatusTypeDef SDI12_Scheduler_Reserve(SDI12_Scheduler_TypeDef *scheduler, SDI12_Slot_TypeDef *slot, const uint16_t count) {
+    if (count <= slot->Parser.Capacity) {
+        return HAL_OK;
+    }
+    if (scheduler->Pool == NULL || scheduler->PoolSize - scheduler->PoolUsed < count) {
+        return HAL_ERROR;
+    }
+
+    slot->Parser.Values = &scheduler->Pool[scheduler->PoolUsed];
+    slot->Parser.Capacity = count;
+    scheduler->PoolUsed += count;
+
+    return HAL_OK;
+}
+
+/*
+ * ttt of the slot's last aC! if cached, 0 otherwise.
+ */
+static uint16_t SDI12_Scheduler_KnownTime(const SDI12_Scheduler_TypeDef *scheduler, const SDI12_Slot_TypeDef *slot) {
+    if (scheduler->Cache == NULL) {
+        return 0;
+    }
+    SDI12_CacheEntry_TypeDef *entry = SDI12_Cache_Get(scheduler->Cache, slot->Address);
+    if (entry == NULL || !(entry->Valid & SDI12_CACHE_CONCURRENT)) {
+        return 0;
+    }
+    return entry->Concurrent.Time;
+}
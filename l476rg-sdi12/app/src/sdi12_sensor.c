@@ -0,0 +1,287 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_sensor.c
+ * @brief          : SDI-12 sensor side, answers commands from a data recorder.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * CPU work per command: one receive interrupt per command character, a
+ * copy of the prepared response, then one TXE interrupt per response
+ * character and TC.
+ ******************************************************************************
+ */
+
+#include "sdi12_sensor.h"
+
+static SDI12_Sensor_TypeDef *sensors[SDI12_SENSOR_MAX_INSTANCES];
+static uint8_t num_sensors = 0;
+
+static SDI12_Sensor_TypeDef* SDI12_Sensor_FindUart(const UART_HandleTypeDef *huart);
+static void SDI12_Sensor_Decode(SDI12_Sensor_TypeDef *sensor);
+static void SDI12_Sensor_Respond(SDI12_Sensor_TypeDef *sensor, const char *body);
+static void SDI12_Sensor_Listen(SDI12_Sensor_TypeDef *sensor);
+static void SDI12_Sensor_SetSwap(SDI12_Sensor_TypeDef *sensor, const uint32_t swap);
+
+/*
+ * Answer as a sensor at addr on the UART. The UART is set up like a
+ * recorder's (1200 baud 7E1, inverted, TX pin on the bus) but must not
+ * also be passed to SDI12_Init(...).
+ * Returns HAL_ERROR for an invalid address or if all sensors are in use.
+ */
+HAL_StatusTypeDef SDI12_Sensor_Init(SDI12_Sensor_TypeDef *sensor, UART_HandleTypeDef *huart, const char addr) {
+    if (SDI12_AddressIndex(addr) < 0) {
+        return HAL_ERROR;
+    }
+
+    uint8_t i = 0;
+    while (i < num_sensors && sensors[i] != sensor) {
+        i++;
+    }
+    if (i == num_sensors) {
+        if (num_sensors >= SDI12_SENSOR_MAX_INSTANCES) {
+            return HAL_ERROR;
+        }
+        sensors[num_sensors++] = sensor;
+    }
+
+    memset(sensor, 0, sizeof(SDI12_Sensor_TypeDef));
+    sensor->Huart = huart;
+    sensor->Address = addr;
+    sensor->State = SDI12_SENSOR_SLEEP;
+    SDI12_Sensor_SetMeasurement(sensor, 0, 0);
+
+    SDI12_Sensor_Listen(sensor);
+
+    return HAL_OK;
+}
+
+/*
+ * Identification returned by aI! after the address, e.g.
+ * "14STM32L4 MCP9808001" (version, vendor, model, model version...).
+ */
+void SDI12_Sensor_SetIdentification(SDI12_Sensor_TypeDef *sensor, const char *ident) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    strncpy(sensor->Identification, ident, SDI12_SENSOR_MAX_IDENT - 1);
+    sensor->Identification[SDI12_SENSOR_MAX_IDENT - 1] = 0;
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Time (ttt, s) and number of values announced to aM! (max 9) and
+ * aC! (max 99).
+ */
+void SDI12_Sensor_SetMeasurement(SDI12_Sensor_TypeDef *sensor, const uint16_t time, const uint8_t num_values) {
+    uint16_t ttt = (time > 999) ? 999 : time;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    snprintf(sensor->Measurement, sizeof(sensor->Measurement), "%03u%u", ttt, (num_values > 9) ? 9 : num_values);
+    snprintf(sensor->Concurrent, sizeof(sensor->Concurrent), "%03u%02u", ttt, (num_values > 99) ? 99 : num_values);
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Values returned by aD0! and aR0!, e.g. "+21.50+1013.2". Sends the
+ * service request (a<CR><LF>) if an aM! is waiting for them.
+ */
+void SDI12_Sensor_SetData(SDI12_Sensor_TypeDef *sensor, const char *data) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    strncpy(sensor->Data, data, SDI12_SENSOR_MAX_DATA - 1);
+    sensor->Data[SDI12_SENSOR_MAX_DATA - 1] = 0;
+
+    // Service requests go out without a break, asleep or not
+    if (sensor->ServiceRequest && sensor->State != SDI12_SENSOR_RESPOND) {
+        sensor->ServiceRequest = 0;
+        HAL_UART_AbortReceive(sensor->Huart);
+        SDI12_Sensor_Respond(sensor, "");
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Response has left the UART, listen for the next command.
+ * Call from HAL_UART_TxCpltCallback().
+ */
+void SDI12_Sensor_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_Sensor_TypeDef *sensor = SDI12_Sensor_FindUart(huart);
+    if (sensor == NULL || sensor->State != SDI12_SENSOR_RESPOND) {
+        return;
+    }
+
+    sensor->LastActivityTick = HAL_GetTick();
+    sensor->State = SDI12_SENSOR_LISTEN;
+    SDI12_Sensor_Listen(sensor);
+}
+
+/*
+ * A character of a command has arrived, the command is decoded and
+ * answered once its '!' is in.
+ * Call from HAL_UART_RxCpltCallback().
+ */
+void SDI12_Sensor_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_Sensor_TypeDef *sensor = SDI12_Sensor_FindUart(huart);
+    if (sensor == NULL) {
+        return;
+    }
+
+    uint32_t now = HAL_GetTick();
+    if (sensor->State == SDI12_SENSOR_LISTEN && (now - sensor->LastActivityTick) > SDI12_SENSOR_WAKE_MS) {
+        sensor->State = SDI12_SENSOR_SLEEP;
+    }
+
+    // 0x00 is the break itself, see SDI12_Sensor_UART_ErrorCallback()
+    char c = (char) (sensor->RxByte & 0x7f);
+    if (sensor->State == SDI12_SENSOR_LISTEN && c != 0x00) {
+        sensor->LastActivityTick = now;
+        if (sensor->CmdLen < SDI12_SENSOR_MAX_CMD) {
+            sensor->Cmd[sensor->CmdLen++] = c;
+        }
+        if (c == '!') {
+            SDI12_Sensor_Decode(sensor);
+            sensor->CmdLen = 0;
+        }
+    }
+
+    if (sensor->State != SDI12_SENSOR_RESPOND) {
+        SDI12_Sensor_Listen(sensor);
+    }
+}
+
+/*
+ * A framing error is a break, wake up and expect a command.
+ * Call from HAL_UART_ErrorCallback().
+ */
+void SDI12_Sensor_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    SDI12_Sensor_TypeDef *sensor = SDI12_Sensor_FindUart(huart);
+    if (sensor == NULL) {
+        return;
+    }
+
+    if (huart->ErrorCode & HAL_UART_ERROR_FE) {
+        if (sensor->State == SDI12_SENSOR_RESPOND) {
+            // The recorder gave up on the response
+            HAL_UART_AbortTransmit(huart);
+        }
+        sensor->Breaks++;
+        sensor->State = SDI12_SENSOR_LISTEN;
+        sensor->CmdLen = 0;
+        sensor->LastActivityTick = HAL_GetTick();
+    }
+
+    // Blocking errors (overrun) stop the reception
+    if (sensor->State != SDI12_SENSOR_RESPOND && huart->RxState == HAL_UART_STATE_READY) {
+        SDI12_Sensor_Listen(sensor);
+    }
+}
+
+/*
+ * Answer a complete command if it is for this sensor.
+ */
+static void SDI12_Sensor_Decode(SDI12_Sensor_TypeDef *sensor) {
+    const char *cmd = sensor->Cmd;
+    uint8_t len = sensor->CmdLen;
+
+    if (len == 2 && cmd[0] == '?') {
+        sensor->Commands++;
+        SDI12_Sensor_Respond(sensor, "");
+        return;
+    }
+    if (len < 2 || cmd[0] != sensor->Address) {
+        sensor->Ignored++;
+        return;
+    }
+
+    // Anything else addressed to the sensor aborts a pending aM!
+    sensor->ServiceRequest = 0;
+
+    const char *body = NULL;
+    char type = 0;
+    if (len == 2) {
+        body = "";
+    } else if (len == 3 && cmd[1] == 'I') {
+        body = sensor->Identification;
+    } else if (len == 3 && cmd[1] == 'M') {
+        body = sensor->Measurement;
+        type = 'M';
+        sensor->ServiceRequest = memcmp(sensor->Measurement, "000", 3) != 0;
+    } else if (len == 3 && cmd[1] == 'C') {
+        body = sensor->Concurrent;
+        type = 'C';
+    } else if (len == 4 && (cmd[1] == 'D' || cmd[1] == 'R') && cmd[2] == '0') {
+        body = sensor->Data;
+    }
+
+    if (body == NULL) {
+        sensor->Ignored++;
+        return;
+    }
+
+    sensor->Commands++;
+    SDI12_Sensor_Respond(sensor, body);
+
+    if (type != 0 && sensor->MeasureCallback != NULL) {
+        sensor->MeasureCallback(sensor, type);
+    }
+}
+
+/*
+ * Send address, body and CR/LF. Re-enabling the transmitter puts the
+ * marking on the line ahead of the first character.
+ */
+static void SDI12_Sensor_Respond(SDI12_Sensor_TypeDef *sensor, const char *body) {
+    uint8_t len = 0;
+    sensor->Tx[len++] = sensor->Address;
+    while (*body != 0 && len < SDI12_DATA_LINE_SIZE - 2) {
+        sensor->Tx[len++] = *body++;
+    }
+    sensor->Tx[len++] = '\r';
+    sensor->Tx[len++] = '\n';
+
+    sensor->State = SDI12_SENSOR_RESPOND;
+    SDI12_Sensor_SetSwap(sensor, UART_ADVFEATURE_SWAP_DISABLE);
+    CLEAR_BIT(sensor->Huart->Instance->CR1, USART_CR1_TE);
+    SET_BIT(sensor->Huart->Instance->CR1, USART_CR1_TE);
+
+    if (HAL_UART_Transmit_IT(sensor->Huart, (uint8_t*) sensor->Tx, len) != HAL_OK) {
+        sensor->State = SDI12_SENSOR_LISTEN;
+        SDI12_Sensor_Listen(sensor);
+    }
+}
+
+/*
+ * Point the bus pin at the receiver and wait for the next character.
+ */
+static void SDI12_Sensor_Listen(SDI12_Sensor_TypeDef *sensor) {
+    if (READ_BIT(sensor->Huart->Instance->CR2, USART_CR2_SWAP) == 0) {
+        SDI12_Sensor_SetSwap(sensor, UART_ADVFEATURE_SWAP_ENABLE);
+    }
+    HAL_UART_Receive_IT(sensor->Huart, &sensor->RxByte, 1);
+}
+
+/*
+ * Sensor the UART belongs to, or NULL if it is not acting as one.
+ */
+static SDI12_Sensor_TypeDef* SDI12_Sensor_FindUart(const UART_HandleTypeDef *huart) {
+    for (uint8_t i = 0; i < num_sensors; i++) {
+        if (sensors[i]->Huart == huart) {
+            return sensors[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Same as the recorder, the UART must be disabled to swap TX/RX.
+ */
+static void SDI12_Sensor_SetSwap(SDI12_Sensor_TypeDef *sensor, const uint32_t swap) {
+    __HAL_UART_DISABLE(sensor->Huart);
+    MODIFY_REG(sensor->Huart->Instance->CR2, USART_CR2_SWAP, swap);
+    __HAL_UART_ENABLE(sensor->Huart);
+}
@@ -0,0 +1,166 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_stream.c
+ * @brief          : Continuous measurement (aRn!) streaming for a SDI-12 bus.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Per sample, M/D sequence vs continuous:
+ *
+ *   break aM! atttn | ttt | break aD0! a+v...     -> 2 commands + ttt
+ *   break aR0! a+v...                             -> 1 command
+ *
+ ******************************************************************************
+ */
+
+#include "sdi12_stream.h"
+
+#define SDI12_STREAM_MASK (SDI12_STREAM_BUFFER_SIZE - 1)
+
+static void SDI12_Stream_ReadChannel(SDI12_Stream_TypeDef *stream, const SDI12_Channel_TypeDef *channel);
+
+/*
+ * Stream from bus every period ms (0 to read as fast as the bus allows).
+ */
+void SDI12_Stream_Init(SDI12_Stream_TypeDef *stream, SDI12_TypeDef *bus, const uint32_t period) {
+    memset(stream, 0, sizeof(SDI12_Stream_TypeDef));
+    stream->Bus = bus;
+    stream->Period = period;
+}
+
+/*
+ * Read continuous measurement index (aR0!...aR9!) of addr every round.
+ * Returns HAL_ERROR if all channels are in use.
+ */
+HAL_StatusTypeDef SDI12_Stream_AddChannel(SDI12_Stream_TypeDef *stream, const char addr, const uint8_t index, const uint8_t use_crc) {
+    if (stream->NumChannels >= SDI12_STREAM_MAX_CHANNELS || index > 9) {
+        return HAL_ERROR;
+    }
+
+    SDI12_Channel_TypeDef *channel = &stream->Channels[stream->NumChannels++];
+    channel->Address = addr;
+    channel->Index = index;
+    channel->UseCRC = use_crc;
+
+    return HAL_OK;
+}
+
+/*
+ * Reset the statistics and make the first round due now.
+ * Samples still in the buffer are kept.
+ */
+void SDI12_Stream_Start(SDI12_Stream_TypeDef *stream) {
+    memset(&stream->Stats, 0, sizeof(SDI12_StreamStats_TypeDef));
+    stream->StartTick = HAL_GetTick();
+    stream->NextTick = stream->StartTick;
+}
+
+/*
+ * Run a round if one is due, call from the main loop.
+ * Rounds that could not be started on time because the previous ones took
+ * longer than the period are skipped (counted in Missed) rather than run
+ * back to back, so the spacing of the samples stays regular.
+ * Returns the number of samples queued.
+ */
+uint8_t SDI12_Stream_Poll(SDI12_Stream_TypeDef *stream) {
+    uint32_t now = HAL_GetTick();
+    // Signed difference copes with the tick wrapping
+    if ((int32_t) (now - stream->NextTick) < 0) {
+        return 0;
+    }
+
+    SDI12_StreamStats_TypeDef *stats = &stream->Stats;
+    if (stats->Rounds > 0) {
+        uint32_t interval = now - stream->LastRoundTick;
+        if (stats->Rounds == 1 || interval < stats->MinInterval) {
+            stats->MinInterval = interval;
+        }
+        if (interval > stats->MaxInterval) {
+            stats->MaxInterval = interval;
+        }
+    }
+    stream->LastRoundTick = now;
+    stats->Rounds++;
+
+    uint16_t head = stream->Head;
+    for (uint8_t i = 0; i < stream->NumChannels; i++) {
+        SDI12_Stream_ReadChannel(stream, &stream->Channels[i]);
+    }
+
+    stream->NextTick += stream->Period;
+    now = HAL_GetTick();
+    if ((int32_t) (now - stream->NextTick) >= (int32_t) stream->Period && stream->Period > 0) {
+        uint32_t behind = (now - stream->NextTick) / stream->Period;
+        stats->Missed += behind;
+        stream->NextTick += behind * stream->Period;
+    }
+
+    return (uint8_t) (stream->Head - head);
+}
+
+/*
+ * Take the oldest sample out of the buffer.
+ * Returns 0 if there is none.
+ */
+uint8_t SDI12_Stream_Read(SDI12_Stream_TypeDef *stream, SDI12_Sample_TypeDef *sample) {
+    uint16_t tail = stream->Tail;
+    if (tail == stream->Head) {
+        return 0;
+    }
+
+    *sample = stream->Buffer[tail & SDI12_STREAM_MASK];
+    stream->Tail = tail + 1;
+
+    return 1;
+}
+
+/*
+ * Number of samples waiting in the buffer.
+ */
+uint16_t SDI12_Stream_Available(const SDI12_Stream_TypeDef *stream) {
+    return (uint16_t) (stream->Head - stream->Tail);
+}
+
+/*
+ * Copy of the statistics with the sample rate and jitter worked out.
+ */
+void SDI12_Stream_GetStats(const SDI12_Stream_TypeDef *stream, SDI12_StreamStats_TypeDef *stats) {
+    *stats = stream->Stats;
+
+    uint32_t elapsed = HAL_GetTick() - stream->StartTick;
+    stats->Rate = (elapsed > 0) ? (float) stats->Samples * 1000.0f / (float) elapsed : 0.0f;
+    stats->Jitter = stats->MaxInterval - stats->MinInterval;
+}
+
+/*
+ * Read one channel into the next free buffer slot.
+ * The slot is only handed over (Head moved) once the read succeeded.
+ */
+static void SDI12_Stream_ReadChannel(SDI12_Stream_TypeDef *stream, const SDI12_Channel_TypeDef *channel) {
+    uint16_t head = stream->Head;
+    uint8_t full = (uint16_t) (head - stream->Tail) >= SDI12_STREAM_BUFFER_SIZE;
+
+    // Still read when full to keep the timing and statistics honest
+    SDI12_Sample_TypeDef discard;
+    SDI12_Sample_TypeDef *sample = full ? &discard : &stream->Buffer[head & SDI12_STREAM_MASK];
+
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, sample->Values, SDI12_STREAM_MAX_VALUES);
+
+    HAL_StatusTypeDef result = SDI12_ReadContinuous(stream->Bus, channel->Address, channel->Index, channel->UseCRC, &parser);
+    if (result != HAL_OK) {
+        stream->Stats.Errors++;
+        return;
+    }
+
+    sample->Tick = HAL_GetTick();
+    sample->Address = channel->Address;
+    sample->Index = channel->Index;
+    sample->Count = parser.Count;
+    stream->Stats.Samples++;
+
+    if (full) {
+        stream->Stats.Overruns++;
+        return;
+    }
+    stream->Head = head + 1;
+}
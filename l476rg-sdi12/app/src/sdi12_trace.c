@@ -0,0 +1,95 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_trace.c
+ * @brief          : Timestamped trace of SDI-12 transaction phases.
+ *            Built using a STM32L476RG.
+ ******************************************************************************
+ * Records come from the UART and timer interrupts of every bus, a record
+ * is a handful of stores with interrupts disabled.
+ ******************************************************************************
+ */
+
+#include "sdi12_trace.h"
+#include "SDI12_debug.h"
+
+#define SDI12_TRACE_MASK (SDI12_TRACE_SIZE - 1)
+
+/*
+ * Records per debug_output() call, it takes at most 255 bytes.
+ */
+#define SDI12_TRACE_CHUNK 31
+
+static SDI12_TraceRecord_TypeDef records[SDI12_TRACE_SIZE];
+static uint32_t head = 0;
+static uint32_t tail = 0;
+
+/*
+ * Add a record, overwriting the oldest one when the ring is full.
+ * Called through SDI12_TRACE_EVENT(...).
+ */
+void SDI12_Trace_Record(const uint8_t bus, const SDI12_TraceEvent_TypeDef event, const char addr, const uint8_t detail) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    SDI12_TraceRecord_TypeDef *record = &records[head & SDI12_TRACE_MASK];
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    record->Cycles = DWT->CYCCNT;
+#else
+    record->Cycles = HAL_GetTick();
+#endif
+    record->Event = (uint8_t) event;
+    record->Bus = bus;
+    record->Address = addr;
+    record->Detail = detail;
+
+    head++;
+    if (head - tail > SDI12_TRACE_SIZE) {
+        tail = head - SDI12_TRACE_SIZE;
+    }
+
+    __set_PRIMASK(primask);
+}
+
+/*
+ * Number of records waiting to be dumped.
+ */
+uint16_t SDI12_Trace_Available(void) {
+    return (uint16_t) (head - tail);
+}
+
+/*
+ * Send the waiting records over the debug UART, oldest first, and empty
+ * the ring. Blocking, call from the main loop (e.g. after a cycle that
+ * missed its budget). Records added meanwhile wait for the next dump.
+ */
+void SDI12_Trace_Dump(void) {
+    uint32_t start = tail;
+    uint16_t count = (uint16_t) (head - start);
+    uint32_t clock = SystemCoreClock;
+
+    uint8_t header[10] = { 'S', 'D', 'T', '1' };
+    header[4] = (uint8_t) count;
+    header[5] = (uint8_t) (count >> 8);
+    memcpy(&header[6], &clock, sizeof(clock));
+    debug_output(header, sizeof(header));
+
+    SDI12_TraceRecord_TypeDef chunk[SDI12_TRACE_CHUNK];
+    uint16_t sent = 0;
+    while (sent < count) {
+        uint16_t n = 0;
+        while (n < SDI12_TRACE_CHUNK && sent + n < count) {
+            chunk[n] = records[(start + sent + n) & SDI12_TRACE_MASK];
+            n++;
+        }
+        debug_output((uint8_t*) chunk, (uint8_t) (n * sizeof(SDI12_TraceRecord_TypeDef)));
+        sent += n;
+    }
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // Unless records were overwritten during the dump
+    if (tail == start) {
+        tail = start + count;
+    }
+    __set_PRIMASK(primask);
+}
@@ -0,0 +1,61 @@
+/*
+ ******************************************************************************
+ * @file           : bench_crc.c
+ * @brief          : Host benchmark of the three CRC-16 kernels.
+ ******************************************************************************
+ * Relative numbers only, the Cortex-M4 has no data cache so the tables
+ * cost flash wait states there instead of cache misses. The flash figure
+ * is the lookup table, build with arm-none-eabi-gcc and compare the
+ * sizes of sdi12_crc.o for the code.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "crc_variants.h"
+
+#define LINE_SIZE 75 // Longest aDn! response with its CRC
+#define NUM_LINES 64
+#define ROUNDS 20000
+
+static char lines[NUM_LINES][LINE_SIZE];
+
+static double Elapsed(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start->tv_sec) + (double) (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(void) {
+    // Printable characters, as in an ASCII response
+    uint32_t seed = 1;
+    for (uint16_t l = 0; l < NUM_LINES; l++) {
+        for (uint16_t i = 0; i < LINE_SIZE; i++) {
+            seed = seed * 1103515245 + 12345;
+            lines[l][i] = (char) ('+' + (seed >> 16) % 80);
+        }
+    }
+
+    printf("CRC-16 of %u character lines (host CPU)\n", LINE_SIZE);
+    printf("  kernel          ns/line   MB/s   table (bytes)\n");
+    for (uint8_t k = 0; k < CRC_NUM_VARIANTS; k++) {
+        const CRC_Variant_TypeDef *v = &crc_variants[k];
+        volatile uint16_t sink = 0;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t r = 0; r < ROUNDS; r++) {
+            for (uint16_t l = 0; l < NUM_LINES; l++) {
+                sink ^= v->CRC16(lines[l], LINE_SIZE);
+            }
+        }
+        double seconds = Elapsed(&start);
+        (void) sink;
+
+        double count = (double) ROUNDS * NUM_LINES;
+        printf("  %-14s %8.1f %6.0f   %5u\n", v->Name, seconds * 1e9 / count, count * LINE_SIZE / seconds / 1e6, v->TableSize);
+    }
+
+    return 0;
+}
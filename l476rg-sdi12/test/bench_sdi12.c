@@ -0,0 +1,455 @@
+/*
+ ******************************************************************************
+ * @file           : bench_sdi12.c
+ * @brief          : Benchmarks of the SDI-12 driver on the simulated bus.
+ ******************************************************************************
+ * Bus figures (commands/s, cycle times) are in simulated time and hold on
+ * the target, they only depend on the protocol timing. Parser figures are
+ * host CPU time, compare them with each other only.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdi12.h"
+#include "sdi12_scheduler.h"
+#include "sdi12_stream.h"
+#include "sdi12_sim.h"
+
+#define COMMANDS 200
+#define PARSE_ROUNDS 200000
+#define STREAM_SECONDS 60
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static Sim_Sensor_TypeDef sensors[SIM_MAX_SENSORS];
+
+static const float values[] = { 3.14f, -12.5f, 0.01f, 1234.5f, -0.25f, 20.0f, 7.0f, 0.5f, -3.0f };
+
+/*
+ * Bus with num_sensors sensors '0'... of ttt 1 s and 9 values each.
+ */
+static void Setup(const uint8_t num_sensors) {
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus, &huart, USART3, 1, &htim, TIM6, GPIOC, 0x0010);
+    for (uint8_t i = 0; i < num_sensors; i++) {
+        Sim_Sensor_Init(&sensors[i], (char) ('0' + i));
+        Sim_Sensor_SetValues(&sensors[i], values, sizeof(values) / sizeof(values[0]), 2);
+        Sim_Bus_AddSensor(&bus, &sensors[i]);
+    }
+    SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010);
+}
+
+static double Seconds(const uint64_t ns) {
+    return (double) ns / 1e9;
+}
+
+/*
+ * a! to one sensor, each with a break or chained within the wake window.
+ * Returns commands/s, ok receives the ones answered.
+ */
+static double Acknowledges(const uint8_t chained, uint32_t *ok) {
+    char cmd[] = "0!";
+    char response[3];
+    SDI12_Session_TypeDef session;
+    SDI12_Session_Begin(&session, &sdi12, '0');
+
+    *ok = 0;
+    uint64_t start = Sim_Now();
+    for (uint32_t i = 0; i < COMMANDS; i++) {
+        SDI12_Transaction_TypeDef transaction = { 0 };
+        transaction.Cmd = cmd;
+        transaction.CmdLen = 2;
+        transaction.Response = response;
+        transaction.ResponseLen = sizeof(response);
+        HAL_StatusTypeDef res = chained ? SDI12_Session_Transfer(&session, &transaction) : SDI12_Transfer(&sdi12, &transaction);
+        *ok += (res == HAL_OK);
+    }
+    return COMMANDS / Seconds(Sim_Now() - start);
+}
+
+static void Bench_Commands(void) {
+    printf("a! commands/s (simulated)\n");
+    uint32_t ok;
+    Setup(1);
+    printf("  break each          %6.2f\n", Acknowledges(0, &ok));
+    Setup(1);
+    printf("  chained             %6.2f\n", Acknowledges(1, &ok));
+
+    printf("\nResponse characters dropped, chained a!\n");
+    printf("  drop   commands/s   answered   attempts/command\n");
+    const uint16_t drops[] = { 0, 10, 50 };
+    for (uint8_t i = 0; i < sizeof(drops) / sizeof(drops[0]); i++) {
+        Setup(1);
+        sensors[0].DropPermille = drops[i];
+        double rate = Acknowledges(1, &ok);
+        const SDI12_AddressStats_TypeDef *stats = SDI12_GetAddressStats(&sdi12, '0');
+        printf("  %3.1f%%  %9.2f   %7.1f%%   %6.2f\n", drops[i] / 10.0, rate, 100.0 * ok / COMMANDS,
+                (double) (stats->Transactions + stats->Retries) / stats->Transactions);
+    }
+}
+
+/*
+ * From the end of the command on the wire to the receiver armed, over
+ * COMMANDS a! with either transport. The wire gap is simulated, the
+ * turnaround code in SDI12_UART_TxCpltCallback(...) is timed on the host
+ * CPU through the driver's own DWT counter.
+ */
+static void Bench_Turnaround(void) {
+    printf("\nEnd of command to receiver armed, a!\n");
+    printf("  transport       wire (sim)   CPU mean (host)   CPU max (host)\n");
+
+    const struct {
+        const char *Name;
+        SDI12_Transport_TypeDef Transport;
+    } transports[] = {
+        { "TX/RX swap", SDI12_TRANSPORT_SWAP },
+        { "half-duplex", SDI12_TRANSPORT_HALF_DUPLEX },
+    };
+    for (uint8_t t = 0; t < sizeof(transports) / sizeof(transports[0]); t++) {
+        Setup(1);
+        SDI12_SetTransport(&sdi12, transports[t].Transport, GPIOA, 0x0002);
+
+        uint64_t wire = 0, cpu = 0;
+        uint32_t ok = 0;
+        for (uint32_t i = 0; i < COMMANDS; i++) {
+            ok += (SDI12_AckActive(&sdi12, '0') == HAL_OK);
+            wire += bus.RxArmed - bus.CmdEnd;
+            cpu += sdi12.Turnaround;
+        }
+        printf("  %-13s %9.3f ms   %12.0f ns   %11lu ns%s\n", transports[t].Name, (double) wire / COMMANDS / SIM_NS_PER_MS,
+                (double) cpu / COMMANDS, (unsigned long) sdi12.MaxTurnaround, (ok == COMMANDS) ? "" : " (failed)");
+    }
+}
+
+/*
+ * a! the way SDI12_DevicesOnBus(...) probed before the transaction engine:
+ * break and marking timed with HAL_Delay, blocking transmit, up to 110 ms
+ * for each character of the response, then a 200 ms pause.
+ */
+static uint8_t BlockingProbe(const char addr) {
+    GPIO_InitTypeDef init = { 0 };
+    init.Pin = 0x0010;
+    init.Mode = GPIO_MODE_OUTPUT_PP;
+    HAL_GPIO_Init(GPIOC, &init);
+    HAL_GPIO_WritePin(GPIOC, 0x0010, GPIO_PIN_SET);
+    HAL_Delay(12);
+    HAL_GPIO_WritePin(GPIOC, 0x0010, GPIO_PIN_RESET);
+    init.Mode = GPIO_MODE_AF_PP;
+    HAL_GPIO_Init(GPIOC, &init);
+    HAL_Delay(9);
+
+    char cmd[] = { addr, '!' };
+    MODIFY_REG(USART3->CR2, USART_CR2_SWAP, UART_ADVFEATURE_SWAP_DISABLE);
+    HAL_UART_Transmit_IT(&huart, (uint8_t*) cmd, 2);
+    while (huart.gState != HAL_UART_STATE_READY) {
+        Sim_Step();
+    }
+
+    MODIFY_REG(USART3->CR2, USART_CR2_SWAP, UART_ADVFEATURE_SWAP_ENABLE);
+    uint8_t response[3];
+    uint8_t count = 0;
+    while (count < sizeof(response)) {
+        HAL_UART_Receive_IT(&huart, &response[count], 1);
+        uint32_t start = HAL_GetTick();
+        while (huart.RxState != HAL_UART_STATE_READY && HAL_GetTick() - start < 110) {
+            Sim_Step();
+        }
+        if (huart.RxState != HAL_UART_STATE_READY) {
+            HAL_UART_AbortReceive(&huart);
+            break;
+        }
+        if (response[count++] == 0x0a) {
+            break;
+        }
+    }
+
+    HAL_Delay(200);
+    return count == 3 && response[0] == addr;
+}
+
+/*
+ * Where the time of a command goes before its first character is on the
+ * wire, from the submit at start.
+ */
+static void OverheadRow(const char *name, const uint64_t start) {
+    printf("  %-30s %7.2f   %7.2f   %7.2f   %7.2f   %7.2f\n", name,
+            (double) (bus.BreakEnd - bus.BreakNs - start) / SIM_NS_PER_MS, (double) bus.BreakNs / SIM_NS_PER_MS,
+            (double) (bus.CmdStart - bus.BreakEnd) / SIM_NS_PER_MS, (double) (bus.CmdStart - start) / SIM_NS_PER_MS,
+            (double) (bus.CmdEnd - bus.CmdStart) / SIM_NS_PER_MS);
+}
+
+static void Bench_Overhead(void) {
+    printf("\nPer command overhead, a! (simulated, ms)\n");
+    printf("  path                           to break     break   marking  overhead   command\n");
+
+    Setup(1);
+    uint64_t start = Sim_Now();
+    SDI12_AckActive(&sdi12, '0');
+    OverheadRow("timer break, UART marking", start);
+
+    Setup(1);
+    start = Sim_Now();
+    BlockingProbe('0');
+    OverheadRow("GPIO init, HAL_Delay(12 + 9)", start);
+}
+
+/*
+ * Full scan time of the blocking probes over num_addresses and of
+ * SDI12_DiscoverDevices(...), sensors at '0', '5', 'a' and 'Z'.
+ */
+static void Bench_Discover(void) {
+    const char present[] = { '0', '5', 'a', 'Z' };
+    printf("\nBus scan, sensors at 0, 5, a and Z (simulated)\n");
+    printf("  method                               addresses   found   scan time\n");
+
+    const uint8_t ranges[] = { 10, SDI12_NUM_ADDRESSES };
+    for (uint8_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        Setup(sizeof(present));
+        for (uint8_t i = 0; i < sizeof(present); i++) {
+            sensors[i].Address = present[i];
+        }
+        uint8_t found = 0;
+        uint64_t start = Sim_Now();
+        for (uint8_t i = 0; i < ranges[r]; i++) {
+            found += BlockingProbe(SDI12_AddressFromIndex(i));
+        }
+        printf("  break, 110 ms timeout, 200 ms pause  %9u   %5u   %7.2f s\n", ranges[r], found, Seconds(Sim_Now() - start));
+    }
+
+    Setup(sizeof(present));
+    for (uint8_t i = 0; i < sizeof(present); i++) {
+        sensors[i].Address = present[i];
+    }
+    SDI12_AddressMap_TypeDef map;
+    uint32_t scan_time = 0;
+    SDI12_DiscoverDevices(&sdi12, &map, &scan_time);
+    printf("  SDI12_DiscoverDevices                %9u   %5u   %7.2f s\n", SDI12_NUM_ADDRESSES,
+            (unsigned) __builtin_popcountll(map), scan_time / 1000.0);
+}
+
+/*
+ * aM!, service request and data of every sensor in turn.
+ */
+static HAL_StatusTypeDef SequentialCycle(const uint8_t num_sensors) {
+    HAL_StatusTypeDef result = HAL_OK;
+    for (uint8_t i = 0; i < num_sensors; i++) {
+        char addr = (char) ('0' + i);
+        SDI12_Measure_TypeDef info = { 0 };
+        SDI12_Value_TypeDef parsed[SDI12_MAX_VALUES];
+        SDI12_Parser_TypeDef parser;
+        SDI12_Parser_Init(&parser, parsed, SDI12_MAX_VALUES);
+
+        HAL_StatusTypeDef res = SDI12_StartMeasurement(&sdi12, addr, &info);
+        if (res == HAL_OK) {
+            res = SDI12_WaitForServiceRequest(&sdi12, addr, &info);
+        }
+        if (res == HAL_OK) {
+            res = SDI12_ReadValues(&sdi12, addr, &info, &parser);
+        }
+        if (res != HAL_OK) {
+            result = res;
+        }
+    }
+    return result;
+}
+
+static void Bench_Cycle(void) {
+    static SDI12_Value_TypeDef pool[SDI12_SCHEDULER_MAX_SENSORS * 9];
+    printf("\nBus cycle, ttt 1 s and 9 values per sensor (simulated)\n");
+    printf("  sensors   aM! in turn   scheduler (aC!)\n");
+    const uint8_t counts[] = { 1, 2, 5, 10 };
+    for (uint8_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        uint8_t n = counts[i];
+
+        Setup(n);
+        uint64_t start = Sim_Now();
+        HAL_StatusTypeDef sequential = SequentialCycle(n);
+        double sequential_s = Seconds(Sim_Now() - start);
+
+        Setup(n);
+        SDI12_Scheduler_TypeDef scheduler;
+        SDI12_Scheduler_Init(&scheduler, &sdi12, NULL, pool, n * 9);
+        for (uint8_t s = 0; s < n; s++) {
+            SDI12_Scheduler_Add(&scheduler, (char) ('0' + s));
+        }
+        start = Sim_Now();
+        HAL_StatusTypeDef concurrent = SDI12_Scheduler_RunCycle(&scheduler);
+        double concurrent_s = Seconds(Sim_Now() - start);
+
+        printf("  %7u   %9.3f s%s   %9.3f s%s\n", n, sequential_s, sequential == HAL_OK ? "" : " (failed)",
+                concurrent_s, concurrent == HAL_OK ? "" : " (failed)");
+    }
+}
+
+/*
+ * One sensor, 9 values, read for STREAM_SECONDS with aRn! (or aRCn!)
+ * every period ms through SDI12_Stream_Poll(...).
+ */
+static void StreamRow(const char *name, const uint8_t use_crc, const uint32_t period) {
+    static SDI12_Stream_TypeDef stream;
+    Setup(1);
+    sensors[0].Continuous = 1;
+    sensors[0].Crc = 1;
+    SDI12_Stream_Init(&stream, &sdi12, period);
+    SDI12_Stream_AddChannel(&stream, '0', 0, use_crc);
+
+    SDI12_Stream_Start(&stream);
+    uint64_t end = Sim_Now() + (uint64_t) STREAM_SECONDS * 1000 * SIM_NS_PER_MS;
+    SDI12_Sample_TypeDef sample;
+    while (Sim_Now() < end) {
+        if (SDI12_Stream_Poll(&stream) == 0) {
+            Sim_Step();
+        }
+        while (SDI12_Stream_Read(&stream, &sample)) {
+        }
+    }
+
+    SDI12_StreamStats_TypeDef stats;
+    SDI12_Stream_GetStats(&stream, &stats);
+    printf("  %-22s %9.2f   %6lu ms   %6lu   %6lu\n", name, stats.Rate, (unsigned long) stats.Jitter, (unsigned long) stats.Errors,
+            (unsigned long) stats.Missed);
+}
+
+static void Bench_Stream(void) {
+    printf("\nOne sensor, 9 values, %u s (simulated)\n", STREAM_SECONDS);
+    printf("  method                 samples/s     jitter   errors   missed\n");
+
+    // aM!, service request and aD0! back to back, ttt 1 s
+    Setup(1);
+    uint32_t samples = 0;
+    uint32_t min_interval = UINT32_MAX, max_interval = 0;
+    uint32_t last = HAL_GetTick();
+    uint64_t start = Sim_Now();
+    while (Sim_Now() - start < (uint64_t) STREAM_SECONDS * 1000 * SIM_NS_PER_MS) {
+        samples += (SequentialCycle(1) == HAL_OK);
+        uint32_t interval = HAL_GetTick() - last;
+        last += interval;
+        min_interval = (interval < min_interval) ? interval : min_interval;
+        max_interval = (interval > max_interval) ? interval : max_interval;
+    }
+    printf("  %-22s %9.2f   %6lu ms\n", "aM! aD0!", samples / Seconds(Sim_Now() - start),
+            (unsigned long) (max_interval - min_interval));
+
+    StreamRow("aR0! back to back", 0, 0);
+    StreamRow("aRC0! back to back", 1, 0);
+    StreamRow("aR0! every 250 ms", 0, 250);
+    StreamRow("aR0! every 1 s", 0, 1000);
+}
+
+static double Elapsed(const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start->tv_sec) + (double) (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * What SDI12_SendData(...) did with each aDn! line before the streaming
+ * parser: count the signs and copy the values into the caller's buffer.
+ */
+static uint16_t CopyLine(const char response[], char *data, uint16_t index, uint8_t *n_values) {
+    uint8_t res_index = 0;
+    for (uint8_t x = 1; x < MAX_RESPONSE_SIZE; x++) {
+        if (response[x] == '+' || response[x] == '-') {
+            (*n_values)++;
+        }
+        if (response[x] == '\0') {
+            break;
+        }
+        res_index++;
+    }
+    if (res_index > 0) {
+        memcpy(&data[index], &response[1], res_index);
+        index += res_index;
+        data[index] = 0;
+    }
+    return index;
+}
+
+/*
+ * The consumer then parsed the copied text again.
+ */
+static uint16_t ParseCopied(const char *data, float values[], const uint16_t capacity) {
+    uint16_t count = 0;
+    const char *p = data;
+    while (*p != 0 && count < capacity) {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        values[count++] = (float) value;
+        p = end;
+    }
+    return count;
+}
+
+static void Bench_Parser(void) {
+    // aD0!/aD1! responses with the CR/LF removed, as the driver hands them over
+    const char *lines[] = { "0+3.14-12.50+0.01+1234.50-0.25", "0+20.00+7.00+0.50-3.00" };
+    const uint8_t num_lines = sizeof(lines) / sizeof(lines[0]);
+    const uint8_t num_values = 9;
+    char responses[2][MAX_RESPONSE_SIZE + 1] = { 0 };
+    for (uint8_t l = 0; l < num_lines; l++) {
+        strcpy(responses[l], lines[l]);
+    }
+    volatile float sink = 0;
+
+    SDI12_Value_TypeDef parsed[SDI12_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < PARSE_ROUNDS; r++) {
+        SDI12_Parser_Init(&parser, parsed, SDI12_MAX_VALUES);
+        for (uint8_t l = 0; l < num_lines; l++) {
+            for (const char *p = responses[l]; *p != 0; p++) {
+                SDI12_Parser_Feed(&parser, *p);
+            }
+            SDI12_Parser_Finish(&parser);
+        }
+        for (uint16_t i = 0; i < parser.Count; i++) {
+            sink += SDI12_ValueToFloat(&parsed[i]);
+        }
+    }
+    double streaming = Elapsed(&start);
+
+    static char data[800];
+    float values[SDI12_MAX_VALUES];
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t r = 0; r < PARSE_ROUNDS; r++) {
+        uint16_t index = 0;
+        uint8_t n_values = 0;
+        for (uint8_t l = 0; l < num_lines; l++) {
+            index = CopyLine(responses[l], data, index, &n_values);
+        }
+        uint16_t count = ParseCopied(data, values, SDI12_MAX_VALUES);
+        for (uint16_t i = 0; i < count; i++) {
+            sink += values[i];
+        }
+    }
+    double copied = Elapsed(&start);
+    (void) sink;
+
+    printf("\nData lines to %u floats (host CPU)\n", num_values);
+    printf("  streaming parser    %6.1f ns/value   %3u bytes RAM\n", streaming * 1e9 / ((double) PARSE_ROUNDS * num_values),
+            (unsigned) (sizeof(SDI12_Parser_TypeDef) + num_values * sizeof(SDI12_Value_TypeDef)));
+    printf("  copy then strtod    %6.1f ns/value   %3u bytes RAM\n", copied * 1e9 / ((double) PARSE_ROUNDS * num_values),
+            (unsigned) (sizeof(data) + num_values * sizeof(float)));
+}
+
+int main(void) {
+    Bench_Commands();
+    Bench_Overhead();
+    Bench_Turnaround();
+    Bench_Discover();
+    Bench_Cycle();
+    Bench_Stream();
+    Bench_Parser();
+    return 0;
+}
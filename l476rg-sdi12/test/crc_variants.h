@@ -0,0 +1,34 @@
+/*
+ ******************************************************************************
+ * @file           : crc_variants.h
+ * @brief          : The three CRC-16 kernels of sdi12_crc.c side by side.
+ ******************************************************************************
+ * CMakeLists.txt builds sdi12_crc.c once per kernel with SDI12_CRC16
+ * renamed, e.g. to SDI12_CRC16_Bitwise.
+ ******************************************************************************
+ */
+
+#ifndef CRC_VARIANTS_
+#define CRC_VARIANTS_
+
+#include <stdint.h>
+
+uint16_t SDI12_CRC16_Bitwise(const char *data, const uint16_t len);
+uint16_t SDI12_CRC16_Nibble(const char *data, const uint16_t len);
+uint16_t SDI12_CRC16_Byte(const char *data, const uint16_t len);
+
+typedef struct {
+    const char *Name;
+    uint16_t (*CRC16)(const char *data, const uint16_t len);
+    uint16_t TableSize; // Bytes of flash taken by the lookup table
+} CRC_Variant_TypeDef;
+
+#define CRC_NUM_VARIANTS 3
+
+static const CRC_Variant_TypeDef crc_variants[CRC_NUM_VARIANTS] = {
+    { "bitwise", SDI12_CRC16_Bitwise, 0 },
+    { "nibble table", SDI12_CRC16_Nibble, 16 * sizeof(uint16_t) },
+    { "byte table", SDI12_CRC16_Byte, 256 * sizeof(uint16_t) }
+};
+
+#endif // CRC_VARIANTS_
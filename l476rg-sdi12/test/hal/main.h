@@ -0,0 +1,270 @@
+/*
+ ******************************************************************************
+ * @file           : main.h
+ * @brief          : Host stand-in for the STM32 HAL, just enough of it for
+ *            the SDI-12 driver (app/) to build and run on a PC.
+ ******************************************************************************
+ * Registers are plain structs the driver reads and writes as it would on the
+ * target. The HAL functions it calls, and the timer enable/counter macros,
+ * are implemented by the bus simulator (sim/sdi12_sim.c) in simulated time.
+ * Only the fields, bits and calls the driver uses are here.
+ ******************************************************************************
+ */
+
+#ifndef __MAIN_H
+#define __MAIN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+    HAL_OK = 0x00,
+    HAL_ERROR = 0x01,
+    HAL_BUSY = 0x02,
+    HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define WRITE_REG(REG, VAL) ((REG) = (VAL))
+#define READ_REG(REG) ((REG))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK) WRITE_REG((REG), (((READ_REG(REG)) & (~(CLEARMASK))) | (SETMASK)))
+#define POSITION_VAL(VAL) ((uint32_t) __builtin_ctz(VAL))
+
+/*
+ * Interrupts are delivered by the simulator between driver calls, there is
+ * nothing to mask. __WFI() runs the simulation up to the next event.
+ */
+#define __get_PRIMASK() 0U
+#define __set_PRIMASK(primask) ((void) (primask))
+#define __disable_irq()
+#define __enable_irq()
+#define __WFI() Sim_Step()
+void Sim_Step(void);
+
+/* GPIO */
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef enum {
+    GPIO_PIN_RESET = 0,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct {
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_MODER_MODE0 0x3U
+#define GPIO_MODE_INPUT 0x0U
+#define GPIO_MODE_OUTPUT_PP 0x1U
+#define GPIO_MODE_AF_PP 0x2U
+#define GPIO_NOPULL 0x0U
+#define GPIO_SPEED_FREQ_LOW 0x0U
+#define GPIO_AF7_USART1 0x07U
+#define GPIO_AF8_UART4 0x08U
+#define GPIO_PIN_9 0x0200U
+
+extern GPIO_TypeDef Sim_GPIO[3];
+#define GPIOA (&Sim_GPIO[0])
+#define GPIOB (&Sim_GPIO[1])
+#define GPIOC (&Sim_GPIO[2])
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+
+/* UART */
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t CR3;
+    volatile uint32_t ISR;
+    volatile uint32_t ICR;
+} USART_TypeDef;
+
+#define USART_CR1_UE (1U << 0)
+#define USART_CR1_RE (1U << 2)
+#define USART_CR1_TE (1U << 3)
+#define USART_CR1_PEIE (1U << 8)
+#define USART_CR1_PS (1U << 9)
+#define USART_CR1_PCE (1U << 10)
+#define USART_CR1_CMIE (1U << 14)
+#define USART_CR2_SWAP (1U << 15)
+#define USART_CR2_ADD_Pos 24U
+#define USART_CR2_ADD (0xFFU << USART_CR2_ADD_Pos)
+#define USART_CR3_HDSEL (1U << 3)
+#define USART_ISR_BUSY (1U << 16)
+#define USART_ISR_CMF (1U << 17)
+
+extern USART_TypeDef Sim_USART[6];
+#define USART1 (&Sim_USART[0])
+#define USART2 (&Sim_USART[1])
+#define USART3 (&Sim_USART[2])
+#define UART4 (&Sim_USART[3])
+#define UART5 (&Sim_USART[4])
+#define LPUART1 (&Sim_USART[5])
+
+#define UART_WORDLENGTH_8B 0x0U
+#define UART_STOPBITS_1 0x0U
+#define UART_PARITY_NONE 0x0U
+#define UART_PARITY_EVEN USART_CR1_PCE
+#define UART_MODE_TX_RX (USART_CR1_TE | USART_CR1_RE)
+#define UART_ADVFEATURE_SWAP_INIT 0x8U
+#define UART_ADVFEATURE_SWAP_DISABLE 0x0U
+#define UART_ADVFEATURE_SWAP_ENABLE USART_CR2_SWAP
+#define UART_IT_CM USART_CR1_CMIE
+#define UART_FLAG_CMF USART_ISR_CMF
+#define UART_CLEAR_CMF USART_ISR_CMF
+#define HAL_UART_ERROR_NONE 0x0U
+#define HAL_UART_ERROR_PE 0x1U
+#define HAL_UART_ERROR_FE 0x4U
+
+typedef enum {
+    HAL_UART_STATE_RESET = 0x00,
+    HAL_UART_STATE_READY = 0x20,
+    HAL_UART_STATE_BUSY_TX = 0x21,
+    HAL_UART_STATE_BUSY_RX = 0x22
+} HAL_UART_StateTypeDef;
+
+typedef struct {
+    uint32_t BaudRate;
+    uint32_t WordLength;
+    uint32_t StopBits;
+    uint32_t Parity;
+    uint32_t Mode;
+} UART_InitTypeDef;
+
+typedef struct {
+    uint32_t AdvFeatureInit;
+    uint32_t Swap;
+} UART_AdvFeatureInitTypeDef;
+
+/*
+ * A DMA channel is only its transfer counter here.
+ */
+typedef struct {
+    volatile uint32_t Counter;
+} DMA_HandleTypeDef;
+
+typedef struct {
+    USART_TypeDef *Instance;
+    UART_InitTypeDef Init;
+    UART_AdvFeatureInitTypeDef AdvancedInit;
+    const uint8_t *pTxBuffPtr;
+    uint16_t TxXferSize;
+    volatile uint16_t TxXferCount;
+    uint8_t *pRxBuffPtr;
+    uint16_t RxXferSize;
+    volatile uint16_t RxXferCount;
+    uint16_t Mask;
+    DMA_HandleTypeDef *hdmatx;
+    DMA_HandleTypeDef *hdmarx;
+    volatile HAL_UART_StateTypeDef gState;
+    volatile HAL_UART_StateTypeDef RxState;
+    volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define __HAL_UART_ENABLE(h) SET_BIT((h)->Instance->CR1, USART_CR1_UE)
+#define __HAL_UART_DISABLE(h) CLEAR_BIT((h)->Instance->CR1, USART_CR1_UE)
+#define __HAL_UART_ENABLE_IT(h, it) SET_BIT((h)->Instance->CR1, (it))
+#define __HAL_UART_DISABLE_IT(h, it) CLEAR_BIT((h)->Instance->CR1, (it))
+#define __HAL_UART_GET_FLAG(h, flag) (((h)->Instance->ISR & (flag)) == (flag))
+#define __HAL_UART_CLEAR_FLAG(h, flag) CLEAR_BIT((h)->Instance->ISR, (flag))
+#define __HAL_DMA_GET_COUNTER(h) ((h)->Counter)
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_HalfDuplex_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart);
+// Host link of sdi12_bridge.c, not simulated, test_bridge.c fakes it
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart);
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart);
+
+/* Timer */
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t DIER;
+    volatile uint32_t SR;
+    volatile uint32_t CNT;
+    volatile uint32_t ARR;
+} TIM_TypeDef;
+
+#define TIM_CR1_CEN (1U << 0)
+#define TIM_CR1_OPM (1U << 3)
+#define TIM_IT_UPDATE (1U << 0)
+#define TIM_FLAG_UPDATE (1U << 0)
+
+extern TIM_TypeDef Sim_TIM[2];
+#define TIM6 (&Sim_TIM[0])
+#define TIM7 (&Sim_TIM[1])
+
+typedef struct {
+    TIM_TypeDef *Instance;
+} TIM_HandleTypeDef;
+
+/*
+ * Starting and stopping the counter goes through the simulator so it knows
+ * when the timer runs out. The counter counts simulated microseconds.
+ */
+#define __HAL_TIM_ENABLE(h) Sim_TIM_Enable(h)
+#define __HAL_TIM_DISABLE(h) Sim_TIM_Disable(h)
+#define __HAL_TIM_GET_COUNTER(h) Sim_TIM_GetCounter(h)
+#define __HAL_TIM_SET_COUNTER(h, count) Sim_TIM_SetCounter((h), (count))
+#define __HAL_TIM_SET_AUTORELOAD(h, arr) ((h)->Instance->ARR = (arr))
+#define __HAL_TIM_ENABLE_IT(h, it) SET_BIT((h)->Instance->DIER, (it))
+#define __HAL_TIM_DISABLE_IT(h, it) CLEAR_BIT((h)->Instance->DIER, (it))
+#define __HAL_TIM_CLEAR_FLAG(h, flag) CLEAR_BIT((h)->Instance->SR, (flag))
+
+void Sim_TIM_Enable(TIM_HandleTypeDef *htim);
+void Sim_TIM_Disable(TIM_HandleTypeDef *htim);
+uint32_t Sim_TIM_GetCounter(TIM_HandleTypeDef *htim);
+void Sim_TIM_SetCounter(TIM_HandleTypeDef *htim, uint32_t count);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+
+/*
+ * Cycle counter, so the driver's own cycle measurements (turnaround,
+ * trace) run on the host too. Counts host CPU nanoseconds, or simulated
+ * time at SystemCoreClock after Sim_SimulatedCycles(1).
+ */
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1U << 0)
+
+extern CoreDebug_Type Sim_CoreDebug;
+#define CoreDebug (&Sim_CoreDebug)
+#define DWT Sim_DWT()
+DWT_Type* Sim_DWT(void);
+
+/* System */
+
+extern uint32_t SystemCoreClock;
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+
+#endif /* __MAIN_H */
@@ -0,0 +1,1066 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_sim.c
+ * @brief          : Simulated SDI-12 bus for running the driver on a PC.
+ ******************************************************************************
+ * Events (characters starting and ending on the wire, timers running out,
+ * service requests falling due) are processed in time order. Sim_Step()
+ * moves to the next one, or to the next 1 ms tick if that comes first so
+ * code polling HAL_GetTick() keeps going.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sdi12_sim.h"
+#include "sdi12.h"
+#include "sdi12_sensor.h"
+
+GPIO_TypeDef Sim_GPIO[3];
+USART_TypeDef Sim_USART[6];
+TIM_TypeDef Sim_TIM[2];
+CoreDebug_Type Sim_CoreDebug;
+static DWT_Type dwt;
+static uint8_t simulated_cycles = 0;
+uint32_t SystemCoreClock = 80000000;
+
+#define SIM_NUM_TIMERS (sizeof(Sim_TIM) / sizeof(Sim_TIM[0]))
+
+static uint64_t now;
+static uint32_t rng;
+static Sim_Bus_TypeDef *buses[SIM_MAX_BUSES];
+static uint8_t num_buses = 0;
+static TIM_HandleTypeDef *timers[SIM_NUM_TIMERS]; // Handle that last started each timer
+static uint64_t timer_start[SIM_NUM_TIMERS];
+
+static void Sim_Advance(const uint64_t limit);
+static uint8_t Sim_ProcessBus(Sim_Bus_TypeDef *bus);
+static uint8_t Sim_ProcessTimers(void);
+static uint64_t Sim_NextEvent(const Sim_Bus_TypeDef *bus);
+static Sim_Bus_TypeDef* Sim_FindBus(const UART_HandleTypeDef *huart);
+static void Sim_EndBreak(Sim_Bus_TypeDef *bus);
+static void Sim_TxChar(Sim_Bus_TypeDef *bus);
+static void Sim_Hear(Sim_Bus_TypeDef *bus, const uint8_t wire);
+static void Sim_LineCharStart(Sim_Bus_TypeDef *bus);
+static void Sim_LineCharEnd(Sim_Bus_TypeDef *bus);
+static void Sim_Receive(Sim_Bus_TypeDef *bus, const uint8_t wire);
+static void Sim_DeviceReceive(Sim_Bus_TypeDef *bus, const uint8_t wire, const uint8_t framing_error);
+static void Sim_Command(Sim_Bus_TypeDef *bus);
+static void Sim_Sensor_Command(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, const char *body, const uint8_t len);
+static uint16_t Sim_Sensor_DataLine(Sim_Sensor_TypeDef *sensor, const uint16_t index, const uint8_t max, char *out);
+static uint16_t Sim_Sensor_Packet(Sim_Sensor_TypeDef *sensor, const uint16_t index, uint8_t *out);
+static void Sim_Send(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, const uint8_t *data, const uint16_t len, const uint8_t binary, const uint64_t delay);
+static void Sim_SendText(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, char *text, uint16_t len, const uint8_t crc);
+static void Sim_UART_IRQHandler(UART_HandleTypeDef *huart);
+
+/*
+ * Start over at t = 1 ms with no buses. seed drives the dropped,
+ * corrupted and ignored characters and commands.
+ */
+void Sim_Reset(const uint32_t seed) {
+    memset(Sim_GPIO, 0, sizeof(Sim_GPIO));
+    memset(Sim_USART, 0, sizeof(Sim_USART));
+    memset(Sim_TIM, 0, sizeof(Sim_TIM));
+    memset(timers, 0, sizeof(timers));
+    num_buses = 0;
+    simulated_cycles = 0;
+    now = SIM_NS_PER_MS;
+    rng = (seed != 0) ? seed : 1;
+}
+
+/*
+ * Wire up huart, htim and the data pin the way CubeMX and main.c do
+ * (USART 1200 baud 7E1, RX DMA if dma is set) and put them on a new bus.
+ * SDI12_Init(...) is up to the caller.
+ */
+void Sim_Bus_Init(Sim_Bus_TypeDef *bus, UART_HandleTypeDef *huart, USART_TypeDef *instance, const uint8_t dma,
+        TIM_HandleTypeDef *htim, TIM_TypeDef *tim, GPIO_TypeDef *port, const uint16_t pin) {
+    memset(bus, 0, sizeof(Sim_Bus_TypeDef));
+    bus->Huart = huart;
+    bus->Htim = htim;
+    bus->Port = port;
+    bus->Pin = pin;
+
+    memset(huart, 0, sizeof(UART_HandleTypeDef));
+    huart->Instance = instance;
+    huart->Init.BaudRate = 1200;
+    huart->Init.WordLength = UART_WORDLENGTH_8B;
+    huart->Init.StopBits = UART_STOPBITS_1;
+    huart->Init.Parity = UART_PARITY_EVEN;
+    huart->Init.Mode = UART_MODE_TX_RX;
+    huart->AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_SWAP_INIT;
+    huart->AdvancedInit.Swap = UART_ADVFEATURE_SWAP_DISABLE;
+    huart->hdmarx = dma ? &bus->Hdmarx : NULL;
+    HAL_UART_Init(huart);
+
+    memset(htim, 0, sizeof(TIM_HandleTypeDef));
+    htim->Instance = tim;
+
+    if (num_buses < SIM_MAX_BUSES) {
+        buses[num_buses++] = bus;
+    }
+}
+
+void Sim_Bus_AddSensor(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor) {
+    if (bus->NumSensors < SIM_MAX_SENSORS) {
+        bus->Sensors[bus->NumSensors++] = sensor;
+    }
+}
+
+/*
+ * Put huart on the wire of bus as a device, set up like the recorder's
+ * UART (1200 baud 7E1, interrupts only). SDI12_Sensor_Init(...) is up to
+ * the caller.
+ */
+void Sim_Bus_AddDevice(Sim_Bus_TypeDef *bus, UART_HandleTypeDef *huart, USART_TypeDef *instance) {
+    memset(huart, 0, sizeof(UART_HandleTypeDef));
+    huart->Instance = instance;
+    huart->Init = bus->Huart->Init;
+    huart->AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_SWAP_INIT;
+    huart->AdvancedInit.Swap = UART_ADVFEATURE_SWAP_DISABLE;
+    HAL_UART_Init(huart);
+    bus->Device = huart;
+}
+
+/*
+ * A v1.4 sensor at addr with a 1 s measurement of no values, answering
+ * 9 ms after each command and never losing a character.
+ */
+void Sim_Sensor_Init(Sim_Sensor_TypeDef *sensor, const char addr) {
+    memset(sensor, 0, sizeof(Sim_Sensor_TypeDef));
+    sensor->Address = addr;
+    sensor->Ident = "14SIMSDI12SENSOR100";
+    sensor->Time = 1;
+    sensor->Decimals = 2;
+    sensor->BinaryType = SDI12_BINARY_INT16;
+    sensor->PacketValues = 50;
+    sensor->ResponseDelayUs = 9000;
+}
+
+void Sim_Sensor_SetValues(Sim_Sensor_TypeDef *sensor, const float values[], const uint16_t count, const uint8_t decimals) {
+    sensor->NumValues = (count < SIM_MAX_VALUES) ? count : SIM_MAX_VALUES;
+    memcpy(sensor->Values, values, sensor->NumValues * sizeof(float));
+    sensor->Decimals = decimals;
+}
+
+uint64_t Sim_Now(void) {
+    return now;
+}
+
+/*
+ * Move to the next event or 1 ms tick, whichever comes first, and
+ * process everything due by then.
+ */
+void Sim_Step(void) {
+    Sim_Advance(UINT64_MAX);
+}
+
+/*
+ * Run the simulation for ns.
+ */
+void Sim_RunFor(const uint64_t ns) {
+    uint64_t end = now + ns;
+    while (now < end) {
+        Sim_Advance(end);
+    }
+}
+
+/*
+ * Run until nothing is on the wire and no timer is running, e.g. for a
+ * transaction started with SDI12_Submit(...) to finish. Gives up after a
+ * simulated minute.
+ */
+void Sim_RunUntilIdle(void) {
+    uint64_t end = now + 60000 * SIM_NS_PER_MS;
+    while (now < end) {
+        uint8_t busy = 0;
+        for (uint8_t i = 0; i < num_buses; i++) {
+            const Sim_Bus_TypeDef *bus = buses[i];
+            busy |= bus->TxEnd != 0 || bus->LinePos < bus->LineLen || bus->DeviceTx;
+        }
+        for (uint8_t i = 0; i < SIM_NUM_TIMERS; i++) {
+            busy |= READ_BIT(Sim_TIM[i].CR1, TIM_CR1_CEN) != 0;
+        }
+        if (!busy) {
+            return;
+        }
+        Sim_Step();
+    }
+}
+
+static void Sim_Advance(const uint64_t limit) {
+    uint64_t next = (now / SIM_NS_PER_MS + 1) * SIM_NS_PER_MS;
+    for (uint8_t i = 0; i < num_buses; i++) {
+        uint64_t t = Sim_NextEvent(buses[i]);
+        if (t < next) {
+            next = t;
+        }
+    }
+    for (uint8_t i = 0; i < SIM_NUM_TIMERS; i++) {
+        const TIM_TypeDef *tim = &Sim_TIM[i];
+        if (READ_BIT(tim->CR1, TIM_CR1_CEN)) {
+            uint64_t t = timer_start[i] + (tim->ARR + 1) * SIM_NS_PER_US;
+            if (t < next) {
+                next = t;
+            }
+        }
+    }
+    if (next > limit) {
+        next = limit;
+    }
+    if (next > now) {
+        now = next;
+    }
+
+    // One event at a time, callbacks may schedule more at the same instant
+    uint8_t progressed;
+    do {
+        progressed = 0;
+        for (uint8_t i = 0; i < num_buses && !progressed; i++) {
+            progressed = Sim_ProcessBus(buses[i]);
+        }
+        if (!progressed) {
+            progressed = Sim_ProcessTimers();
+        }
+    } while (progressed);
+}
+
+static uint64_t Sim_NextEvent(const Sim_Bus_TypeDef *bus) {
+    uint64_t next = UINT64_MAX;
+    if (bus->TxEnd != 0) {
+        next = bus->TxEnd;
+    }
+    if (bus->LineEnd != 0) {
+        next = (bus->LineEnd < next) ? bus->LineEnd : next;
+    } else if (bus->LinePos < bus->LineLen) {
+        next = (bus->LineStart < next) ? bus->LineStart : next;
+    }
+    for (uint8_t i = 0; i < bus->NumSensors; i++) {
+        const Sim_Sensor_TypeDef *sensor = bus->Sensors[i];
+        // Service requests held back by a busy line go out on a later tick
+        if (sensor->Measuring && sensor->ReadyAt > now && sensor->ReadyAt < next) {
+            next = sensor->ReadyAt;
+        }
+    }
+    return next;
+}
+
+static uint8_t Sim_ProcessBus(Sim_Bus_TypeDef *bus) {
+    if (bus->TxEnd != 0 && bus->TxEnd <= now) {
+        Sim_TxChar(bus);
+        return 1;
+    }
+    if (bus->LineEnd != 0 && bus->LineEnd <= now) {
+        Sim_LineCharEnd(bus);
+        return 1;
+    }
+    if (bus->LineEnd == 0 && bus->LinePos < bus->LineLen && bus->LineStart <= now) {
+        Sim_LineCharStart(bus);
+        return 1;
+    }
+
+    uint8_t line_free = bus->TxEnd == 0 && bus->LinePos >= bus->LineLen && bus->BreakStart == 0;
+    for (uint8_t i = 0; i < bus->NumSensors && line_free; i++) {
+        Sim_Sensor_TypeDef *sensor = bus->Sensors[i];
+        if (sensor->Measuring && sensor->ReadyAt <= now) {
+            // Service request
+            sensor->Measuring = 0;
+            char text[4] = { sensor->Address };
+            Sim_SendText(bus, sensor, text, 1, 0);
+            bus->LineStart = now;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static uint8_t Sim_ProcessTimers(void) {
+    for (uint8_t i = 0; i < SIM_NUM_TIMERS; i++) {
+        TIM_TypeDef *tim = &Sim_TIM[i];
+        if (!READ_BIT(tim->CR1, TIM_CR1_CEN)) {
+            continue;
+        }
+        uint64_t expiry = timer_start[i] + (tim->ARR + 1) * SIM_NS_PER_US;
+        if (expiry > now) {
+            continue;
+        }
+
+        SET_BIT(tim->SR, TIM_FLAG_UPDATE);
+        if (READ_BIT(tim->CR1, TIM_CR1_OPM)) {
+            CLEAR_BIT(tim->CR1, TIM_CR1_CEN);
+            tim->CNT = 0;
+        } else {
+            timer_start[i] = expiry;
+        }
+        if (READ_BIT(tim->DIER, TIM_IT_UPDATE)) {
+            CLEAR_BIT(tim->SR, TIM_FLAG_UPDATE);
+            HAL_TIM_PeriodElapsedCallback(timers[i]);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Wire */
+
+static uint8_t Sim_Parity(const uint8_t c) {
+    return (uint8_t) __builtin_parity(c);
+}
+
+static uint32_t Sim_Random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static uint8_t Sim_Chance(const uint16_t permille) {
+    return permille > 0 && Sim_Random() % 1000 < permille;
+}
+
+static uint32_t Sim_PinMode(const Sim_Bus_TypeDef *bus) {
+    return (bus->Port->MODER >> (POSITION_VAL(bus->Pin) * 2)) & GPIO_MODER_MODE0;
+}
+
+/*
+ * Break over, 12 ms or more wakes every sensor and aborts aM!.
+ */
+static void Sim_EndBreak(Sim_Bus_TypeDef *bus) {
+    uint64_t length = now - bus->BreakStart;
+    bus->BusyNs += length;
+    bus->BreakStart = 0;
+    bus->LastActivity = now;
+    bus->CmdLen = 0;
+    if (length < SIM_BREAK_NS) {
+        return;
+    }
+
+    bus->Breaks++;
+    bus->BreakNs = length;
+    bus->BreakEnd = now;
+    if (bus->Device != NULL) {
+        Sim_DeviceReceive(bus, 0x00, 1);
+    }
+    for (uint8_t i = 0; i < bus->NumSensors; i++) {
+        Sim_Sensor_TypeDef *sensor = bus->Sensors[i];
+        sensor->Awake = 1;
+        if (sensor->Measuring) {
+            sensor->Measuring = 0;
+            sensor->ReadyAt = 0;
+        }
+    }
+}
+
+/*
+ * A character of the command has left the recorder.
+ */
+static void Sim_TxChar(Sim_Bus_TypeDef *bus) {
+    UART_HandleTypeDef *huart = bus->Huart;
+    const USART_TypeDef *usart = huart->Instance;
+    uint8_t c = *huart->pTxBuffPtr++;
+    huart->TxXferCount--;
+
+    if (bus->LineEnd != 0) {
+        bus->Collisions++;
+    }
+
+    uint8_t on_wire = READ_BIT(usart->CR1, USART_CR1_UE) && READ_BIT(usart->CR1, USART_CR1_TE)
+            && (!READ_BIT(usart->CR2, USART_CR2_SWAP) || READ_BIT(usart->CR3, USART_CR3_HDSEL))
+            && Sim_PinMode(bus) == GPIO_MODE_AF_PP;
+    if (on_wire) {
+        // Sensors doze off 100 ms after the last activity
+        if (bus->CmdLen == 0 && now - SIM_CHAR_NS - bus->LastActivity > SIM_WAKE_NS) {
+            for (uint8_t i = 0; i < bus->NumSensors; i++) {
+                bus->Sensors[i]->Awake = 0;
+            }
+        }
+        if (bus->CmdLen == 0) {
+            bus->CmdStart = now - SIM_CHAR_NS;
+        }
+        bus->BusyNs += SIM_CHAR_NS;
+        bus->LastActivity = now;
+        // With parity the hardware replaces the MSB
+        uint8_t wire = READ_BIT(usart->CR1, USART_CR1_PCE) ? (uint8_t) ((c & 0x7f) | (Sim_Parity(c & 0x7f) << 7)) : c;
+        Sim_Hear(bus, wire);
+        if (bus->Device != NULL) {
+            Sim_DeviceReceive(bus, wire, 0);
+        }
+    }
+
+    if (huart->TxXferCount > 0) {
+        bus->TxEnd = now + SIM_CHAR_NS;
+        return;
+    }
+    bus->TxEnd = 0;
+    huart->gState = HAL_UART_STATE_READY;
+    HAL_UART_TxCpltCallback(huart);
+}
+
+/*
+ * The sensors' UARTs (7E1) receive a character from the recorder.
+ */
+static void Sim_Hear(Sim_Bus_TypeDef *bus, const uint8_t wire) {
+    if (Sim_Parity(wire)) {
+        // Parity error, the command is lost
+        bus->CmdLen = sizeof(bus->Cmd);
+        return;
+    }
+
+    char c = (char) (wire & 0x7f);
+    if (bus->CmdLen < sizeof(bus->Cmd) - 1) {
+        bus->Cmd[bus->CmdLen++] = c;
+    } else {
+        bus->CmdLen = sizeof(bus->Cmd);
+    }
+
+    if (c == '!') {
+        bus->CmdEnd = now;
+        if (bus->CmdLen < sizeof(bus->Cmd)) {
+            bus->Cmd[bus->CmdLen] = 0;
+            Sim_Command(bus);
+        }
+        bus->CmdLen = 0;
+    }
+}
+
+static void Sim_LineCharStart(Sim_Bus_TypeDef *bus) {
+    USART_TypeDef *usart = bus->Huart->Instance;
+    uint8_t listening = READ_BIT(usart->CR1, USART_CR1_UE) && READ_BIT(usart->CR1, USART_CR1_RE)
+            && (READ_BIT(usart->CR2, USART_CR2_SWAP) || READ_BIT(usart->CR3, USART_CR3_HDSEL));
+
+    if (bus->TxEnd != 0) {
+        bus->Collisions++;
+    }
+
+    if (bus->LinePos == 0) {
+        bus->ResponseStart = now;
+    }
+    bus->LineHeard = listening && !(bus->Line[bus->LinePos] & SIM_DROPPED);
+    if (bus->LineHeard) {
+        SET_BIT(usart->ISR, USART_ISR_BUSY);
+    }
+    bus->LineEnd = now + SIM_CHAR_NS;
+}
+
+static void Sim_LineCharEnd(Sim_Bus_TypeDef *bus) {
+    uint16_t c = bus->Line[bus->LinePos++];
+    bus->LineEnd = 0;
+    CLEAR_BIT(bus->Huart->Instance->ISR, USART_ISR_BUSY);
+
+    if (!(c & SIM_DROPPED)) {
+        bus->BusyNs += SIM_CHAR_NS;
+        bus->LastActivity = now;
+    }
+    if (bus->LinePos < bus->LineLen) {
+        bus->LineStart = now + bus->LineGap;
+    } else {
+        bus->LinePos = 0;
+        bus->LineLen = 0;
+        bus->Talker = NULL;
+    }
+
+    if (bus->LineHeard) {
+        Sim_Receive(bus, (uint8_t) c);
+    }
+
+    if (bus->DeviceTx && bus->LineLen == 0) {
+        bus->DeviceTx = 0;
+        bus->Device->gState = HAL_UART_STATE_READY;
+        HAL_UART_TxCpltCallback(bus->Device);
+    }
+}
+
+/*
+ * The recorder's UART has received a character: parity check, character
+ * match, then into the buffer by DMA or by interrupt (masked the way
+ * the HAL does for the configured frame).
+ */
+static void Sim_Receive(Sim_Bus_TypeDef *bus, const uint8_t wire) {
+    UART_HandleTypeDef *huart = bus->Huart;
+    USART_TypeDef *usart = huart->Instance;
+
+    if (READ_BIT(usart->CR1, USART_CR1_PCE) && Sim_Parity(wire)) {
+        bus->ParityErrors++;
+        if (READ_BIT(usart->CR1, USART_CR1_PEIE)) {
+            huart->ErrorCode |= HAL_UART_ERROR_PE;
+            huart->RxState = HAL_UART_STATE_READY;
+            CLEAR_BIT(usart->CR1, USART_CR1_PEIE);
+            HAL_UART_ErrorCallback(huart);
+        }
+        return;
+    }
+
+    if (wire == ((usart->CR2 & USART_CR2_ADD) >> USART_CR2_ADD_Pos)) {
+        SET_BIT(usart->ISR, USART_ISR_CMF);
+    }
+
+    uint8_t interrupt = 0;
+    if (huart->RxState == HAL_UART_STATE_BUSY_RX) {
+        uint8_t done;
+        if (bus->RxDma) {
+            *huart->pRxBuffPtr++ = wire;
+            huart->hdmarx->Counter--;
+            done = huart->hdmarx->Counter == 0;
+        } else {
+            *huart->pRxBuffPtr++ = wire & huart->Mask;
+            huart->RxXferCount--;
+            done = huart->RxXferCount == 0;
+            interrupt = 1;
+        }
+        if (done) {
+            huart->RxState = HAL_UART_STATE_READY;
+            CLEAR_BIT(usart->CR1, USART_CR1_PEIE);
+            HAL_UART_RxCpltCallback(huart);
+        }
+    }
+
+    if (READ_BIT(usart->ISR, USART_ISR_CMF) && (READ_BIT(usart->CR1, USART_CR1_CMIE) || interrupt)) {
+        Sim_UART_IRQHandler(huart);
+    }
+}
+
+/*
+ * The device's UART receives a character from the recorder, or the 0x00
+ * with a framing error that a break turns into.
+ */
+static void Sim_DeviceReceive(Sim_Bus_TypeDef *bus, const uint8_t wire, const uint8_t framing_error) {
+    UART_HandleTypeDef *huart = bus->Device;
+    USART_TypeDef *usart = huart->Instance;
+    uint8_t listening = READ_BIT(usart->CR1, USART_CR1_UE) && READ_BIT(usart->CR1, USART_CR1_RE)
+            && (READ_BIT(usart->CR2, USART_CR2_SWAP) || READ_BIT(usart->CR3, USART_CR3_HDSEL));
+    if (!listening || huart->RxState != HAL_UART_STATE_BUSY_RX) {
+        return;
+    }
+
+    if (!framing_error && READ_BIT(usart->CR1, USART_CR1_PCE) && Sim_Parity(wire)) {
+        huart->ErrorCode |= HAL_UART_ERROR_PE;
+        huart->RxState = HAL_UART_STATE_READY;
+        HAL_UART_ErrorCallback(huart);
+        return;
+    }
+
+    *huart->pRxBuffPtr++ = wire & huart->Mask;
+    huart->RxXferCount--;
+    if (huart->RxXferCount == 0) {
+        huart->RxState = HAL_UART_STATE_READY;
+        CLEAR_BIT(usart->CR1, USART_CR1_PEIE);
+        HAL_UART_RxCpltCallback(huart);
+    }
+    // Non-blocking error, reported after the character as the HAL does
+    if (framing_error) {
+        huart->ErrorCode |= HAL_UART_ERROR_FE;
+        HAL_UART_ErrorCallback(huart);
+    }
+}
+
+/* Sensors */
+
+/*
+ * A whole command is on the wire, the sensor it is for answers if it
+ * is awake.
+ */
+static void Sim_Command(Sim_Bus_TypeDef *bus) {
+    bus->Commands++;
+    for (uint8_t i = 0; i < bus->NumSensors; i++) {
+        Sim_Sensor_TypeDef *sensor = bus->Sensors[i];
+        if (sensor->Address != bus->Cmd[0] || !sensor->Awake) {
+            continue;
+        }
+
+        sensor->Commands++;
+        if (Sim_Chance(sensor->IgnorePermille)) {
+            sensor->Ignored++;
+            return;
+        }
+        // Without the address and the '!'
+        Sim_Sensor_Command(bus, sensor, &bus->Cmd[1], (uint8_t) (bus->CmdLen - 2));
+        return;
+    }
+}
+
+static uint16_t Sim_ParseIndex(const char *digits, const uint8_t len) {
+    uint16_t index = 0;
+    for (uint8_t i = 0; i < len; i++) {
+        if (digits[i] < '0' || digits[i] > '9') {
+            return UINT16_MAX;
+        }
+        index = index * 10 + (digits[i] - '0');
+    }
+    return (len > 0 && len <= 3) ? index : UINT16_MAX;
+}
+
+static void Sim_Sensor_Command(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, const char *body, const uint8_t len) {
+    char text[SIM_LINE_SIZE];
+    text[0] = sensor->Address;
+    uint16_t n = 1;
+    uint8_t crc = 0;
+    uint64_t ready = (uint64_t) (sensor->ReadyMs ? sensor->ReadyMs : sensor->Time * 1000U) * SIM_NS_PER_MS;
+
+    if (len == 0) {
+        // a!
+    } else if (body[0] == 'I' && len == 1) {
+        n += sprintf(&text[n], "%s", sensor->Ident);
+    } else if (body[0] == 'A' && len == 2 && SDI12_AddressIndex(body[1]) >= 0) {
+        sensor->Address = body[1];
+        text[0] = sensor->Address;
+    } else if (len == 2 && body[0] == 'I' && body[1] == 'M') {
+        n += sprintf(&text[n], "%03u%u", sensor->Time, sensor->NumValues < 9 ? sensor->NumValues : 9);
+    } else if ((body[0] == 'M' || body[0] == 'V') && len <= 3) {
+        // aM!, aMC!, aMn!, aMCn!, aV!
+        crc = len >= 2 && body[1] == 'C';
+        if (crc && !sensor->Crc) {
+            return;
+        }
+        sensor->ReadyAt = now + ready;
+        sensor->Measuring = sensor->Time > 0;
+        sensor->DataCrc = crc;
+        sensor->DataLine = 35;
+        n += sprintf(&text[n], "%03u%u", sensor->Time, sensor->NumValues < 9 ? sensor->NumValues : 9);
+        crc = 0;
+    } else if (body[0] == 'C' && len <= 3) {
+        crc = len >= 2 && body[1] == 'C';
+        if (crc && !sensor->Crc) {
+            return;
+        }
+        sensor->ReadyAt = now + ready;
+        sensor->Measuring = 0;
+        sensor->DataCrc = crc;
+        sensor->DataLine = 75;
+        n += sprintf(&text[n], "%03u%02u", sensor->Time, sensor->NumValues < 99 ? sensor->NumValues : 99);
+        crc = 0;
+    } else if (body[0] == 'H' && len == 2 && (body[1] == 'A' || body[1] == 'B')) {
+        if (!sensor->HighVolume) {
+            return;
+        }
+        sensor->ReadyAt = now + ready;
+        sensor->Measuring = 0;
+        sensor->DataCrc = 1;
+        sensor->DataLine = 75;
+        n += sprintf(&text[n], "%03u%03u", sensor->Time, sensor->NumValues);
+    } else if (body[0] == 'D' && len >= 3 && body[1] == 'B') {
+        uint16_t index = Sim_ParseIndex(&body[2], len - 2);
+        if (index == UINT16_MAX) {
+            return;
+        }
+        uint8_t packet[SIM_LINE_SIZE];
+        uint16_t size = Sim_Sensor_Packet(sensor, index, packet);
+        Sim_Send(bus, sensor, packet, size, 1, sensor->ResponseDelayUs * SIM_NS_PER_US);
+        return;
+    } else if (body[0] == 'D') {
+        uint16_t index = Sim_ParseIndex(&body[1], len - 1);
+        if (index == UINT16_MAX) {
+            return;
+        }
+        if (sensor->ReadyAt != 0 && now >= sensor->ReadyAt) {
+            n += Sim_Sensor_DataLine(sensor, index, sensor->DataLine, &text[n]);
+            crc = sensor->DataCrc;
+        }
+    } else if (body[0] == 'R') {
+        // aRn!, aRCn!
+        crc = len == 3 && body[1] == 'C';
+        uint16_t index = Sim_ParseIndex(&body[1 + crc], len - 1 - crc);
+        if (!sensor->Continuous || (crc && !sensor->Crc) || index == UINT16_MAX) {
+            return;
+        }
+        if (index == 0) {
+            n += Sim_Sensor_DataLine(sensor, 0, 75, &text[n]);
+        }
+    } else {
+        return;
+    }
+
+    Sim_SendText(bus, sensor, text, n, crc);
+}
+
+/*
+ * Values of data line index, each line holding as many whole values
+ * as fit in max characters.
+ */
+static uint16_t Sim_Sensor_DataLine(Sim_Sensor_TypeDef *sensor, const uint16_t index, const uint8_t max, char *out) {
+    uint16_t line = 0;
+    uint16_t len = 0;
+    for (uint16_t i = 0; i < sensor->NumValues; i++) {
+        char value[24];
+        int size = snprintf(value, sizeof(value), "%+.*f", sensor->Decimals, (double) sensor->Values[i]);
+        if (len + size > max) {
+            if (line == index) {
+                break;
+            }
+            line++;
+            len = 0;
+        }
+        if (line == index) {
+            memcpy(&out[len], value, size);
+        }
+        len += size;
+    }
+    return (line == index) ? len : 0;
+}
+
+/*
+ * aDBn! packet, PacketValues values of BinaryType each.
+ */
+static uint16_t Sim_Sensor_Packet(Sim_Sensor_TypeDef *sensor, const uint16_t index, uint8_t *out) {
+    uint8_t type = sensor->BinaryType;
+    uint8_t type_size = SDI12_Binary_TypeSize((SDI12_BinaryType_TypeDef) type);
+    uint32_t first = (uint32_t) index * sensor->PacketValues;
+    uint16_t count = 0;
+    if (sensor->ReadyAt != 0 && now >= sensor->ReadyAt && first < sensor->NumValues) {
+        count = sensor->NumValues - first;
+        count = (count < sensor->PacketValues) ? count : sensor->PacketValues;
+    }
+    if (count == 0) {
+        type = SDI12_BINARY_INVALID;
+    }
+
+    uint16_t size = count * type_size;
+    uint16_t len = 0;
+    out[len++] = (uint8_t) sensor->Address;
+    out[len++] = size & 0xff;
+    out[len++] = size >> 8;
+    out[len++] = type;
+    for (uint16_t i = 0; i < count; i++) {
+        float value = sensor->Values[first + i];
+        uint8_t raw[8];
+        switch (type) {
+        case SDI12_BINARY_FLOAT32:
+            memcpy(raw, &value, 4);
+            break;
+        case SDI12_BINARY_FLOAT64: {
+            double d = value;
+            memcpy(raw, &d, 8);
+            break;
+        }
+        default: {
+            // Little endian host, the low bytes are the value
+            int64_t v = (int64_t) value;
+            memcpy(raw, &v, 8);
+            break;
+        }
+        }
+        memcpy(&out[len], raw, type_size);
+        len += type_size;
+    }
+
+    uint16_t crc = SDI12_CRC16((const char*) out, len);
+    out[len++] = crc & 0xff;
+    out[len++] = crc >> 8;
+    return len;
+}
+
+/*
+ * Response text plus CRC (if crc) and CR/LF.
+ */
+static void Sim_SendText(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, char *text, uint16_t len, const uint8_t crc) {
+    if (crc) {
+        SDI12_CRC_Encode(SDI12_CRC16(text, len), &text[len]);
+        len += SDI12_CRC_SIZE;
+    }
+    text[len++] = '\r';
+    text[len++] = '\n';
+    Sim_Send(bus, sensor, (const uint8_t*) text, len, 0, sensor->ResponseDelayUs * SIM_NS_PER_US);
+}
+
+/*
+ * Queue a response on the wire, starting delay from now. Characters are
+ * dropped or corrupted here, as the sensor's settings ask.
+ */
+static void Sim_Send(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor, const uint8_t *data, const uint16_t len, const uint8_t binary, const uint64_t delay) {
+    if (bus->LinePos < bus->LineLen || len > SIM_LINE_SIZE) {
+        bus->Collisions++;
+        return;
+    }
+
+    for (uint16_t i = 0; i < len; i++) {
+        uint16_t wire = binary ? data[i] : (uint16_t) ((data[i] & 0x7f) | (Sim_Parity(data[i] & 0x7f) << 7));
+        if (Sim_Chance(sensor->DropPermille)) {
+            wire |= SIM_DROPPED;
+            sensor->Dropped++;
+        } else if (i + 1 == sensor->CorruptChar || Sim_Chance(sensor->CorruptPermille)) {
+            // Two bits so the parity still holds, only a CRC catches it
+            wire ^= binary ? 0x01 : 0x03;
+            sensor->Corrupted++;
+        }
+        bus->Line[i] = wire;
+    }
+    sensor->CorruptChar = 0;
+
+    bus->LineLen = len;
+    bus->LinePos = 0;
+    bus->LineStart = now + delay;
+    bus->LineGap = sensor->GapUs * SIM_NS_PER_US;
+    bus->Talker = sensor;
+    sensor->Responses++;
+}
+
+/* HAL */
+
+/*
+ * DWT->CYCCNT counts simulated time at SystemCoreClock when set, e.g. for
+ * trace timestamps, otherwise host nanoseconds for CPU time. Sim_Reset()
+ * goes back to the host clock.
+ */
+void Sim_SimulatedCycles(const uint8_t simulated) {
+    simulated_cycles = simulated;
+}
+
+/*
+ * DWT->CYCCNT reads the host clock unless Sim_SimulatedCycles(1).
+ */
+DWT_Type* Sim_DWT(void) {
+    if (simulated_cycles) {
+        dwt.CYCCNT = (uint32_t) (now * (SystemCoreClock / 1000000U) / 1000U);
+        return &dwt;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    dwt.CYCCNT = (uint32_t) ((uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec);
+    return &dwt;
+}
+
+uint32_t HAL_GetTick(void) {
+    return (uint32_t) (now / SIM_NS_PER_MS);
+}
+
+void HAL_Delay(uint32_t delay) {
+    uint32_t start = HAL_GetTick();
+    while (HAL_GetTick() - start < delay) {
+        Sim_Step();
+    }
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+    for (uint32_t pos = 0; pos < 16; pos++) {
+        if (init->Pin & (1U << pos)) {
+            MODIFY_REG(port->MODER, GPIO_MODER_MODE0 << (pos * 2), (init->Mode & GPIO_MODER_MODE0) << (pos * 2));
+        }
+    }
+}
+
+/*
+ * Driving the data pin high holds the line in break.
+ */
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state) {
+    if (state == GPIO_PIN_SET) {
+        SET_BIT(port->ODR, pin);
+    } else {
+        CLEAR_BIT(port->ODR, pin);
+    }
+
+    for (uint8_t i = 0; i < num_buses; i++) {
+        Sim_Bus_TypeDef *bus = buses[i];
+        if (bus->Port != port || bus->Pin != pin) {
+            continue;
+        }
+        if (state == GPIO_PIN_SET && bus->BreakStart == 0) {
+            bus->BreakStart = now;
+        } else if (state == GPIO_PIN_RESET && bus->BreakStart != 0) {
+            Sim_EndBreak(bus);
+        }
+    }
+}
+
+static HAL_StatusTypeDef Sim_UART_Config(UART_HandleTypeDef *huart, const uint8_t half_duplex) {
+    USART_TypeDef *usart = huart->Instance;
+    MODIFY_REG(usart->CR1, ~0U, huart->Init.Parity | huart->Init.Mode | USART_CR1_UE);
+    if (huart->AdvancedInit.AdvFeatureInit & UART_ADVFEATURE_SWAP_INIT) {
+        MODIFY_REG(usart->CR2, USART_CR2_SWAP, huart->AdvancedInit.Swap);
+    }
+    usart->CR3 = half_duplex ? USART_CR3_HDSEL : 0;
+    huart->gState = HAL_UART_STATE_READY;
+    huart->RxState = HAL_UART_STATE_READY;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart) {
+    return Sim_UART_Config(huart, 0);
+}
+
+HAL_StatusTypeDef HAL_HalfDuplex_Init(UART_HandleTypeDef *huart) {
+    return Sim_UART_Config(huart, 1);
+}
+
+/*
+ * The idle frame goes first, then one character every 8.33 ms.
+ * The device's response goes onto the line like a sensor's, it must
+ * have its transmitter on the bus by then.
+ */
+HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size) {
+    if (huart->gState != HAL_UART_STATE_READY) {
+        return HAL_BUSY;
+    }
+    Sim_Bus_TypeDef *bus = Sim_FindBus(huart);
+    if (data == NULL || size == 0 || bus == NULL) {
+        return HAL_ERROR;
+    }
+
+    huart->pTxBuffPtr = data;
+    huart->TxXferSize = size;
+    huart->TxXferCount = size;
+    huart->gState = HAL_UART_STATE_BUSY_TX;
+    if (huart == bus->Huart) {
+        bus->TxEnd = now + 2 * SIM_CHAR_NS;
+        return HAL_OK;
+    }
+
+    const USART_TypeDef *usart = huart->Instance;
+    uint8_t on_wire = READ_BIT(usart->CR1, USART_CR1_UE) && READ_BIT(usart->CR1, USART_CR1_TE)
+            && (!READ_BIT(usart->CR2, USART_CR2_SWAP) || READ_BIT(usart->CR3, USART_CR3_HDSEL));
+    if (bus->LinePos < bus->LineLen || size > SIM_LINE_SIZE) {
+        bus->Collisions++;
+        huart->gState = HAL_UART_STATE_READY;
+        return HAL_ERROR;
+    }
+
+    // Characters of a transmitter that is not on the bus are lost
+    for (uint16_t i = 0; i < size; i++) {
+        uint16_t wire = READ_BIT(usart->CR1, USART_CR1_PCE) ? (uint16_t) ((data[i] & 0x7f) | (Sim_Parity(data[i] & 0x7f) << 7)) : data[i];
+        bus->Line[i] = on_wire ? wire : SIM_DROPPED;
+    }
+    bus->LineLen = size;
+    bus->LinePos = 0;
+    bus->LineStart = now + SIM_CHAR_NS;
+    bus->LineGap = 0;
+    bus->DeviceTx = 1;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef Sim_UART_StartReceive(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, const uint8_t dma) {
+    if (huart->RxState != HAL_UART_STATE_READY) {
+        return HAL_BUSY;
+    }
+    Sim_Bus_TypeDef *bus = Sim_FindBus(huart);
+    if (data == NULL || size == 0 || bus == NULL || (dma && huart->hdmarx == NULL)) {
+        return HAL_ERROR;
+    }
+
+    huart->pRxBuffPtr = data;
+    huart->RxXferSize = size;
+    huart->RxXferCount = size;
+    // UART_MASK_COMPUTATION() for 8 bit words
+    huart->Mask = (huart->Init.Parity == UART_PARITY_NONE) ? 0xff : 0x7f;
+    huart->ErrorCode = HAL_UART_ERROR_NONE;
+    huart->RxState = HAL_UART_STATE_BUSY_RX;
+    if (huart->Init.Parity != UART_PARITY_NONE) {
+        SET_BIT(huart->Instance->CR1, USART_CR1_PEIE);
+    }
+    if (dma) {
+        huart->hdmarx->Counter = size;
+    }
+    if (huart != bus->Huart) {
+        return dma ? HAL_ERROR : HAL_OK;
+    }
+    bus->RxDma = dma;
+    if (bus->RxArmed < bus->CmdEnd) {
+        bus->RxArmed = now;
+    }
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_IT(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size) {
+    return Sim_UART_StartReceive(huart, data, size, 0);
+}
+
+HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size) {
+    return Sim_UART_StartReceive(huart, data, size, 1);
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart) {
+    CLEAR_BIT(huart->Instance->CR1, USART_CR1_PEIE);
+    huart->RxXferCount = 0;
+    huart->RxState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortTransmit(UART_HandleTypeDef *huart) {
+    Sim_Bus_TypeDef *bus = Sim_FindBus(huart);
+    if (bus != NULL && huart == bus->Huart) {
+        bus->TxEnd = 0;
+    } else if (bus != NULL && bus->DeviceTx) {
+        // The rest of the response is not sent
+        bus->DeviceTx = 0;
+        bus->LineEnd = 0;
+        bus->LineLen = 0;
+        bus->LinePos = 0;
+    }
+    huart->TxXferCount = 0;
+    huart->gState = HAL_UART_STATE_READY;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart) {
+    HAL_UART_AbortTransmit(huart);
+    return HAL_UART_AbortReceive(huart);
+}
+
+static Sim_Bus_TypeDef* Sim_FindBus(const UART_HandleTypeDef *huart) {
+    for (uint8_t i = 0; i < num_buses; i++) {
+        if (buses[i]->Huart == huart || buses[i]->Device == huart) {
+            return buses[i];
+        }
+    }
+    return NULL;
+}
+
+void Sim_TIM_Enable(TIM_HandleTypeDef *htim) {
+    uint8_t i = (uint8_t) (htim->Instance - Sim_TIM);
+    timers[i] = htim;
+    if (!READ_BIT(htim->Instance->CR1, TIM_CR1_CEN)) {
+        timer_start[i] = now - htim->Instance->CNT * SIM_NS_PER_US;
+        SET_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+    }
+}
+
+void Sim_TIM_Disable(TIM_HandleTypeDef *htim) {
+    if (READ_BIT(htim->Instance->CR1, TIM_CR1_CEN)) {
+        htim->Instance->CNT = Sim_TIM_GetCounter(htim);
+        CLEAR_BIT(htim->Instance->CR1, TIM_CR1_CEN);
+    }
+}
+
+uint32_t Sim_TIM_GetCounter(TIM_HandleTypeDef *htim) {
+    TIM_TypeDef *tim = htim->Instance;
+    if (!READ_BIT(tim->CR1, TIM_CR1_CEN)) {
+        return tim->CNT;
+    }
+    uint8_t i = (uint8_t) (tim - Sim_TIM);
+    return (uint32_t) (((now - timer_start[i]) / SIM_NS_PER_US) % (tim->ARR + 1));
+}
+
+void Sim_TIM_SetCounter(TIM_HandleTypeDef *htim, uint32_t count) {
+    htim->Instance->CNT = count;
+    if (READ_BIT(htim->Instance->CR1, TIM_CR1_CEN)) {
+        timer_start[htim->Instance - Sim_TIM] = now - count * SIM_NS_PER_US;
+    }
+}
+
+/*
+ * Interrupt callbacks, routed to the driver as main.c and stm32l4xx_it.c
+ * do on the target.
+ */
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+    SDI12_TIM_PeriodElapsedCallback(htim);
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_UART_TxCpltCallback(huart);
+    SDI12_Sensor_UART_TxCpltCallback(huart);
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    SDI12_UART_RxCpltCallback(huart);
+    SDI12_Sensor_UART_RxCpltCallback(huart);
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    SDI12_UART_ErrorCallback(huart);
+    SDI12_Sensor_UART_ErrorCallback(huart);
+}
+
+static void Sim_UART_IRQHandler(UART_HandleTypeDef *huart) {
+    SDI12_UART_IRQHandler(huart);
+}
@@ -0,0 +1,151 @@
+/*
+ ******************************************************************************
+ * @file           : sdi12_sim.h
+ * @brief          : Simulated SDI-12 bus for running the driver on a PC.
+ ******************************************************************************
+ * Implements the HAL calls of hal/main.h in simulated time (1 ns steps) and
+ * puts sensors on the other end of the wire:
+ *
+ *   driver (app/) --HAL--> UART, timer, GPIO --wire--> sensors
+ *
+ * Characters take 10 bits at 1200 baud (8.33 ms). The recorder's UART sends
+ * an idle frame (the marking) ahead of every command, as it does after its
+ * transmitter is re-enabled. Holding the line in break for 12 ms or more
+ * wakes the sensors, which then listen for 100 ms after the last activity
+ * on the line.
+ *
+ * ASCII is sent as 7E1 and binary packets (aDBn!) as 8N1, the receiving
+ * UART checks parity and masks the MSB the way the hardware and HAL do, so
+ * a UART left in the wrong frame shows up as parity errors or lost bits.
+ *
+ * Sensors answer a!, aI!, aAb!, aIM!, aM!, aMC!, aMn!, aV!, aC!, aCC!,
+ * aHA!, aHB!, aDn!, aDBn!, aRn! and aRCn!, each after ResponseDelay, and
+ * send a service request once an aM! measurement is ready. Characters of
+ * their responses can be dropped or corrupted at random.
+ *
+ * A second UART can be put on the wire as a device (Sim_Bus_AddDevice),
+ * for the driver's own sensor mode (sdi12_sensor.c) to answer the
+ * recorder. It hears commands and breaks (a 0x00 with a framing error)
+ * while its receiver is on the bus, and its characters reach the
+ * recorder the same way a simulated sensor's do.
+ *
+ * Time only moves in Sim_Step() (__WFI() in the driver) and the functions
+ * built on it. Interrupt callbacks run from there.
+ ******************************************************************************
+ */
+
+#ifndef SDI12_SIM_
+#define SDI12_SIM_
+
+#include "main.h"
+
+#define SIM_MAX_BUSES 2
+#define SIM_MAX_SENSORS 10
+#define SIM_MAX_VALUES 200
+#define SIM_LINE_SIZE 1100 // Longest response, a full binary packet
+
+#define SIM_NS_PER_US 1000ULL
+#define SIM_NS_PER_MS 1000000ULL
+#define SIM_CHAR_NS 8333333ULL // 10 bits at 1200 baud
+#define SIM_BREAK_NS (12 * SIM_NS_PER_MS)
+#define SIM_WAKE_NS (100 * SIM_NS_PER_MS)
+
+/*
+ * A sensor on the simulated bus. Set it up with Sim_Sensor_Init(...) and
+ * change the settings before adding it to a bus.
+ */
+typedef struct {
+    char Address;
+    const char *Ident; // aI! response after the address
+    uint16_t Time; // ttt reported by aM!/aC!, s
+    uint32_t ReadyMs; // Data actually ready after this, 0 for Time
+    uint16_t NumValues;
+    float Values[SIM_MAX_VALUES];
+    uint8_t Decimals;
+    uint8_t BinaryType; // SDI12_BinaryType_TypeDef of aDBn! packets
+    uint16_t PacketValues; // Values per aDBn! packet
+    uint8_t Crc; // Answers aMC!, aCC! and aRCn!
+    uint8_t Continuous; // Answers aRn!
+    uint8_t HighVolume; // Answers aHA! and aHB!
+    uint32_t ResponseDelayUs; // End of command to start of response (8.33 - 15 ms)
+    uint32_t GapUs; // Between characters of a response (max 1.66 ms)
+    uint16_t DropPermille; // Response characters lost on the wire
+    uint16_t CorruptPermille; // Response characters with two bits flipped
+    uint16_t IgnorePermille; // Commands not answered at all
+    uint16_t CorruptChar; // Corrupt this character (from 1) of the next response only, 0 for none
+    // State
+    uint8_t Awake;
+    uint8_t Measuring; // aM! in progress, service request due at ReadyAt
+    uint8_t DataCrc; // Data of the last measurement carries a CRC
+    uint8_t DataLine; // Longest line of values, 35 (aM!) or 75 characters
+    uint64_t ReadyAt;
+    // Statistics
+    uint32_t Commands; // Addressed to this sensor while awake
+    uint32_t Responses;
+    uint32_t Ignored;
+    uint32_t Dropped;
+    uint32_t Corrupted;
+} Sim_Sensor_TypeDef;
+
+/*
+ * One SDI-12 wire: the recorder's UART, timer and data pin, and the sensors.
+ */
+typedef struct {
+    UART_HandleTypeDef *Huart;
+    TIM_HandleTypeDef *Htim;
+    GPIO_TypeDef *Port;
+    uint16_t Pin;
+    DMA_HandleTypeDef Hdmarx;
+    Sim_Sensor_TypeDef *Sensors[SIM_MAX_SENSORS];
+    uint8_t NumSensors;
+    // Recorder transmitting
+    uint64_t TxEnd; // End of the character on the wire, 0 when idle
+    // Sensor transmitting
+    uint16_t Line[SIM_LINE_SIZE]; // Wire characters, SIM_DROPPED when lost
+    uint16_t LineLen;
+    uint16_t LinePos;
+    uint64_t LineStart; // Start of the next character
+    uint64_t LineEnd; // End of the character on the wire, 0 between characters
+    uint64_t LineGap; // Between characters of the response
+    Sim_Sensor_TypeDef *Talker;
+    uint8_t LineHeard; // The recorder was listening at its start bit
+    uint8_t RxDma; // Reception in progress is by DMA
+    // Line
+    char Cmd[16]; // Command being sent
+    uint8_t CmdLen;
+    uint64_t BreakStart; // 0 when not in break
+    uint64_t LastActivity; // End of the last break or character
+    // Timing of the last command
+    uint64_t BreakNs; // Length of its break
+    uint64_t BreakEnd;
+    uint64_t CmdStart; // Start of its first character
+    uint64_t CmdEnd; // End of its '!'
+    uint64_t RxArmed; // Reception first started after it
+    uint64_t ResponseStart; // Start of the first character of the last response
+    // Sensor mode UART (SDI12_Sensor_...) on the same wire, NULL for none
+    UART_HandleTypeDef *Device;
+    uint8_t DeviceTx; // The line is carrying its response
+    // Statistics
+    uint32_t Breaks;
+    uint32_t Commands;
+    uint32_t ParityErrors; // Detected by the recorder's UART
+    uint32_t Collisions; // Recorder and a sensor sending at once
+    uint64_t BusyNs; // Line in break or carrying characters
+} Sim_Bus_TypeDef;
+
+#define SIM_DROPPED 0x100
+
+void Sim_Reset(const uint32_t seed);
+void Sim_Bus_Init(Sim_Bus_TypeDef *bus, UART_HandleTypeDef *huart, USART_TypeDef *instance, const uint8_t dma,
+        TIM_HandleTypeDef *htim, TIM_TypeDef *tim, GPIO_TypeDef *port, const uint16_t pin);
+void Sim_Bus_AddSensor(Sim_Bus_TypeDef *bus, Sim_Sensor_TypeDef *sensor);
+void Sim_Bus_AddDevice(Sim_Bus_TypeDef *bus, UART_HandleTypeDef *huart, USART_TypeDef *instance);
+void Sim_Sensor_Init(Sim_Sensor_TypeDef *sensor, const char addr);
+void Sim_Sensor_SetValues(Sim_Sensor_TypeDef *sensor, const float values[], const uint16_t count, const uint8_t decimals);
+uint64_t Sim_Now(void);
+void Sim_Step(void);
+void Sim_RunFor(const uint64_t ns);
+void Sim_RunUntilIdle(void);
+void Sim_SimulatedCycles(const uint8_t simulated);
+
+#endif // SDI12_SIM_
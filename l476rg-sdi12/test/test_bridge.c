@@ -0,0 +1,202 @@
+/*
+ ******************************************************************************
+ * @file           : test_bridge.c
+ * @brief          : Host tests of the USB to SDI-12 bridge (sdi12_bridge.c)
+ *            on the simulated bus.
+ ******************************************************************************
+ * The host link (USART2 by DMA) is faked here: typed lines go straight
+ * into the bridge's receive buffer, replies are kept in host_out until
+ * HostTxDone() finishes them.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12.h"
+#include "sdi12_bridge.h"
+#include "sdi12_sim.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_REPLY(expected) do { \
+    CHECK_EQ(host_out_len, strlen(expected)); \
+    CHECK(memcmp(host_out, (expected), strlen(expected)) == 0); \
+} while (0)
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static Sim_Sensor_TypeDef sensor;
+static SDI12_Bridge_TypeDef bridge;
+
+static UART_HandleTypeDef host;
+static DMA_HandleTypeDef host_dmarx, host_dmatx;
+static uint8_t *host_rx;
+static uint16_t host_rx_size;
+static uint16_t host_rx_pos;
+static uint8_t host_out[SDI12_DATA_LINE_SIZE + 1];
+static uint16_t host_out_len;
+static uint32_t host_sent; // Replies started
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *h, uint8_t *data, uint16_t size) {
+    h->RxState = HAL_UART_STATE_BUSY_RX;
+    host_rx = data;
+    host_rx_size = size;
+    host_rx_pos = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *h, const uint8_t *data, uint16_t size) {
+    if (h->gState != HAL_UART_STATE_READY) {
+        return HAL_BUSY;
+    }
+    h->gState = HAL_UART_STATE_BUSY_TX;
+    memcpy(host_out, data, size);
+    host_out_len = size;
+    host_sent++;
+    return HAL_OK;
+}
+
+/*
+ * The reply in host_out has gone out.
+ */
+static void HostTxDone(void) {
+    host.gState = HAL_UART_STATE_READY;
+    host_out_len = 0;
+    SDI12_Bridge_UART_TxCpltCallback(&host);
+}
+
+/*
+ * Type a line in the terminal, the idle event follows it.
+ */
+static void Type(const char *line) {
+    for (const char *c = line; *c != '\0'; c++) {
+        host_rx[host_rx_pos++] = (uint8_t) *c;
+        if (host_rx_pos == host_rx_size) {
+            host_rx_pos = 0;
+        }
+    }
+    SDI12_Bridge_RxEventCallback(&host, host_rx_pos);
+}
+
+static void Setup(void) {
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus, &huart, USART3, 1, &htim, TIM6, GPIOC, 0x0010);
+    Sim_Sensor_Init(&sensor, '0');
+    Sim_Bus_AddSensor(&bus, &sensor);
+    CHECK_EQ(SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010), HAL_OK);
+
+    memset(&host, 0, sizeof(host));
+    host.Instance = USART2;
+    host.hdmarx = &host_dmarx;
+    host.hdmatx = &host_dmatx;
+    host.gState = HAL_UART_STATE_READY;
+    host_out_len = 0;
+    host_sent = 0;
+    CHECK_EQ(SDI12_Bridge_Init(&bridge, &host, &sdi12), HAL_OK);
+}
+
+/*
+ * One CR/LF per reply, an empty line only when nothing answered.
+ */
+static void Test_Command(void) {
+    Setup();
+
+    Type("0!\r\n");
+    Sim_RunUntilIdle();
+    CHECK_REPLY("0\r\n");
+    HostTxDone();
+
+    Type("5!\r");
+    Sim_RunUntilIdle();
+    CHECK_REPLY("\r\n");
+    HostTxDone();
+    CHECK_EQ(bridge.Commands, 2);
+    CHECK_EQ(bridge.Timeouts, 1);
+}
+
+/*
+ * A full aRC0! line, 37 values with the address and the CRC.
+ */
+static void Test_FullLine(void) {
+    Setup();
+    float values[MAX_RESPONSE_SIZE / 2];
+    for (uint8_t i = 0; i < MAX_RESPONSE_SIZE / 2; i++) {
+        values[i] = (float) (i % 10);
+    }
+    Sim_Sensor_SetValues(&sensor, values, MAX_RESPONSE_SIZE / 2, 0);
+    sensor.Continuous = 1;
+    sensor.Crc = 1;
+
+    Type("0RC0!\r");
+    Sim_RunUntilIdle();
+    uint16_t len = 1 + (MAX_RESPONSE_SIZE / 2) * 2 + SDI12_CRC_SIZE + 2;
+    CHECK_EQ(host_out_len, len);
+    CHECK_EQ(host_out[0], '0');
+    CHECK(memcmp(&host_out[1], "+0+1+2", 6) == 0);
+    CHECK(memcmp(&host_out[len - 2], "\r\n", 2) == 0);
+    CHECK_EQ(bridge.Timeouts, 0);
+}
+
+/*
+ * Replies while the host UART is busy wait for it, one at a time.
+ */
+static void Test_Queue(void) {
+    Setup();
+
+    Type("0!\r");
+    Sim_RunUntilIdle();
+    CHECK_REPLY("0\r\n");
+
+    // Answered before the host took the last reply
+    Type("0I!\r");
+    Sim_RunUntilIdle();
+    CHECK_EQ(bridge.QueuedLen, strlen("014SIMSDI12SENSOR100") + 2);
+    CHECK_EQ(host_sent, 1);
+    HostTxDone();
+    CHECK_EQ(host_sent, 2);
+    CHECK(host_out_len > 3 && memcmp(host_out, "014", 3) == 0);
+
+    // BUSY queues behind it, the response after that has nowhere to go
+    Type("0M!\r");
+    Type("0!\r");
+    CHECK_EQ(bridge.Dropped, 1);
+    CHECK_EQ(bridge.QueuedLen, strlen(SDI12_BRIDGE_BUSY) + 2);
+    Sim_RunUntilIdle();
+    CHECK_EQ(bridge.RepliesDropped, 1);
+    HostTxDone();
+    CHECK_REPLY(SDI12_BRIDGE_BUSY "\r\n");
+    HostTxDone();
+    CHECK_EQ(host_sent, 3);
+    CHECK_EQ(bridge.QueuedLen, 0);
+}
+
+int main(void) {
+    Test_Command();
+    Test_FullLine();
+    Test_Queue();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
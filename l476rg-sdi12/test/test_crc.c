@@ -0,0 +1,108 @@
+/*
+ ******************************************************************************
+ * @file           : test_crc.c
+ * @brief          : Host tests of the SDI-12 CRC-16, all three kernels.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12_crc.h"
+#include "crc_variants.h"
+
+#define MAX_LINE 72 // Longest aDn! line without its CRC
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+/*
+ * Check values of CRC-16/ARC, the same for every kernel.
+ */
+static void Test_Vectors(void) {
+    for (uint8_t k = 0; k < CRC_NUM_VARIANTS; k++) {
+        const CRC_Variant_TypeDef *v = &crc_variants[k];
+        CHECK_EQ(v->CRC16("123456789", 9), 0xBB3D);
+        CHECK_EQ(v->CRC16("", 0), 0x0000);
+        CHECK_EQ(v->CRC16("0+3.14", 6), 0xFC5A);
+    }
+}
+
+/*
+ * The kernels agree on every byte value and on random data.
+ */
+static void Test_Agree(void) {
+    char data[256];
+    for (uint16_t i = 0; i < sizeof(data); i++) {
+        data[i] = (char) i;
+    }
+    uint32_t seed = 1;
+    for (uint16_t round = 0; round < 1000; round++) {
+        uint16_t len = round % sizeof(data);
+        if (round > 0) {
+            for (uint16_t i = 0; i < len; i++) {
+                seed = seed * 1103515245 + 12345;
+                data[i] = (char) (seed >> 16);
+            }
+        }
+        uint16_t expected = crc_variants[0].CRC16(data, len);
+        for (uint8_t k = 1; k < CRC_NUM_VARIANTS; k++) {
+            CHECK_EQ(crc_variants[k].CRC16(data, len), expected);
+        }
+    }
+}
+
+static void Test_Encoding(void) {
+    char ascii[SDI12_CRC_SIZE + 1] = { 0 };
+    SDI12_CRC_Encode(0xFC5A, ascii);
+    CHECK_EQ(strcmp(ascii, "OqZ"), 0);
+
+    for (uint32_t crc = 0; crc <= 0xFFFF; crc++) {
+        SDI12_CRC_Encode((uint16_t) crc, ascii);
+        for (uint8_t i = 0; i < SDI12_CRC_SIZE; i++) {
+            if ((ascii[i] & 0xC0) != 0x40) {
+                CHECK_EQ(ascii[i] & 0xC0, 0x40);
+            }
+        }
+        if (SDI12_CRC_Decode(ascii) != crc) {
+            CHECK_EQ(SDI12_CRC_Decode(ascii), crc);
+        }
+    }
+}
+
+static void Test_Check(void) {
+    CHECK_EQ(SDI12_CheckCRC("0+3.14OqZ", 9), HAL_OK);
+    CHECK_EQ(SDI12_CheckCRC("0+3.15OqZ", 9), HAL_ERROR); // Data changed
+    CHECK_EQ(SDI12_CheckCRC("0+3.14OqY", 9), HAL_ERROR); // CRC changed
+    CHECK_EQ(SDI12_CheckCRC("0+3.14Oq\x1a", 9), HAL_ERROR); // Not a CRC character
+    CHECK_EQ(SDI12_CheckCRC("OqZ", 3), HAL_ERROR); // Nothing but the CRC
+    CHECK_EQ(SDI12_CheckCRC("0+3.14", 6), HAL_ERROR); // No CRC at all
+
+    // Longest aDn! line
+    char line[MAX_LINE + SDI12_CRC_SIZE];
+    memset(line, '+', MAX_LINE);
+    line[0] = '0';
+    SDI12_CRC_Encode(SDI12_CRC16(line, MAX_LINE), &line[MAX_LINE]);
+    CHECK_EQ(SDI12_CheckCRC(line, sizeof(line)), HAL_OK);
+}
+
+int main(void) {
+    Test_Vectors();
+    Test_Agree();
+    Test_Encoding();
+    Test_Check();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,305 @@
+/*
+ ******************************************************************************
+ * @file           : test_engine.c
+ * @brief          : Host tests of the SDI-12 transaction engine (break,
+ *            marking, transmit, receive, retries) on the simulated bus.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12.h"
+#include "sdi12_sim.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+#define DATA_PIN 0x0010 // PC4
+#define OE_PIN 0x0100 // PA8
+
+static SDI12_TypeDef sdi12[2];
+static UART_HandleTypeDef huart[2];
+static TIM_HandleTypeDef htim[2];
+static Sim_Bus_TypeDef bus[2];
+static Sim_Sensor_TypeDef sensors[2];
+
+static char response[MAX_RESPONSE_SIZE + 1];
+static SDI12_Transaction_TypeDef transaction;
+static uint8_t callbacks;
+
+static void Done(SDI12_Transaction_TypeDef *t) {
+    (void) t;
+    callbacks++;
+}
+
+/*
+ * Bus 0 on USART3 (PC4) with TIM6 and sensor '0' on it, received by DMA
+ * if dma is set.
+ */
+static void Setup(const uint8_t dma) {
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus[0], &huart[0], USART3, dma, &htim[0], TIM6, GPIOC, DATA_PIN);
+    Sim_Sensor_Init(&sensors[0], '0');
+    Sim_Bus_AddSensor(&bus[0], &sensors[0]);
+    CHECK_EQ(SDI12_Init(&sdi12[0], &huart[0], &htim[0], GPIOC, DATA_PIN), HAL_OK);
+}
+
+/*
+ * Set up the transaction for cmd, with Done as its callback.
+ */
+static SDI12_Transaction_TypeDef* Prepare(const char *cmd, const uint8_t skip_break) {
+    memset(&transaction, 0, sizeof(transaction));
+    memset(response, 0, sizeof(response));
+    transaction.Cmd = cmd;
+    transaction.CmdLen = (uint8_t) strlen(cmd);
+    transaction.Response = response;
+    transaction.ResponseLen = MAX_RESPONSE_SIZE;
+    transaction.Callback = Done;
+    transaction.SkipBreak = skip_break;
+    callbacks = 0;
+    return &transaction;
+}
+
+/*
+ * Submit returns straight away and every state follows from the timer
+ * and UART interrupts: break, marking and command, then the response.
+ */
+static void Test_States(const uint8_t dma) {
+    Setup(dma);
+
+    uint64_t start = Sim_Now();
+    CHECK_EQ(SDI12_Submit(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+    CHECK_EQ(sdi12[0].State, SDI12_STATE_BREAK);
+    CHECK(SDI12_IsBusy(&sdi12[0]));
+    CHECK_EQ(SDI12_Submit(&sdi12[0], &transaction), HAL_BUSY);
+    CHECK_EQ(Sim_Now(), start);
+
+    // Break held for SDI12_BREAK_US
+    Sim_RunFor(SDI12_BREAK_US * SIM_NS_PER_US - SIM_NS_PER_US);
+    CHECK_EQ(sdi12[0].State, SDI12_STATE_BREAK);
+    CHECK(READ_BIT(GPIOC->ODR, DATA_PIN));
+    Sim_RunFor(2 * SIM_NS_PER_US);
+    CHECK(!READ_BIT(GPIOC->ODR, DATA_PIN));
+    CHECK_EQ(bus[0].Breaks, 1);
+
+    // Marking (one idle frame) and 2 characters of command
+    CHECK_EQ(sdi12[0].State, SDI12_STATE_TRANSMIT);
+    Sim_RunFor(3 * SIM_CHAR_NS);
+    CHECK_EQ(sdi12[0].State, SDI12_STATE_RECEIVE);
+    CHECK_EQ(bus[0].Commands, 1);
+    CHECK_EQ(callbacks, 0);
+
+    Sim_RunUntilIdle();
+    CHECK_EQ(callbacks, 1);
+    CHECK_EQ(transaction.Status, HAL_OK);
+    CHECK_EQ(transaction.Attempts, 1);
+    CHECK(strcmp(response, "0") == 0);
+    // Sensor's 9 ms plus its first character
+    CHECK_EQ(transaction.Latency, 9000 + SIM_CHAR_NS / SIM_NS_PER_US);
+    CHECK_EQ(sdi12[0].State, SDI12_STATE_IDLE);
+    CHECK_EQ(bus[0].Collisions, 0);
+    CHECK_EQ(bus[0].ParityErrors, 0);
+}
+
+/*
+ * SkipBreak only sends without a break inside the wake window.
+ */
+static void Test_WakeWindow(void) {
+    Setup(1);
+
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 1)), HAL_OK);
+    CHECK_EQ(sdi12[0].BreakSent, 1);
+
+    Sim_RunFor(50 * SIM_NS_PER_MS);
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 1)), HAL_OK);
+    CHECK_EQ(sdi12[0].BreakSent, 0);
+    CHECK_EQ(bus[0].Breaks, 1);
+
+    // Sensor asleep by now
+    Sim_RunFor((SDI12_WAKE_WINDOW_MS + 1) * SIM_NS_PER_MS);
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 1)), HAL_OK);
+    CHECK_EQ(sdi12[0].BreakSent, 1);
+    CHECK_EQ(bus[0].Breaks, 2);
+    CHECK_EQ(sensors[0].Responses, 3);
+}
+
+/*
+ * Unanswered commands are sent again with a marking, then after a new
+ * break, SDI12_MAX_ATTEMPTS times in all.
+ */
+static void Test_Retries(void) {
+    Setup(1);
+    sensors[0].IgnorePermille = 1000;
+
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 0)), HAL_TIMEOUT);
+    CHECK_EQ(callbacks, 1);
+    CHECK_EQ(transaction.Attempts, SDI12_MAX_ATTEMPTS);
+    CHECK_EQ(sensors[0].Commands, SDI12_MAX_ATTEMPTS);
+    CHECK_EQ(bus[0].Breaks, SDI12_RETRY_BREAKS + 1);
+
+    // A start bit within the retry wait is enough
+    Setup(1);
+    sensors[0].ResponseDelayUs = SDI12_RETRY_WAIT_US - 500;
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+    CHECK_EQ(transaction.Attempts, 1);
+
+    Setup(1);
+    sensors[0].IgnorePermille = 1000;
+    Prepare("0!", 0);
+    transaction.NoRetry = 1;
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], &transaction), HAL_TIMEOUT);
+    CHECK_EQ(transaction.Attempts, 1);
+
+    // Absent addresses get a single attempt
+    Setup(1);
+    for (uint8_t i = 0; i < SDI12_ABSENT_AFTER; i++) {
+        CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("7!", 0)), HAL_TIMEOUT);
+    }
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("7!", 0)), HAL_TIMEOUT);
+    CHECK_EQ(transaction.Attempts, 1);
+    CHECK_EQ(SDI12_GetAddressStats(&sdi12[0], '7')->Failures, SDI12_ABSENT_AFTER + 1);
+}
+
+/*
+ * Abort in the middle of the break releases the line, the bus is usable
+ * straight after.
+ */
+static void Test_Abort(void) {
+    Setup(1);
+
+    CHECK_EQ(SDI12_Submit(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+    Sim_RunFor(5 * SIM_NS_PER_MS);
+    SDI12_Abort(&sdi12[0]);
+    CHECK_EQ(callbacks, 1);
+    CHECK_EQ(transaction.Status, HAL_TIMEOUT);
+    CHECK(!READ_BIT(GPIOC->ODR, DATA_PIN));
+    CHECK_EQ((GPIOC->MODER >> sdi12[0].ModeShift) & GPIO_MODER_MODE0, GPIO_MODE_AF_PP);
+    CHECK_EQ(bus[0].Breaks, 0);
+
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+
+    // Listening with nothing on the line only ends with an abort
+    Prepare("", 0);
+    CHECK_EQ(SDI12_Listen(&sdi12[0], &transaction), HAL_OK);
+    Sim_RunFor(500 * SIM_NS_PER_MS);
+    CHECK_EQ(callbacks, 0);
+    SDI12_Abort(&sdi12[0]);
+    CHECK_EQ(transaction.Status, HAL_TIMEOUT);
+    CHECK(!SDI12_IsBusy(&sdi12[0]));
+}
+
+/*
+ * A line that fills the buffer before its LF is an error, with the
+ * first character (interrupt) or the rest of the line (block) filling it.
+ */
+static void Test_Overflow(const uint8_t dma) {
+    Setup(dma);
+
+    // "014SIMSDI12SENSOR100" and CR/LF
+    Prepare("0I!", 0);
+    transaction.ResponseLen = 22;
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], &transaction), HAL_OK);
+    CHECK(strcmp(response, "014SIMSDI12SENSOR100") == 0);
+
+    Prepare("0I!", 0);
+    transaction.ResponseLen = 21;
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], &transaction), HAL_ERROR);
+    CHECK_EQ(transaction.Count, 20); // CR stripped, LF still on the bus
+
+    Sim_RunUntilIdle();
+    Prepare("0!", 0);
+    transaction.ResponseLen = 1;
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], &transaction), HAL_ERROR);
+    CHECK_EQ(SDI12_GetAddressStats(&sdi12[0], '0')->Failures, 2);
+}
+
+/*
+ * Half duplex transport drives the OE pin only while transmitting.
+ */
+static void Test_HalfDuplex(void) {
+    Setup(1);
+    CHECK_EQ(SDI12_SetTransport(&sdi12[0], SDI12_TRANSPORT_HALF_DUPLEX, NULL, 0), HAL_ERROR);
+    CHECK_EQ(SDI12_SetTransport(&sdi12[0], SDI12_TRANSPORT_HALF_DUPLEX, GPIOA, OE_PIN), HAL_OK);
+    CHECK(READ_BIT(USART3->CR3, USART_CR3_HDSEL));
+
+    CHECK_EQ(SDI12_Submit(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+    CHECK(READ_BIT(GPIOA->ODR, OE_PIN));
+    Sim_RunUntilIdle();
+    CHECK_EQ(transaction.Status, HAL_OK);
+    CHECK(!READ_BIT(GPIOA->ODR, OE_PIN));
+
+    CHECK_EQ(SDI12_SetTransport(&sdi12[0], SDI12_TRANSPORT_SWAP, NULL, 0), HAL_OK);
+    CHECK(!READ_BIT(USART3->CR3, USART_CR3_HDSEL));
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], Prepare("0!", 0)), HAL_OK);
+}
+
+/*
+ * Two buses run their transactions at the same time.
+ */
+static void Test_TwoBuses(void) {
+    static SDI12_Transaction_TypeDef transactions[2];
+    static char responses[2][MAX_RESPONSE_SIZE + 1];
+
+    Setup(1);
+    Sim_Bus_Init(&bus[1], &huart[1], UART4, 0, &htim[1], TIM7, GPIOA, 0x0001);
+    Sim_Sensor_Init(&sensors[1], '0');
+    Sim_Bus_AddSensor(&bus[1], &sensors[1]);
+    CHECK_EQ(SDI12_Init(&sdi12[1], &huart[1], &htim[1], GPIOA, 0x0001), HAL_OK);
+
+    uint64_t start = Sim_Now();
+    for (uint8_t i = 0; i < 2; i++) {
+        memset(&transactions[i], 0, sizeof(SDI12_Transaction_TypeDef));
+        transactions[i].Cmd = "0I!";
+        transactions[i].CmdLen = 3;
+        transactions[i].Response = responses[i];
+        transactions[i].ResponseLen = MAX_RESPONSE_SIZE;
+        CHECK_EQ(SDI12_Submit(&sdi12[i], &transactions[i]), HAL_OK);
+    }
+    Sim_RunUntilIdle();
+    uint64_t both = Sim_Now() - start;
+
+    start = Sim_Now();
+    CHECK_EQ(SDI12_Transfer(&sdi12[0], &transactions[0]), HAL_OK);
+    uint64_t one = Sim_Now() - start;
+
+    for (uint8_t i = 0; i < 2; i++) {
+        CHECK_EQ(transactions[i].Status, HAL_OK);
+        CHECK(strcmp(responses[i], "014SIMSDI12SENSOR100") == 0);
+        CHECK_EQ(sensors[i].Commands, 1 + (i == 0));
+    }
+    CHECK(both < one + 2 * SIM_NS_PER_MS);
+}
+
+int main(void) {
+    for (uint8_t dma = 0; dma <= 1; dma++) {
+        Test_States(dma);
+        Test_Overflow(dma);
+    }
+    Test_WakeWindow();
+    Test_Retries();
+    Test_Abort();
+    Test_HalfDuplex();
+    Test_TwoBuses();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ ******************************************************************************
+ * @file           : test_parser.c
+ * @brief          : Host tests of the streaming SDI-12 value parser.
+ ******************************************************************************
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12_parser.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+/*
+ * A response and the values it should give, Mantissa / 10^Decimals.
+ */
+typedef struct {
+    const char *Line;
+    uint8_t Count;
+    SDI12_Value_TypeDef Values[4];
+} Case_TypeDef;
+
+static const Case_TypeDef cases[] = {
+    { "0+3.14-12+0.005\r\n", 3, { { 314, 2 }, { -12, 0 }, { 5, 3 } } },
+    { "0+1.5-2OqZ\r\n", 2, { { 15, 1 }, { -2, 0 } } }, // CRC ends the last value
+    { "0\r\n", 0, { { 0 } } }, // Address only, no data (yet)
+    { "1+-7", 1, { { -7, 0 } } }, // Lone sign is not a value, no CR/LF
+    { "a+.5-0", 2, { { 5, 1 }, { 0, 0 } } },
+    { "0+1.2.3+4", 2, { { 12, 1 }, { 4, 0 } } }, // Second point ends the value
+    { "0+12345678901", 1, { { 123456789, 0 } } }, // Digits past 9 are dropped
+    { "0-9999999+0.000001\r\n", 2, { { -9999999, 0 }, { 1, 6 } } }
+};
+
+static void Check(const SDI12_Parser_TypeDef *parser, const SDI12_Value_TypeDef values[], const Case_TypeDef *c) {
+    CHECK_EQ(parser->Count, c->Count);
+    CHECK_EQ(parser->Overflow, 0);
+    for (uint8_t i = 0; i < c->Count && i < parser->Count; i++) {
+        CHECK_EQ(values[i].Mantissa, c->Values[i].Mantissa);
+        CHECK_EQ(values[i].Decimals, c->Values[i].Decimals);
+    }
+}
+
+static void Test_Cases(void) {
+    for (uint8_t n = 0; n < sizeof(cases) / sizeof(cases[0]); n++) {
+        const Case_TypeDef *c = &cases[n];
+        SDI12_Value_TypeDef values[SDI12_MAX_VALUES];
+        SDI12_Parser_TypeDef parser;
+        SDI12_Parser_Init(&parser, values, SDI12_MAX_VALUES);
+        for (const char *p = c->Line; *p != 0; p++) {
+            SDI12_Parser_Feed(&parser, *p);
+        }
+        SDI12_Parser_Finish(&parser);
+        Check(&parser, values, c);
+    }
+}
+
+/*
+ * Values add up over the lines of aD0!, aD1!... with Finish between them
+ * as SDI12_ReadValues(...) does, the next address is not a digit of the
+ * last value.
+ */
+static void Test_Lines(void) {
+    const char *lines[] = { "0+1.5-2", "0+3", "0\r\n" };
+    SDI12_Value_TypeDef values[SDI12_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, values, SDI12_MAX_VALUES);
+    for (uint8_t i = 0; i < 3; i++) {
+        for (const char *p = lines[i]; *p != 0; p++) {
+            SDI12_Parser_Feed(&parser, *p);
+        }
+        SDI12_Parser_Finish(&parser);
+    }
+
+    CHECK_EQ(parser.Count, 3);
+    CHECK_EQ(values[1].Mantissa, -2);
+    CHECK_EQ(values[2].Mantissa, 3);
+}
+
+static void Test_Overflow(void) {
+    SDI12_Value_TypeDef values[2];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, values, 2);
+    const char *line = "0+1+2+3\r\n";
+    for (const char *p = line; *p != 0; p++) {
+        SDI12_Parser_Feed(&parser, *p);
+    }
+
+    CHECK_EQ(parser.Count, 2);
+    CHECK_EQ(parser.Overflow, 1);
+    CHECK_EQ(values[1].Mantissa, 2);
+}
+
+static void Test_Float(void) {
+    const SDI12_Value_TypeDef values[] = { { 314, 2 }, { -5, 3 }, { 1234567, 0 }, { -1, 9 } };
+    const float expected[] = { 3.14f, -0.005f, 1234567.0f, -1e-9f };
+    for (uint8_t i = 0; i < 4; i++) {
+        float f = SDI12_ValueToFloat(&values[i]);
+        if (fabsf(f - expected[i]) > fabsf(expected[i]) * 1e-6f) {
+            printf("%s:%d: value %u is %g, expected %g\n", __FILE__, __LINE__, i, f, expected[i]);
+            failures++;
+        }
+    }
+}
+
+int main(void) {
+    Test_Cases();
+    Test_Lines();
+    Test_Overflow();
+    Test_Float();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,243 @@
+/*
+ ******************************************************************************
+ * @file           : test_scheduler.c
+ * @brief          : Host tests of the SDI-12 scheduler on the simulated bus.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12_scheduler.h"
+#include "sdi12_sim.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+#define POOL_SIZE 36
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static Sim_Sensor_TypeDef sensors[3];
+static SDI12_Scheduler_TypeDef scheduler;
+static SDI12_Value_TypeDef pool[POOL_SIZE];
+
+/*
+ * Sensors '0', '1' and '2' returning num_values[i] values, ttt 1 s.
+ */
+static void Setup(const uint16_t num_values[3]) {
+    static const float values[SIM_MAX_VALUES] = { 0 };
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus, &huart, USART3, 1, &htim, TIM6, GPIOC, 0x0010);
+    for (uint8_t i = 0; i < 3; i++) {
+        Sim_Sensor_Init(&sensors[i], (char) ('0' + i));
+        Sim_Sensor_SetValues(&sensors[i], values, num_values[i], 1);
+        Sim_Bus_AddSensor(&bus, &sensors[i]);
+    }
+    CHECK_EQ(SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010), HAL_OK);
+}
+
+/*
+ * Every sensor gets the share of the pool its aC! announced, one that
+ * announces more later gets a new one while the pool lasts.
+ */
+static void Test_Pool(void) {
+    const uint16_t counts[3] = { 3, 20, 6 };
+    Setup(counts);
+    SDI12_Scheduler_Init(&scheduler, &sdi12, NULL, pool, POOL_SIZE);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK_EQ(SDI12_Scheduler_Add(&scheduler, (char) ('0' + i)), HAL_OK);
+        CHECK_EQ(scheduler.Slots[i].Parser.Capacity, 0);
+    }
+
+    CHECK_EQ(SDI12_Scheduler_RunCycle(&scheduler), HAL_OK);
+    CHECK_EQ(scheduler.PoolUsed, 29);
+    for (uint8_t i = 0; i < 3; i++) {
+        const SDI12_Slot_TypeDef *slot = &scheduler.Slots[i];
+        CHECK_EQ(slot->State, SDI12_SLOT_DONE);
+        CHECK_EQ(slot->Parser.Capacity, counts[i]);
+        CHECK_EQ(slot->Parser.Count, counts[i]);
+    }
+    CHECK(scheduler.Slots[1].Parser.Values == &pool[3]);
+
+    // Same counts, nothing new is taken
+    CHECK_EQ(SDI12_Scheduler_RunCycle(&scheduler), HAL_OK);
+    CHECK_EQ(scheduler.PoolUsed, 29);
+
+    // '0' grows by one and fits, '2' grows past what is left
+    sensors[0].NumValues = 4;
+    sensors[2].NumValues = 7;
+    CHECK_EQ(SDI12_Scheduler_RunCycle(&scheduler), HAL_ERROR);
+    CHECK_EQ(scheduler.Slots[0].State, SDI12_SLOT_DONE);
+    CHECK_EQ(scheduler.Slots[0].Parser.Count, 4);
+    CHECK_EQ(scheduler.Slots[1].State, SDI12_SLOT_DONE);
+    CHECK_EQ(scheduler.Slots[2].State, SDI12_SLOT_ERROR);
+    CHECK_EQ(scheduler.Slots[2].Status, HAL_ERROR);
+    CHECK_EQ(scheduler.PoolUsed, 33);
+}
+
+/*
+ * A scheduler built on a filled cache reserves every share up front, a
+ * sensor that stops acknowledging aC! is dropped from the cache.
+ */
+static void Test_Cache(void) {
+    static SDI12_Cache_TypeDef cache;
+    const uint16_t counts[3] = { 3, 20, 6 };
+    Setup(counts);
+    SDI12_Cache_Init(&cache, &sdi12);
+    SDI12_Scheduler_Init(&scheduler, &sdi12, &cache, pool, POOL_SIZE);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK_EQ(SDI12_Cache_ExpectedValues(&cache, (char) ('0' + i)), 0);
+        SDI12_Scheduler_Add(&scheduler, (char) ('0' + i));
+    }
+    CHECK_EQ(SDI12_Scheduler_RunCycle(&scheduler), HAL_OK);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK_EQ(SDI12_Cache_ExpectedValues(&cache, (char) ('0' + i)), counts[i]);
+    }
+
+    SDI12_Scheduler_Init(&scheduler, &sdi12, &cache, pool, POOL_SIZE);
+    for (uint8_t i = 0; i < 3; i++) {
+        SDI12_Scheduler_Add(&scheduler, (char) ('0' + i));
+        CHECK_EQ(scheduler.Slots[i].Parser.Capacity, counts[i]);
+    }
+    CHECK_EQ(scheduler.PoolUsed, 29);
+
+    // No acknowledge
+    sensors[1].IgnorePermille = 1000;
+    CHECK_EQ(SDI12_Scheduler_RunCycle(&scheduler), HAL_ERROR);
+    CHECK_EQ(scheduler.Slots[1].State, SDI12_SLOT_ERROR);
+    CHECK(SDI12_Cache_Get(&cache, '1') == NULL);
+    CHECK_EQ(SDI12_Cache_ExpectedValues(&cache, '1'), 0);
+    CHECK(SDI12_Cache_Get(&cache, '0') != NULL);
+    CHECK(SDI12_Cache_Get(&cache, '2') != NULL);
+    CHECK_EQ(scheduler.PoolUsed, 29);
+}
+
+/*
+ * Sensors found on the bus are identified once and added once, the cache
+ * entry of one that leaves is dropped.
+ */
+static void Test_Discover(void) {
+    static SDI12_Cache_TypeDef cache;
+    const uint16_t counts[3] = { 1, 1, 1 };
+    Setup(counts);
+    sensors[2].Address = 'Z';
+    SDI12_Cache_Init(&cache, &sdi12);
+    SDI12_Scheduler_Init(&scheduler, &sdi12, &cache, pool, POOL_SIZE);
+
+    CHECK_EQ(SDI12_Scheduler_Discover(&scheduler), HAL_OK);
+    CHECK_EQ(scheduler.NumSlots, 3);
+    CHECK_EQ(scheduler.Slots[0].Address, '0');
+    CHECK_EQ(scheduler.Slots[1].Address, '1');
+    CHECK_EQ(scheduler.Slots[2].Address, 'Z');
+    for (uint8_t i = 0; i < 3; i++) {
+        const SDI12_CacheEntry_TypeDef *entry = SDI12_Cache_Get(&cache, sensors[i].Address);
+        CHECK(entry != NULL && (entry->Valid & SDI12_CACHE_ID));
+        CHECK(entry != NULL && strcmp(entry->Ident.Vendor, "SIMSDI12") == 0);
+        CHECK_EQ(sensors[i].Commands, 2); // a! and aI!
+    }
+
+    // '1' leaves the bus, nothing is added twice and aI! is not repeated
+    sensors[1].IgnorePermille = 1000;
+    CHECK_EQ(SDI12_Scheduler_Discover(&scheduler), HAL_OK);
+    CHECK_EQ(scheduler.NumSlots, 3);
+    CHECK(SDI12_Cache_Get(&cache, '1') == NULL);
+    CHECK_EQ(sensors[0].Commands, 3);
+    CHECK_EQ(sensors[2].Commands, 3);
+}
+
+/*
+ * The main loop of Core/Src/main.c for ms, sleeping until the next event.
+ */
+static void RunFor(const uint32_t ms) {
+    uint32_t end = HAL_GetTick() + ms;
+    while ((int32_t) (HAL_GetTick() - end) < 0) {
+        SDI12_Scheduler_Run(&scheduler);
+        uint32_t wait = SDI12_Scheduler_NextEvent(&scheduler);
+        uint32_t left = end - HAL_GetTick();
+        if (wait > 0 && (int32_t) left > 0) {
+            HAL_Delay((wait < left) ? wait : left);
+        }
+    }
+}
+
+/*
+ * Sensors at their own interval meet every deadline while the loop keeps
+ * up. A loop held up past ttt misses the collections, one held up past
+ * an interval misses the start too.
+ */
+static void Test_Deadlines(void) {
+    const uint16_t counts[3] = { 1, 2, 3 };
+    Setup(counts);
+    SDI12_Scheduler_Init(&scheduler, &sdi12, NULL, pool, POOL_SIZE);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK_EQ(SDI12_Scheduler_Add(&scheduler, (char) ('0' + i)), HAL_OK);
+    }
+    CHECK_EQ(SDI12_Scheduler_SetInterval(&scheduler, '0', 5000), HAL_OK);
+    CHECK_EQ(SDI12_Scheduler_SetInterval(&scheduler, '1', 10000), HAL_OK);
+    CHECK_EQ(SDI12_Scheduler_SetInterval(&scheduler, '2', 10000), HAL_OK);
+
+    RunFor(20000);
+    CHECK_EQ(scheduler.Missed, 0);
+    CHECK_EQ(scheduler.Slots[0].Samples, 4);
+    CHECK_EQ(scheduler.Slots[1].Samples, 2);
+    CHECK_EQ(scheduler.Slots[2].Samples, 2);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK_EQ(scheduler.Slots[i].Status, HAL_OK);
+        CHECK(scheduler.Slots[i].MaxCollectLateness <= SDI12_SCHEDULER_COLLECT_SLACK_MS);
+    }
+
+    // Start all three, then stay away 3 s
+    while (scheduler.Slots[0].State != SDI12_SLOT_MEASURING || scheduler.Slots[1].State != SDI12_SLOT_MEASURING
+            || scheduler.Slots[2].State != SDI12_SLOT_MEASURING) {
+        RunFor(1);
+    }
+    HAL_Delay(3000);
+    RunFor(1000);
+    CHECK_EQ(scheduler.Slots[0].Missed, 1);
+    CHECK_EQ(scheduler.Slots[1].Missed, 1);
+    CHECK_EQ(scheduler.Slots[2].Missed, 1);
+    CHECK_EQ(scheduler.Missed, 3);
+    for (uint8_t i = 0; i < 3; i++) {
+        CHECK(scheduler.Slots[i].MaxCollectLateness >= 2000);
+        CHECK_EQ(scheduler.Slots[i].Status, HAL_OK);
+    }
+
+    // '0' (5 s) is started a whole interval late
+    uint32_t samples = scheduler.Slots[0].Samples;
+    HAL_Delay(6000);
+    RunFor(2000);
+    CHECK_EQ(scheduler.Slots[0].Missed, 2);
+    CHECK(scheduler.Slots[0].MaxLateness >= 5000);
+    CHECK_EQ(scheduler.Slots[0].Samples, samples + 1);
+}
+
+int main(void) {
+    Test_Pool();
+    Test_Cache();
+    Test_Discover();
+    Test_Deadlines();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
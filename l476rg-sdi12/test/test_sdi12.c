@@ -0,0 +1,448 @@
+/*
+ ******************************************************************************
+ * @file           : test_sdi12.c
+ * @brief          : Host tests of the SDI-12 driver on the simulated bus.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12.h"
+#include "sdi12_stream.h"
+#include "sdi12_sim.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static Sim_Sensor_TypeDef sensors[2];
+
+/*
+ * Bus on USART3 (PC4) with TIM6 and sensors '0' and '1', receiving
+ * blocks by DMA if dma is set.
+ */
+static void Setup(const uint8_t dma) {
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus, &huart, USART3, dma, &htim, TIM6, GPIOC, 0x0010);
+    for (uint8_t i = 0; i < 2; i++) {
+        Sim_Sensor_Init(&sensors[i], (char) ('0' + i));
+        Sim_Bus_AddSensor(&bus, &sensors[i]);
+    }
+    CHECK_EQ(SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010), HAL_OK);
+}
+
+static void Test_Acknowledge(const uint8_t dma) {
+    Setup(dma);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_OK);
+    CHECK_EQ(sensors[0].Responses, 1);
+    CHECK_EQ(bus.Breaks, 1);
+    CHECK_EQ(bus.ParityErrors, 0);
+    CHECK_EQ(bus.Collisions, 0);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '5'), HAL_TIMEOUT);
+    CHECK_EQ(SDI12_GetAddressStats(&sdi12, '5')->Retries, SDI12_MAX_ATTEMPTS - 1);
+}
+
+/*
+ * Sensors at the two ends of the address space show up in the bitmap,
+ * nothing else does.
+ */
+static void Test_Discover(const uint8_t dma) {
+    Setup(dma);
+    sensors[1].Address = 'Z';
+
+    SDI12_AddressMap_TypeDef map;
+    uint32_t scan_time = 0;
+    uint64_t start = Sim_Now();
+    CHECK_EQ(SDI12_DiscoverDevices(&sdi12, &map, &scan_time), HAL_OK);
+    CHECK(map == ((1ULL << 0) | (1ULL << 61)));
+    CHECK_EQ(scan_time, (Sim_Now() - start) / SIM_NS_PER_MS);
+    CHECK_EQ(bus.Breaks, 1);
+    CHECK_EQ(bus.Commands, SDI12_NUM_ADDRESSES);
+    for (uint8_t i = 0; i < SDI12_NUM_ADDRESSES; i++) {
+        char addr = SDI12_AddressFromIndex(i);
+        CHECK_EQ(SDI12_AddressIndex(addr), i);
+        CHECK_EQ(SDI12_AddressMap_Test(&map, addr), addr == '0' || addr == 'Z');
+    }
+    CHECK_EQ(SDI12_AddressIndex('!'), -1);
+
+    SDI12_AddressMap_Clear(&map, 'Z');
+    CHECK(map == 1);
+
+    // Output is bounded by max
+    char devices[2] = { 0 };
+    CHECK_EQ(SDI12_DevicesOnBus(&sdi12, devices, 1), 1);
+    CHECK_EQ(devices[0], '0');
+    CHECK_EQ(devices[1], 0);
+    CHECK_EQ(SDI12_DevicesOnBus(&sdi12, devices, 2), 2);
+    CHECK_EQ(devices[1], 'Z');
+}
+
+static void Test_Identify(const uint8_t dma) {
+    Setup(dma);
+
+    char response[MAX_RESPONSE_SIZE + 1] = { 0 };
+    CHECK_EQ(SDI12_GetId(&sdi12, '1', response, MAX_RESPONSE_SIZE), HAL_OK);
+    CHECK(strcmp(response, "114SIMSDI12SENSOR100") == 0);
+}
+
+/*
+ * aM!, service request, then the values over two data lines.
+ */
+static void Test_Measure(const uint8_t dma) {
+    Setup(dma);
+    const float values[] = { 3.14f, -12.5f, 0.01f, 1234.5f, -0.25f, 20.0f, 7.0f };
+    Sim_Sensor_SetValues(&sensors[0], values, 7, 2);
+    sensors[0].Time = 2;
+    sensors[0].ReadyMs = 600;
+
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartMeasurement(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(info.Time, 2);
+    CHECK_EQ(info.NumValues, 7);
+
+    uint64_t start = Sim_Now();
+    CHECK_EQ(SDI12_WaitForServiceRequest(&sdi12, '0', &info), HAL_OK);
+    // Back on the service request, not at ttt
+    CHECK(Sim_Now() - start < 700 * SIM_NS_PER_MS);
+
+    SDI12_Value_TypeDef parsed[SDI12_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, parsed, SDI12_MAX_VALUES);
+    CHECK_EQ(SDI12_ReadValues(&sdi12, '0', &info, &parser), HAL_OK);
+    CHECK_EQ(parser.Count, 7);
+    for (uint8_t i = 0; i < parser.Count; i++) {
+        CHECK_EQ(parsed[i].Mantissa, (long) (values[i] * 100.0f + (values[i] < 0 ? -0.5f : 0.5f)));
+        CHECK_EQ(parsed[i].Decimals, 2);
+    }
+}
+
+/*
+ * aMC! data with a corrupted character fails its CRC and is asked for
+ * again, the parser only sees the good copy.
+ */
+static void Test_Crc(const uint8_t dma) {
+    Setup(dma);
+    const float values[] = { 3.14f, -12.5f, 0.01f };
+    Sim_Sensor_SetValues(&sensors[0], values, 3, 2);
+    sensors[0].Crc = 1;
+    sensors[0].Time = 0;
+
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartMeasurementCRC(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(info.UseCRC, 1);
+
+    // '3' of +3.14 becomes '0', parity and framing still fine
+    sensors[0].CorruptChar = 3;
+    SDI12_Value_TypeDef parsed[SDI12_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, parsed, SDI12_MAX_VALUES);
+    CHECK_EQ(SDI12_ReadValues(&sdi12, '0', &info, &parser), HAL_OK);
+    CHECK_EQ(sensors[0].Corrupted, 1);
+    CHECK_EQ(sensors[0].Responses, 3); // aMC!, aD0! twice
+    CHECK_EQ(parser.Count, 3);
+    CHECK_EQ(parsed[0].Mantissa, 314);
+    CHECK_EQ(parsed[2].Mantissa, 1);
+    CHECK_EQ(bus.ParityErrors, 0);
+}
+
+/*
+ * Data lines of 75 value characters, with and without a CRC, come in
+ * whole and leave nothing behind on the bus.
+ */
+static void Test_FullLines(const uint8_t dma) {
+    Setup(dma);
+    float values[20];
+    for (uint8_t i = 0; i < 20; i++) {
+        values[i] = 1.23f;
+    }
+    Sim_Sensor_SetValues(&sensors[0], values, 20, 2);
+    sensors[0].Crc = 1;
+    sensors[0].Time = 0;
+
+    // 15 values of +1.23 in aD0!, 5 in aD1!
+    static char data[10 * MAX_RESPONSE_SIZE + 1];
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartConcurrentMeasurementCRC(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(info.NumValues, 20);
+    CHECK_EQ(SDI12_SendData(&sdi12, '0', &info, data), HAL_OK);
+    CHECK_EQ(strlen(data), 20 * 5);
+    CHECK_EQ(sensors[0].Responses, 3);
+
+    Sim_Sensor_SetValues(&sensors[0], values, 15, 2);
+    CHECK_EQ(SDI12_StartConcurrentMeasurement(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(SDI12_SendData(&sdi12, '0', &info, data), HAL_OK);
+    CHECK_EQ(strlen(data), 15 * 5);
+    CHECK(strcmp(&data[14 * 5], "+1.23") == 0);
+
+    // 6 values of +1234567.50 per line, the last ones in aD9!
+    float wide[60];
+    for (uint8_t i = 0; i < 60; i++) {
+        wide[i] = 1234567.5f;
+    }
+    Sim_Sensor_SetValues(&sensors[0], wide, 60, 2);
+    CHECK_EQ(SDI12_StartConcurrentMeasurement(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(SDI12_SendData(&sdi12, '0', &info, data), HAL_OK);
+    CHECK_EQ(strlen(data), 60 * 11);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_OK);
+    CHECK_EQ(bus.Collisions, 0);
+    CHECK_EQ(SDI12_GetAddressStats(&sdi12, '0')->Failures, 0);
+}
+
+/*
+ * Full aC! lines go straight into the parser, more values than it can
+ * hold is an error.
+ */
+static void Test_Values(const uint8_t dma) {
+    Setup(dma);
+    float values[20];
+    for (uint8_t i = 0; i < 20; i++) {
+        values[i] = (i % 2) ? -1.25f : 1.25f;
+    }
+    Sim_Sensor_SetValues(&sensors[0], values, 20, 2);
+    sensors[0].Time = 0;
+
+    SDI12_Measure_TypeDef info = { 0 };
+    SDI12_Value_TypeDef parsed[SDI12_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    CHECK_EQ(SDI12_StartConcurrentMeasurement(&sdi12, '0', &info), HAL_OK);
+    SDI12_Parser_Init(&parser, parsed, info.NumValues);
+    CHECK_EQ(SDI12_ReadValues(&sdi12, '0', &info, &parser), HAL_OK);
+    CHECK_EQ(parser.Count, 20);
+    CHECK_EQ(parser.Overflow, 0);
+    CHECK_EQ(parsed[19].Mantissa, -125);
+
+    CHECK_EQ(SDI12_StartConcurrentMeasurement(&sdi12, '0', &info), HAL_OK);
+    SDI12_Parser_Init(&parser, parsed, 19);
+    CHECK_EQ(SDI12_ReadValues(&sdi12, '0', &info, &parser), HAL_ERROR);
+    CHECK_EQ(parser.Overflow, 1);
+}
+
+/*
+ * A full aR0! line of the shortest values, with and without CRC, fits a
+ * stream sample. One value more than the parser holds is an error.
+ */
+static void Test_Continuous(const uint8_t dma) {
+    static SDI12_Stream_TypeDef stream;
+    Setup(dma);
+    float values[SDI12_STREAM_MAX_VALUES];
+    for (uint8_t i = 0; i < SDI12_STREAM_MAX_VALUES; i++) {
+        values[i] = (float) (i % 10);
+    }
+    Sim_Sensor_SetValues(&sensors[0], values, SDI12_STREAM_MAX_VALUES, 0);
+    sensors[0].Continuous = 1;
+    sensors[0].Crc = 1;
+
+    SDI12_Stream_Init(&stream, &sdi12, 0);
+    CHECK_EQ(SDI12_Stream_AddChannel(&stream, '0', 0, 0), HAL_OK);
+    CHECK_EQ(SDI12_Stream_AddChannel(&stream, '0', 0, 1), HAL_OK);
+    SDI12_Stream_Start(&stream);
+    CHECK_EQ(SDI12_Stream_Poll(&stream), 2);
+
+    SDI12_Sample_TypeDef sample;
+    for (uint8_t crc = 0; crc <= 1; crc++) {
+        CHECK_EQ(SDI12_Stream_Read(&stream, &sample), 1);
+        CHECK_EQ(sample.Count, SDI12_STREAM_MAX_VALUES);
+        CHECK_EQ(sample.Values[SDI12_STREAM_MAX_VALUES - 1].Mantissa, (SDI12_STREAM_MAX_VALUES - 1) % 10);
+    }
+    CHECK_EQ(stream.Stats.Errors, 0);
+
+    SDI12_Value_TypeDef parsed[SDI12_STREAM_MAX_VALUES];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, parsed, SDI12_STREAM_MAX_VALUES - 1);
+    CHECK_EQ(SDI12_ReadContinuous(&sdi12, '0', 0, 0, &parser), HAL_ERROR);
+    CHECK_EQ(parser.Overflow, 1);
+}
+
+/*
+ * aHB! packets are 8N1, bytes with the MSB set or an odd number of bits
+ * set must come through as they are, then ASCII (7E1) works again.
+ */
+static void Test_Binary(const uint8_t dma) {
+    Setup(dma);
+    // 0xffff, 0x0181, 0x8000, 0x00c8, 0x0001, 0x7fff
+    const float values[] = { -1.0f, 385.0f, -32768.0f, 200.0f, 1.0f, 32767.0f };
+    Sim_Sensor_SetValues(&sensors[0], values, 6, 0);
+    sensors[0].HighVolume = 1;
+    sensors[0].BinaryType = SDI12_BINARY_INT16;
+    sensors[0].PacketValues = 4;
+
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartHighVolumeBinary(&sdi12, '0', &info), HAL_OK);
+    CHECK_EQ(info.NumValues, 6);
+    Sim_RunFor(info.Time * 1000 * SIM_NS_PER_MS);
+
+    static SDI12_BinaryPacket_TypeDef packet;
+    CHECK_EQ(SDI12_ReadBinaryPacket(&sdi12, '0', 0, &packet), HAL_OK);
+    const uint8_t expected[] = { '0', 8, 0, SDI12_BINARY_INT16, 0xff, 0xff, 0x81, 0x01, 0x00, 0x80, 0xc8, 0x00 };
+    CHECK_EQ(packet.Length, sizeof(expected) + SDI12_BINARY_CRC_SIZE);
+    CHECK(memcmp(packet.Data, expected, sizeof(expected)) == 0);
+    CHECK_EQ(packet.NumValues, 4);
+
+    float received[8];
+    uint16_t count = 0;
+    CHECK_EQ(SDI12_ReadBinaryValues(&sdi12, '0', &info, &packet, received, 8, &count), HAL_OK);
+    CHECK_EQ(count, 6);
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK_EQ(received[i], values[i]);
+    }
+    CHECK_EQ(bus.ParityErrors, 0);
+
+    char response[MAX_RESPONSE_SIZE + 1] = { 0 };
+    CHECK_EQ(SDI12_GetId(&sdi12, '0', response, MAX_RESPONSE_SIZE), HAL_OK);
+    CHECK(strcmp(response, "014SIMSDI12SENSOR100") == 0);
+}
+
+/*
+ * A sensor that drops every character looks absent, one that ignores
+ * some commands is reached through the retries.
+ */
+static void Test_Lossy(void) {
+    Setup(1);
+    sensors[0].DropPermille = 1000;
+    CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_TIMEOUT);
+    CHECK_EQ(sensors[0].Responses, SDI12_MAX_ATTEMPTS);
+
+    sensors[1].IgnorePermille = 500;
+    for (uint8_t i = 0; i < 20; i++) {
+        CHECK_EQ(SDI12_AckActive(&sdi12, '1'), HAL_OK);
+    }
+    CHECK(sensors[1].Ignored > 0);
+    CHECK_EQ(SDI12_GetAddressStats(&sdi12, '1')->Retries, sensors[1].Ignored);
+}
+
+/*
+ * Every payload type over the wire, extremes of each range.
+ */
+static void Test_BinaryTypes(const uint8_t dma) {
+    static const struct {
+        SDI12_BinaryType_TypeDef Type;
+        float Values[3];
+    } cases[] = {
+        { SDI12_BINARY_INT8, { -128.0f, 127.0f, -1.0f } },
+        { SDI12_BINARY_UINT8, { 0.0f, 255.0f, 128.0f } },
+        { SDI12_BINARY_INT16, { -32768.0f, 32767.0f, -1.0f } },
+        { SDI12_BINARY_UINT16, { 0.0f, 65535.0f, 32768.0f } },
+        { SDI12_BINARY_INT32, { -2147483648.0f, 16777216.0f, -1.0f } },
+        { SDI12_BINARY_UINT32, { 0.0f, 4000000000.0f, 2147483648.0f } },
+        { SDI12_BINARY_FLOAT32, { -1.5f, 3.4e38f, 1e-6f } },
+        { SDI12_BINARY_FLOAT64, { -1.5f, 3.4e38f, 1e-6f } },
+    };
+    static SDI12_BinaryPacket_TypeDef packet;
+
+    for (uint8_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        Setup(dma);
+        Sim_Sensor_SetValues(&sensors[0], cases[c].Values, 3, 0);
+        sensors[0].HighVolume = 1;
+        sensors[0].BinaryType = cases[c].Type;
+
+        SDI12_Measure_TypeDef info = { 0 };
+        CHECK_EQ(SDI12_StartHighVolumeBinary(&sdi12, '0', &info), HAL_OK);
+        Sim_RunFor(info.Time * 1000 * SIM_NS_PER_MS);
+        CHECK_EQ(SDI12_ReadBinaryPacket(&sdi12, '0', 0, &packet), HAL_OK);
+        CHECK_EQ(packet.Type, cases[c].Type);
+        CHECK_EQ(packet.NumValues, 3);
+        CHECK_EQ(packet.PayloadSize, 3 * SDI12_Binary_TypeSize(cases[c].Type));
+
+        float received[3];
+        CHECK_EQ(SDI12_Binary_ToFloat(&packet, received, 3), 3);
+        for (uint8_t i = 0; i < 3; i++) {
+            CHECK(received[i] == cases[c].Values[i]);
+            CHECK(SDI12_Binary_GetDouble(&packet, i) == (double) cases[c].Values[i]);
+            if (cases[c].Type < SDI12_BINARY_FLOAT32) {
+                CHECK(SDI12_Binary_GetInt(&packet, i) == (int64_t) cases[c].Values[i]);
+            }
+        }
+    }
+    CHECK_EQ(bus.ParityErrors, 0);
+}
+
+/*
+ * Append the CRC of the first len bytes.
+ */
+static void Seal(SDI12_BinaryPacket_TypeDef *packet, const uint16_t len) {
+    uint16_t crc = SDI12_CRC16((const char*) packet->Data, len);
+    packet->Data[len] = crc & 0xff;
+    packet->Data[len + 1] = crc >> 8;
+}
+
+/*
+ * Packets that must not decode.
+ */
+static void Test_BinaryErrors(void) {
+    static SDI12_BinaryPacket_TypeDef packet;
+    const uint8_t header[] = { '0', 4, 0, SDI12_BINARY_INT16, 0x01, 0x00, 0xff, 0x7f };
+
+    // Well formed
+    memcpy(packet.Data, header, sizeof(header));
+    Seal(&packet, sizeof(header));
+    packet.Length = sizeof(header) + SDI12_BINARY_CRC_SIZE;
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_OK);
+    CHECK_EQ(packet.NumValues, 2);
+    CHECK_EQ(SDI12_Binary_GetInt(&packet, 1), 32767);
+
+    // Unknown type, CRC made to match
+    packet.Data[3] = SDI12_BINARY_FLOAT64 + 1;
+    Seal(&packet, sizeof(header));
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_ERROR);
+
+    // Payload not a whole number of values
+    packet.Data[3] = SDI12_BINARY_INT64;
+    Seal(&packet, sizeof(header));
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_ERROR);
+
+    // Size field and bytes received disagree
+    packet.Data[3] = SDI12_BINARY_INT16;
+    Seal(&packet, sizeof(header));
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_OK);
+    packet.Length--;
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_ERROR);
+    packet.Length += 2;
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_ERROR);
+    packet.Length = 5;
+    CHECK_EQ(SDI12_Binary_Decode(&packet), HAL_ERROR);
+}
+
+int main(void) {
+    for (uint8_t dma = 0; dma <= 1; dma++) {
+        Test_Acknowledge(dma);
+        Test_Discover(dma);
+        Test_Identify(dma);
+        Test_Measure(dma);
+        Test_Crc(dma);
+        Test_FullLines(dma);
+        Test_Values(dma);
+        Test_Continuous(dma);
+        Test_Binary(dma);
+        Test_BinaryTypes(dma);
+    }
+    Test_BinaryErrors();
+    Test_Lossy();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ ******************************************************************************
+ * @file           : test_sensor.c
+ * @brief          : Host tests of the sensor mode (sdi12_sensor.c) answering
+ *            the driver's own recorder on the simulated bus.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sdi12.h"
+#include "sdi12_sensor.h"
+#include "sdi12_sim.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+/*
+ * The spec gives a sensor 15 ms from the end of the command to the start
+ * of its response, the marking alone is 8.33 ms.
+ */
+#define CHECK_RESPONSE_TIME() do { \
+    CHECK(bus.ResponseStart >= bus.CmdEnd + SIM_CHAR_NS); \
+    CHECK(bus.ResponseStart <= bus.CmdEnd + 15 * SIM_NS_PER_MS); \
+} while (0)
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static UART_HandleTypeDef huart_sensor;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static SDI12_Sensor_TypeDef sensor;
+static char measure_type;
+
+static void MeasureCallback(SDI12_Sensor_TypeDef *s, const char type) {
+    (void) s;
+    measure_type = type;
+}
+
+/*
+ * Recorder on USART3 and the board as sensor '3' on USART1, same wire.
+ */
+static void Setup(const uint8_t dma) {
+    Sim_Reset(1);
+    Sim_Bus_Init(&bus, &huart, USART3, dma, &htim, TIM6, GPIOC, 0x0010);
+    Sim_Bus_AddDevice(&bus, &huart_sensor, USART1);
+    CHECK_EQ(SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010), HAL_OK);
+
+    CHECK_EQ(SDI12_Sensor_Init(&sensor, &huart_sensor, '3'), HAL_OK);
+    SDI12_Sensor_SetIdentification(&sensor, "14STM32L4 SDI12 001");
+    SDI12_Sensor_SetMeasurement(&sensor, 1, 3);
+    sensor.MeasureCallback = MeasureCallback;
+    measure_type = 0;
+}
+
+static void Test_Acknowledge(const uint8_t dma) {
+    Setup(dma);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '3'), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(sensor.Breaks, 1);
+    CHECK_EQ(sensor.Commands, 1);
+
+    // Not its address
+    CHECK_EQ(SDI12_AckActive(&sdi12, '4'), HAL_TIMEOUT);
+    CHECK(sensor.Ignored > 0);
+    CHECK_EQ(bus.Collisions, 0);
+    CHECK_EQ(bus.ParityErrors, 0);
+}
+
+static void Test_Identify(const uint8_t dma) {
+    Setup(dma);
+
+    char response[MAX_RESPONSE_SIZE + 1] = { 0 };
+    CHECK_EQ(SDI12_GetId(&sdi12, '3', response, MAX_RESPONSE_SIZE), HAL_OK);
+    CHECK(strcmp(response, "314STM32L4 SDI12 001") == 0);
+    CHECK_RESPONSE_TIME();
+}
+
+/*
+ * aM! with ttt, the service request goes out once the application hands
+ * the values over, then aD0!.
+ */
+static void Test_Measure(const uint8_t dma) {
+    Setup(dma);
+
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartMeasurement(&sdi12, '3', &info), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(info.Address, '3');
+    CHECK_EQ(info.Time, 1);
+    CHECK_EQ(info.NumValues, 3);
+    CHECK_EQ(measure_type, 'M');
+    CHECK_EQ(sensor.ServiceRequest, 1);
+
+    // Values ready halfway through ttt
+    Sim_RunFor(500 * SIM_NS_PER_MS);
+    uint64_t start = Sim_Now();
+    SDI12_Sensor_SetData(&sensor, "+21.50+1013.2-3");
+    CHECK_EQ(SDI12_WaitForServiceRequest(&sdi12, '3', &info), HAL_OK);
+    CHECK(Sim_Now() - start < 100 * SIM_NS_PER_MS);
+    CHECK_EQ(sensor.ServiceRequest, 0);
+
+    SDI12_Value_TypeDef parsed[3];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, parsed, 3);
+    CHECK_EQ(SDI12_ReadValues(&sdi12, '3', &info, &parser), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(parser.Count, 3);
+    CHECK_EQ(parsed[0].Mantissa, 2150);
+    CHECK_EQ(parsed[1].Mantissa, 10132);
+    CHECK_EQ(parsed[2].Mantissa, -3);
+}
+
+/*
+ * aC!, then a full 75 character data line by aD0! and by aR0!.
+ */
+static void Test_Concurrent(const uint8_t dma) {
+    Setup(dma);
+    char data[MAX_RESPONSE_SIZE + 1] = { 0 };
+    for (uint8_t i = 0; i < 15; i++) {
+        strcat(data, "+1.23");
+    }
+    SDI12_Sensor_SetMeasurement(&sensor, 0, 15);
+    SDI12_Sensor_SetData(&sensor, data);
+
+    SDI12_Measure_TypeDef info = { 0 };
+    CHECK_EQ(SDI12_StartConcurrentMeasurement(&sdi12, '3', &info), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(info.Time, 0);
+    CHECK_EQ(info.NumValues, 15);
+    CHECK_EQ(measure_type, 'C');
+    CHECK_EQ(sensor.ServiceRequest, 0);
+
+    char received[SDI12_DATA_LINE_SIZE * 10] = { 0 };
+    CHECK_EQ(SDI12_SendData(&sdi12, '3', &info, received), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(strlen(received), 75);
+    CHECK(strcmp(received, data) == 0);
+
+    SDI12_Value_TypeDef parsed[15];
+    SDI12_Parser_TypeDef parser;
+    SDI12_Parser_Init(&parser, parsed, 15);
+    CHECK_EQ(SDI12_ReadContinuous(&sdi12, '3', 0, 0, &parser), HAL_OK);
+    CHECK_RESPONSE_TIME();
+    CHECK_EQ(parser.Count, 15);
+    CHECK_EQ(parsed[14].Mantissa, 123);
+
+    // Not supported
+    SDI12_Parser_Init(&parser, parsed, 15);
+    CHECK_EQ(SDI12_ReadContinuous(&sdi12, '3', 1, 0, &parser), HAL_TIMEOUT);
+    CHECK_EQ(bus.Collisions, 0);
+    CHECK_EQ(bus.ParityErrors, 0);
+}
+
+int main(void) {
+    for (uint8_t dma = 0; dma <= 1; dma++) {
+        Test_Acknowledge(dma);
+        Test_Identify(dma);
+        Test_Measure(dma);
+        Test_Concurrent(dma);
+    }
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,267 @@
+/*
+ ******************************************************************************
+ * @file           : test_trace.c
+ * @brief          : Host tests of the transaction trace (sdi12_trace.c, built
+ *            with SDI12_TRACE) and its SDT1 decoder (tools/sdt1.c).
+ ******************************************************************************
+ * DWT->CYCCNT counts simulated time here, so the phases of a dump can be
+ * checked against the timing the simulated bus saw.
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdi12.h"
+#include "sdi12_trace.h"
+#include "SDI12_debug.h"
+#include "sdi12_sim.h"
+#include "sdt1.h"
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected) do { \
+    long a_ = (long) (actual), e_ = (long) (expected); \
+    if (a_ != e_) { \
+        printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, a_, e_); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+        failures++; \
+    } \
+} while (0)
+
+/*
+ * A record's time since start matches the bus to within a microsecond.
+ */
+#define CHECK_AT(record, start_ns, expected_ns) do { \
+    long long ns_ = (long long) Cycles_Ns((record)->Cycles - first) - (long long) ((expected_ns) - (start_ns)); \
+    if (ns_ < -1000 || ns_ > 1000) { \
+        printf("%s:%d: %s is %lld ns off\n", __FILE__, __LINE__, #record, ns_); \
+        failures++; \
+    } \
+} while (0)
+
+static SDI12_TypeDef sdi12;
+static UART_HandleTypeDef huart;
+static TIM_HandleTypeDef htim;
+static Sim_Bus_TypeDef bus;
+static Sim_Sensor_TypeDef sensors[2];
+
+// What SDI12_Trace_Dump() sent over the "debug link"
+static uint8_t capture[4096];
+static size_t captured;
+
+void debug_output(uint8_t *data, uint8_t size) {
+    if (captured + size <= sizeof(capture)) {
+        memcpy(&capture[captured], data, size);
+        captured += size;
+    }
+}
+
+static uint64_t Cycles_Ns(const uint32_t cycles) {
+    return (uint64_t) cycles * 1000000000ULL / SystemCoreClock;
+}
+
+static void Setup(const uint8_t dma) {
+    Sim_Reset(1);
+    Sim_SimulatedCycles(1);
+    Sim_Bus_Init(&bus, &huart, USART3, dma, &htim, TIM6, GPIOC, 0x0010);
+    Sim_Sensor_Init(&sensors[0], '0');
+    Sim_Sensor_Init(&sensors[1], '5');
+    sensors[1].ResponseDelayUs = 14000;
+    Sim_Bus_AddSensor(&bus, &sensors[0]);
+    Sim_Bus_AddSensor(&bus, &sensors[1]);
+    CHECK_EQ(SDI12_Init(&sdi12, &huart, &htim, GPIOC, 0x0010), HAL_OK);
+
+    // Nothing left over from the last test
+    SDI12_Trace_Dump();
+    captured = 0;
+}
+
+/*
+ * a! gives one record per phase, at the times the bus saw them.
+ */
+static void Test_Phases(const uint8_t dma) {
+    Setup(dma);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_OK);
+    uint64_t complete = Sim_Now();
+    CHECK_EQ(SDI12_Trace_Available(), 5);
+
+    SDI12_Trace_Dump();
+    CHECK_EQ(SDI12_Trace_Available(), 0);
+    CHECK_EQ(captured, SDT1_HEADER_SIZE + 5 * sizeof(SDI12_TraceRecord_TypeDef));
+
+    SDT1_Dump_TypeDef dump;
+    CHECK_EQ(SDT1_Decode(capture, captured, &dump), (long) captured);
+    CHECK_EQ(dump.Clock, SystemCoreClock);
+    CHECK_EQ(dump.Count, 5);
+    if (dump.Count != 5) {
+        SDT1_Free(&dump);
+        return;
+    }
+
+    const SDI12_TraceEvent_TypeDef order[] = { SDI12_TRACE_BREAK, SDI12_TRACE_MARKING, SDI12_TRACE_TX_DONE,
+            SDI12_TRACE_FIRST_BYTE, SDI12_TRACE_COMPLETE };
+    for (uint8_t i = 0; i < 5; i++) {
+        CHECK_EQ(dump.Records[i].Event, order[i]);
+        CHECK_EQ(dump.Records[i].Bus, sdi12.Number);
+        CHECK_EQ(dump.Records[i].Address, '0');
+    }
+    CHECK_EQ(dump.Records[4].Detail, HAL_OK);
+
+    uint32_t first = dump.Records[0].Cycles;
+    uint64_t start = bus.BreakEnd - bus.BreakNs;
+    CHECK_AT(&dump.Records[1], start, bus.BreakEnd);
+    CHECK_AT(&dump.Records[2], start, bus.CmdEnd);
+    // Received once the first character is in
+    CHECK_AT(&dump.Records[3], start, bus.ResponseStart + SIM_CHAR_NS);
+    CHECK_AT(&dump.Records[4], start, complete);
+    SDT1_Free(&dump);
+}
+
+/*
+ * An unanswered address is retried, each retry is recorded with its
+ * attempt and the transaction ends in HAL_TIMEOUT.
+ */
+static void Test_Retry(const uint8_t dma) {
+    Setup(dma);
+
+    CHECK_EQ(SDI12_AckActive(&sdi12, '7'), HAL_TIMEOUT);
+    SDI12_Trace_Dump();
+
+    SDT1_Dump_TypeDef dump;
+    CHECK(SDT1_Decode(capture, captured, &dump) > 0);
+    uint8_t retries = 0, breaks = 0;
+    for (uint16_t i = 0; i < dump.Count; i++) {
+        const SDI12_TraceRecord_TypeDef *record = &dump.Records[i];
+        CHECK_EQ(record->Address, '7');
+        CHECK(record->Event != SDI12_TRACE_FIRST_BYTE);
+        if (record->Event == SDI12_TRACE_RETRY) {
+            retries++;
+            CHECK_EQ(record->Detail, retries);
+            CHECK(i > 0 && dump.Records[i - 1].Event == SDI12_TRACE_TX_DONE);
+        }
+        breaks += (record->Event == SDI12_TRACE_BREAK);
+    }
+    CHECK_EQ(retries, SDI12_MAX_ATTEMPTS - 1);
+    CHECK_EQ(breaks, bus.Breaks);
+    CHECK(dump.Count > 0 && dump.Records[dump.Count - 1].Event == SDI12_TRACE_COMPLETE);
+    CHECK(dump.Count > 0 && dump.Records[dump.Count - 1].Detail == HAL_TIMEOUT);
+    SDT1_Free(&dump);
+}
+
+/*
+ * Histograms of a few rounds over two sensors and an absent address, from
+ * two dumps.
+ */
+static void Test_Histogram(const uint8_t dma) {
+    Setup(dma);
+
+    static SDT1_Histogram_TypeDef histogram;
+    SDT1_Histogram_Init(&histogram);
+    for (uint8_t dumps = 0; dumps < 2; dumps++) {
+        for (uint8_t round = 0; round < 5; round++) {
+            CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_OK);
+            CHECK_EQ(SDI12_AckActive(&sdi12, '5'), HAL_OK);
+        }
+        captured = 0;
+        SDI12_Trace_Dump();
+
+        SDT1_Dump_TypeDef dump;
+        CHECK_EQ(SDT1_Decode(capture, captured, &dump), (long) captured);
+        SDT1_Add(&histogram, &dump);
+        SDT1_Free(&dump);
+    }
+    CHECK_EQ(SDI12_AckActive(&sdi12, '7'), HAL_TIMEOUT);
+    captured = 0;
+    SDI12_Trace_Dump();
+    SDT1_Dump_TypeDef dump;
+    CHECK(SDT1_Decode(capture, captured, &dump) > 0);
+    SDT1_Add(&histogram, &dump);
+    SDT1_Free(&dump);
+
+    CHECK_EQ(histogram.NumSensors, 3);
+    SDT1_Sensor_TypeDef *s0 = SDT1_Sensor(&histogram, sdi12.Number, '0');
+    SDT1_Sensor_TypeDef *s5 = SDT1_Sensor(&histogram, sdi12.Number, '5');
+    SDT1_Sensor_TypeDef *s7 = SDT1_Sensor(&histogram, sdi12.Number, '7');
+    CHECK_EQ(s0->Transactions, 10);
+    CHECK_EQ(s0->Errors, 0);
+    CHECK_EQ(s0->Retries, 0);
+    CHECK_EQ(s5->Transactions, 10);
+    CHECK_EQ(s0->Count[SDT1_PHASE_BREAK] + s5->Count[SDT1_PHASE_BREAK], bus.Breaks - s7->Count[SDT1_PHASE_BREAK]);
+    for (uint8_t p = SDT1_PHASE_COMMAND; p < SDT1_NUM_PHASES; p++) {
+        CHECK_EQ(s0->Count[p], 10);
+        CHECK_EQ(s5->Count[p], 10);
+    }
+
+    // The sensor's own delay plus its first character
+    uint32_t latency0 = (uint32_t) ((sensors[0].ResponseDelayUs * SIM_NS_PER_US + SIM_CHAR_NS) / SIM_NS_PER_US);
+    uint32_t latency5 = (uint32_t) ((sensors[1].ResponseDelayUs * SIM_NS_PER_US + SIM_CHAR_NS) / SIM_NS_PER_US);
+    CHECK(s0->MinUs[SDT1_PHASE_LATENCY] + 2 >= latency0 && s0->MaxUs[SDT1_PHASE_LATENCY] <= latency0 + 2);
+    CHECK(s5->MinUs[SDT1_PHASE_LATENCY] + 2 >= latency5 && s5->MaxUs[SDT1_PHASE_LATENCY] <= latency5 + 2);
+    CHECK_EQ(s5->Bins[SDT1_PHASE_LATENCY][SDT1_Bin(latency5)], 10);
+
+    CHECK_EQ(s7->Transactions, 1);
+    CHECK_EQ(s7->Errors, 1);
+    CHECK_EQ(s7->Retries, SDI12_MAX_ATTEMPTS - 1);
+    CHECK_EQ(s7->Count[SDT1_PHASE_LATENCY], 0);
+    CHECK_EQ(s7->Count[SDT1_PHASE_LINE], 0);
+}
+
+/*
+ * Dumps among other debug output, one cut off.
+ */
+static void Test_Decode(void) {
+    Setup(0);
+    const char *text = "cycle 12 missed SDT\n";
+    memcpy(capture, text, strlen(text));
+    captured = strlen(text);
+    CHECK_EQ(SDI12_AckActive(&sdi12, '0'), HAL_OK);
+    SDI12_Trace_Dump();
+    size_t first_end = captured;
+    CHECK_EQ(SDI12_AckActive(&sdi12, '5'), HAL_OK);
+    SDI12_Trace_Dump();
+    size_t second_end = captured;
+
+    SDT1_Dump_TypeDef dump;
+    CHECK_EQ(SDT1_Decode(capture, captured, &dump), (long) first_end);
+    CHECK_EQ(dump.Count, 5);
+    CHECK(dump.Count > 0 && dump.Records[0].Address == '0');
+    SDT1_Free(&dump);
+    CHECK_EQ(SDT1_Decode(&capture[first_end], captured - first_end, &dump), (long) (second_end - first_end));
+    CHECK(dump.Count > 0 && dump.Records[0].Address == '5');
+    SDT1_Free(&dump);
+
+    // Last record cut off
+    CHECK_EQ(SDT1_Decode(&capture[first_end], captured - first_end - 1, &dump), -1);
+    CHECK_EQ(SDT1_Decode((const uint8_t*) text, strlen(text), &dump), -1);
+
+    CHECK_EQ(SDT1_Bin(0), 0);
+    CHECK_EQ(SDT1_Bin(1), 0);
+    CHECK_EQ(SDT1_Bin(2), 1);
+    CHECK_EQ(SDT1_Bin(8333), 13);
+    CHECK_EQ(SDT1_Bin(UINT32_MAX), SDT1_BINS - 1);
+}
+
+int main(void) {
+    for (uint8_t dma = 0; dma <= 1; dma++) {
+        Test_Phases(dma);
+        Test_Retry(dma);
+        Test_Histogram(dma);
+    }
+    Test_Decode();
+
+    if (failures > 0) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ ******************************************************************************
+ * @file           : sdt1.c
+ * @brief          : Host decoder of the SDI12_Trace_Dump() format ("SDT1").
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdt1.h"
+
+static uint32_t SDT1_Read32(const uint8_t *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/*
+ * Decode the first complete dump in data. Returns the offset just past
+ * it, to look for the next one from there, or -1 if there is none.
+ */
+long SDT1_Decode(const uint8_t *data, const size_t len, SDT1_Dump_TypeDef *dump) {
+    memset(dump, 0, sizeof(*dump));
+
+    for (size_t i = 0; i + SDT1_HEADER_SIZE <= len; i++) {
+        if (memcmp(&data[i], "SDT1", 4) != 0) {
+            continue;
+        }
+        const uint8_t *header = &data[i];
+        uint16_t count = (uint16_t) (header[4] | (header[5] << 8));
+        size_t size = SDT1_HEADER_SIZE + (size_t) count * sizeof(SDI12_TraceRecord_TypeDef);
+        if (i + size > len) {
+            continue; // Cut off, or "SDT1" in other output
+        }
+
+        dump->Clock = SDT1_Read32(&header[6]);
+        dump->Count = count;
+        dump->Records = calloc((count > 0) ? count : 1, sizeof(SDI12_TraceRecord_TypeDef));
+        if (dump->Records == NULL) {
+            return -1;
+        }
+        const uint8_t *p = &header[SDT1_HEADER_SIZE];
+        for (uint16_t r = 0; r < count; r++, p += sizeof(SDI12_TraceRecord_TypeDef)) {
+            dump->Records[r].Cycles = SDT1_Read32(p);
+            dump->Records[r].Event = p[4];
+            dump->Records[r].Bus = p[5];
+            dump->Records[r].Address = (char) p[6];
+            dump->Records[r].Detail = p[7];
+        }
+        return (long) (i + size);
+    }
+    return -1;
+}
+
+void SDT1_Free(SDT1_Dump_TypeDef *dump) {
+    free(dump->Records);
+    dump->Records = NULL;
+    dump->Count = 0;
+}
+
+void SDT1_Histogram_Init(SDT1_Histogram_TypeDef *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+/*
+ * Entry of a sensor, added on first use. NULL once SDT1_MAX_SENSORS are
+ * taken.
+ */
+SDT1_Sensor_TypeDef* SDT1_Sensor(SDT1_Histogram_TypeDef *histogram, const uint8_t bus, const char addr) {
+    for (uint8_t i = 0; i < histogram->NumSensors; i++) {
+        if (histogram->Sensors[i].Bus == bus && histogram->Sensors[i].Address == addr) {
+            return &histogram->Sensors[i];
+        }
+    }
+    if (histogram->NumSensors >= SDT1_MAX_SENSORS) {
+        return NULL;
+    }
+
+    SDT1_Sensor_TypeDef *sensor = &histogram->Sensors[histogram->NumSensors++];
+    memset(sensor, 0, sizeof(*sensor));
+    sensor->Bus = bus;
+    sensor->Address = addr;
+    for (uint8_t p = 0; p < SDT1_NUM_PHASES; p++) {
+        sensor->MinUs[p] = UINT32_MAX;
+    }
+    return sensor;
+}
+
+uint8_t SDT1_Bin(const uint32_t us) {
+    uint8_t bin = 0;
+    while ((us >> (bin + 1)) != 0 && bin < SDT1_BINS - 1) {
+        bin++;
+    }
+    return bin;
+}
+
+const char* SDT1_PhaseName(const SDT1_Phase_TypeDef phase) {
+    static const char *names[SDT1_NUM_PHASES] = { "break", "command", "latency", "line" };
+    return (phase < SDT1_NUM_PHASES) ? names[phase] : "?";
+}
+
+/*
+ * Close phase on record, if it was started on the same bus.
+ */
+static void SDT1_EndPhase(SDT1_Histogram_TypeDef *histogram, const SDI12_TraceRecord_TypeDef *record,
+        const SDT1_Phase_TypeDef phase) {
+    SDT1_Bus_TypeDef *bus = &histogram->Buses[record->Bus];
+    if (!bus->Valid[phase]) {
+        return;
+    }
+    bus->Valid[phase] = 0;
+
+    SDT1_Sensor_TypeDef *sensor = SDT1_Sensor(histogram, record->Bus, record->Address);
+    if (sensor == NULL || histogram->Clock == 0) {
+        return;
+    }
+    // Unsigned difference, CYCCNT wraps every 53 s at 80 MHz
+    uint32_t cycles = record->Cycles - bus->Start[phase];
+    uint32_t us = (uint32_t) ((uint64_t) cycles * 1000000ULL / histogram->Clock);
+
+    sensor->Count[phase]++;
+    sensor->Bins[phase][SDT1_Bin(us)]++;
+    sensor->TotalUs[phase] += us;
+    if (us < sensor->MinUs[phase]) {
+        sensor->MinUs[phase] = us;
+    }
+    if (us > sensor->MaxUs[phase]) {
+        sensor->MaxUs[phase] = us;
+    }
+}
+
+static void SDT1_StartPhase(SDT1_Histogram_TypeDef *histogram, const SDI12_TraceRecord_TypeDef *record,
+        const SDT1_Phase_TypeDef phase) {
+    SDT1_Bus_TypeDef *bus = &histogram->Buses[record->Bus];
+    bus->Valid[phase] = 1;
+    bus->Start[phase] = record->Cycles;
+}
+
+/*
+ * Add the phases of a dump. Dumps of the same recorder can be added one
+ * after the other, a transaction split across two of them still counts.
+ */
+void SDT1_Add(SDT1_Histogram_TypeDef *histogram, const SDT1_Dump_TypeDef *dump) {
+    histogram->Clock = dump->Clock;
+
+    for (uint16_t i = 0; i < dump->Count; i++) {
+        const SDI12_TraceRecord_TypeDef *record = &dump->Records[i];
+        SDT1_Bus_TypeDef *bus = &histogram->Buses[record->Bus];
+        SDT1_Sensor_TypeDef *sensor;
+
+        switch (record->Event) {
+        case SDI12_TRACE_BREAK:
+            SDT1_StartPhase(histogram, record, SDT1_PHASE_BREAK);
+            break;
+        case SDI12_TRACE_MARKING:
+            SDT1_EndPhase(histogram, record, SDT1_PHASE_BREAK);
+            SDT1_StartPhase(histogram, record, SDT1_PHASE_COMMAND);
+            break;
+        case SDI12_TRACE_TX_DONE:
+            SDT1_EndPhase(histogram, record, SDT1_PHASE_COMMAND);
+            SDT1_StartPhase(histogram, record, SDT1_PHASE_LATENCY);
+            break;
+        case SDI12_TRACE_FIRST_BYTE:
+            SDT1_EndPhase(histogram, record, SDT1_PHASE_LATENCY);
+            SDT1_StartPhase(histogram, record, SDT1_PHASE_LINE);
+            break;
+        case SDI12_TRACE_RETRY:
+            sensor = SDT1_Sensor(histogram, record->Bus, record->Address);
+            if (sensor != NULL) {
+                sensor->Retries++;
+            }
+            memset(bus, 0, sizeof(*bus));
+            break;
+        case SDI12_TRACE_COMPLETE:
+            SDT1_EndPhase(histogram, record, SDT1_PHASE_LINE);
+            sensor = SDT1_Sensor(histogram, record->Bus, record->Address);
+            if (sensor != NULL) {
+                sensor->Transactions++;
+                if (record->Detail != 0) {
+                    sensor->Errors++;
+                }
+            }
+            memset(bus, 0, sizeof(*bus));
+            break;
+        default:
+            break;
+        }
+    }
+}
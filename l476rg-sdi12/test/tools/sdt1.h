@@ -0,0 +1,84 @@
+/*
+ ******************************************************************************
+ * @file           : sdt1.h
+ * @brief          : Host decoder of the SDI12_Trace_Dump() format ("SDT1").
+ ******************************************************************************
+ * SDT1_Decode(...) finds a dump in bytes captured from the debug link,
+ * which may carry other output around it. SDT1_Add(...) then splits its
+ * records into the transaction phases of sdi12_trace.h and keeps a latency
+ * histogram per sensor (bus and address) and phase:
+ *
+ *   BREAK    BREAK -> MARKING
+ *   COMMAND  MARKING -> TX_DONE, marking and command
+ *   LATENCY  TX_DONE -> FIRST_BYTE, the sensor
+ *   LINE     FIRST_BYTE -> COMPLETE, rest of the response
+ *
+ * Bin b counts phases of [2^b, 2^(b+1)) us, bin 0 everything below 2 us.
+ * An unanswered command (RETRY after TX_DONE) has no latency, it counts
+ * in Retries.
+ ******************************************************************************
+ */
+
+#ifndef SDT1_
+#define SDT1_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdi12_trace.h"
+
+#define SDT1_HEADER_SIZE 10
+#define SDT1_MAX_SENSORS 64
+#define SDT1_BINS 24 // Up to 16 s
+
+typedef enum {
+    SDT1_PHASE_BREAK = 0,
+    SDT1_PHASE_COMMAND,
+    SDT1_PHASE_LATENCY,
+    SDT1_PHASE_LINE,
+    SDT1_NUM_PHASES
+} SDT1_Phase_TypeDef;
+
+typedef struct {
+    uint32_t Clock; // SystemCoreClock of the recorder, Hz
+    uint16_t Count;
+    SDI12_TraceRecord_TypeDef *Records; // Count records, allocated by SDT1_Decode(...)
+} SDT1_Dump_TypeDef;
+
+typedef struct {
+    uint8_t Bus;
+    char Address;
+    uint32_t Count[SDT1_NUM_PHASES];
+    uint32_t Bins[SDT1_NUM_PHASES][SDT1_BINS];
+    uint64_t TotalUs[SDT1_NUM_PHASES];
+    uint32_t MinUs[SDT1_NUM_PHASES];
+    uint32_t MaxUs[SDT1_NUM_PHASES];
+    uint32_t Transactions; // COMPLETE records
+    uint32_t Errors; // COMPLETE with a status other than HAL_OK
+    uint32_t Retries;
+} SDT1_Sensor_TypeDef;
+
+/*
+ * Phase starts of the transaction in progress on each bus.
+ */
+typedef struct {
+    uint8_t Valid[SDT1_NUM_PHASES];
+    uint32_t Start[SDT1_NUM_PHASES];
+} SDT1_Bus_TypeDef;
+
+typedef struct {
+    uint32_t Clock;
+    SDT1_Sensor_TypeDef Sensors[SDT1_MAX_SENSORS];
+    uint8_t NumSensors;
+    SDT1_Bus_TypeDef Buses[256];
+} SDT1_Histogram_TypeDef;
+
+long SDT1_Decode(const uint8_t *data, const size_t len, SDT1_Dump_TypeDef *dump);
+void SDT1_Free(SDT1_Dump_TypeDef *dump);
+void SDT1_Histogram_Init(SDT1_Histogram_TypeDef *histogram);
+void SDT1_Add(SDT1_Histogram_TypeDef *histogram, const SDT1_Dump_TypeDef *dump);
+SDT1_Sensor_TypeDef* SDT1_Sensor(SDT1_Histogram_TypeDef *histogram, const uint8_t bus, const char addr);
+uint8_t SDT1_Bin(const uint32_t us);
+const char* SDT1_PhaseName(const SDT1_Phase_TypeDef phase);
+
+#endif // SDT1_
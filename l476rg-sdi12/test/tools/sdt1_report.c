@@ -0,0 +1,116 @@
+/*
+ ******************************************************************************
+ * @file           : sdt1_report.c
+ * @brief          : Per sensor, per phase latency histograms of SDT1 trace
+ *            dumps captured from the debug link.
+ ******************************************************************************
+ *   build/sdt1_report capture.bin [capture2.bin ...]
+ *   build/sdt1_report < capture.bin
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdt1.h"
+
+#define BAR_WIDTH 40
+
+static SDT1_Histogram_TypeDef histogram;
+
+/*
+ * Add every dump in a capture, returns how many there were.
+ */
+static unsigned AddCapture(FILE *file) {
+    size_t size = 0, capacity = 4096;
+    uint8_t *data = malloc(capacity);
+    size_t n;
+    while (data != NULL && (n = fread(&data[size], 1, capacity - size, file)) > 0) {
+        size += n;
+        if (size == capacity) {
+            capacity *= 2;
+            uint8_t *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                break;
+            }
+            data = grown;
+        }
+    }
+    if (data == NULL) {
+        return 0;
+    }
+
+    unsigned dumps = 0;
+    size_t offset = 0;
+    SDT1_Dump_TypeDef dump;
+    long end;
+    while (offset < size && (end = SDT1_Decode(&data[offset], size - offset, &dump)) > 0) {
+        SDT1_Add(&histogram, &dump);
+        SDT1_Free(&dump);
+        offset += (size_t) end;
+        dumps++;
+    }
+    free(data);
+    return dumps;
+}
+
+static void PrintPhase(const SDT1_Sensor_TypeDef *sensor, const SDT1_Phase_TypeDef phase) {
+    uint32_t count = sensor->Count[phase];
+    if (count == 0) {
+        return;
+    }
+    printf("  %-8s n=%-6u min %9.3f  mean %9.3f  max %9.3f ms\n", SDT1_PhaseName(phase), count,
+            sensor->MinUs[phase] / 1000.0, (double) sensor->TotalUs[phase] / count / 1000.0,
+            sensor->MaxUs[phase] / 1000.0);
+
+    uint32_t most = 0;
+    for (uint8_t b = 0; b < SDT1_BINS; b++) {
+        if (sensor->Bins[phase][b] > most) {
+            most = sensor->Bins[phase][b];
+        }
+    }
+    for (uint8_t b = 0; b < SDT1_BINS; b++) {
+        uint32_t n = sensor->Bins[phase][b];
+        if (n == 0) {
+            continue;
+        }
+        printf("    %9.3f ms  %6u  ", (b == 0) ? 0.0 : (1UL << b) / 1000.0, n);
+        for (uint32_t i = 0; i < (n * BAR_WIDTH + most - 1) / most; i++) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char *argv[]) {
+    SDT1_Histogram_Init(&histogram);
+
+    unsigned dumps = 0;
+    if (argc < 2) {
+        dumps = AddCapture(stdin);
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        dumps += AddCapture(file);
+        fclose(file);
+    }
+    if (dumps == 0) {
+        fprintf(stderr, "No SDT1 dump found\n");
+        return 1;
+    }
+
+    printf("%u dumps, recorder at %u Hz, bins from the lower bound\n", dumps, histogram.Clock);
+    for (uint8_t s = 0; s < histogram.NumSensors; s++) {
+        const SDT1_Sensor_TypeDef *sensor = &histogram.Sensors[s];
+        printf("\nbus %u address '%c': %u transactions, %u errors, %u retries\n", sensor->Bus,
+                sensor->Address, sensor->Transactions, sensor->Errors, sensor->Retries);
+        for (uint8_t p = 0; p < SDT1_NUM_PHASES; p++) {
+            PrintPhase(sensor, (SDT1_Phase_TypeDef) p);
+        }
+    }
+    return 0;
+}